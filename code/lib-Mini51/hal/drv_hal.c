@@ -14,6 +14,24 @@
 #define FLASH_WRITE_ADDR                (16*1024 - FLASH_PAGE_SIZE)  // use the last 0.5 KB for storage
 #define EEP_SIZE                        (FLASH_PAGE_SIZE)
 
+// the blackbox pages go below the EEPROM page, and the data flash starts with them
+#if (BLACKBOX==YES)
+#define BLACKBOX_ADDR                   (FLASH_WRITE_ADDR - BLACKBOX_PAGES * FLASH_PAGE_SIZE)
+#define DATA_FLASH_ADDR                 BLACKBOX_ADDR
+#else
+#define DATA_FLASH_ADDR                 FLASH_WRITE_ADDR
+#endif
+
+// The data flash is the top of the APROM, so the firmware has to end below DATA_FLASH_ADDR or erasing a blackbox or
+// EEPROM page erases code.  The GCC build checks this when it links (see linker/link.ld).  The Keil projects link
+// into all 16 KB, so there it is checked at startup, and the data flash is left alone if the firmware doesn't fit.
+#if defined(__CC_ARM)
+extern unsigned int Load$$LR$$LR_IROM1$$Limit;
+#define FIRMWARE_FITS() ((uint32_t) &Load$$LR$$LR_IROM1$$Limit <= DATA_FLASH_ADDR)
+#else
+#define FIRMWARE_FITS() true
+#endif
+
 static bool flash_available = false;
 static uint32_t last_write_index = FLASH_PAGE_SIZE;
 
@@ -44,8 +62,13 @@ void lib_hal_init(void)
     
     lib_timers_init();
     
+#if defined(__GNUC__) && !defined(__CC_ARM)
+    // tells linker/link.ld where the data flash starts
+    __asm__ (".global __data_flash_start\n\t.set __data_flash_start, %c0" : : "i" (DATA_FLASH_ADDR));
+#endif
+
     FMC_Open();
-    if (set_data_flash_base(FLASH_WRITE_ADDR) == 0)
+    if (FIRMWARE_FITS() && set_data_flash_base(DATA_FLASH_ADDR) == 0)
     {
         flash_available = true;
     }
@@ -118,20 +141,20 @@ void eeprom_commit(void)
 {
 }
 
-size_t eeprom_read_block(void *dst, uint16_t index, size_t size)
+static size_t read_flash_block(void *dst, uint32_t base, uint32_t index, size_t size)
 {
     if (!flash_available) return 0;
     SYS_UnlockReg();
     FMC_Open();
 
     uint8_t *write_dst = (uint8_t *) dst;
-    uint32_t addr = (FLASH_WRITE_ADDR + index) & ~ALIGN_MASK;
+    uint32_t addr = (base + index) & ~ALIGN_MASK;
     int i = index & ALIGN_MASK;
-    uint32_t endAddr = (FLASH_WRITE_ADDR + index + size + (ALIGN_SIZE-1)) & ~ALIGN_MASK;
+    uint32_t endAddr = (base + index + size + (ALIGN_SIZE-1)) & ~ALIGN_MASK;
     for (; addr < endAddr; addr += ALIGN_SIZE)
     {
         uint32_t data = FMC_Read(addr);
-        int l = FLASH_WRITE_ADDR + index + size - addr;
+        int l = base + index + size - addr;
         if (l > ALIGN_SIZE) l = ALIGN_SIZE;
         for (; i < l;) {
             *write_dst++ = ((uint8_t *) &data)[i++];
@@ -145,6 +168,41 @@ size_t eeprom_read_block(void *dst, uint16_t index, size_t size)
     return size;
 }
 
+size_t eeprom_read_block(void *dst, uint16_t index, size_t size)
+{
+    return read_flash_block(dst, FLASH_WRITE_ADDR, index, size);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Blackbox
+
+#if (BLACKBOX==YES)
+void blackbox_erase_page(uint8_t page)
+{
+    if (!flash_available) return;
+    SYS_UnlockReg();
+    FMC_Open();
+    FMC_Erase(BLACKBOX_ADDR + page * FLASH_PAGE_SIZE);
+    FMC_Close();
+    SYS_LockReg();
+}
+
+void blackbox_write_word(uint32_t index, uint32_t data)
+{
+    if (!flash_available) return;
+    SYS_UnlockReg();
+    FMC_Open();
+    FMC_Write(BLACKBOX_ADDR + index, data);
+    FMC_Close();
+    SYS_LockReg();
+}
+
+size_t blackbox_read_block(void *dst, uint32_t index, size_t size)
+{
+    return read_flash_block(dst, BLACKBOX_ADDR, index, size);
+}
+#endif
+
 
 // Copied from Nuvoton's sample code
 static int set_data_flash_base(uint32_t u32DFBA)
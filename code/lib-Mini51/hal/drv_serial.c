@@ -109,6 +109,18 @@ void uartWrite(serialPort_t *s, uint8_t ch)
 #endif
 }
 
+#if !defined(USE_PERIPH_BUFFERS)
+uint32_t uartTxFree(serialPort_t *s)
+{
+    return (s->txBufferTail + s->txBufferSize - s->txBufferHead - 1) % s->txBufferSize;
+}
+
+void uartTxCommit(serialPort_t *s, uint32_t head)
+{
+    s->txBufferHead = head;
+    UART_EnableInt(s->UARTx, UART_IER_THRE_IEN_Msk);
+}
+#endif
 
 void uartInit()
 {
@@ -22,3 +22,9 @@ void lib_hal_init(void);
 size_t eeprom_read_block (void *dst, uint16_t index, size_t size);
 size_t eeprom_write_block (const void *src, uint16_t index, size_t size);
 void eeprom_commit(void);
+// the blackbox pages of the data flash, below the EEPROM page when BLACKBOX is YES.  index is in bytes from the
+// start of the first one.  A page erase stops the cpu for about 20 ms, programming a word for about 20 us.
+#define BLACKBOX_FLASH_PAGE_SIZE 512
+void blackbox_erase_page(uint8_t page);
+void blackbox_write_word(uint32_t index, uint32_t data);
+size_t blackbox_read_block(void *dst, uint32_t index, size_t size);
@@ -61,6 +61,13 @@ void lib_digitalio_setoutput(unsigned char portandpinnumber, unsigned char value
     GPIO_PIN_ADDR(port, pin) = value ? 1 : 0;
 }
 
+digitalpin lib_digitalio_getpin(unsigned char portandpinnumber)
+{
+    uint8_t port = (portandpinnumber & 0xF0) >> 4;
+    uint8_t pin = portandpinnumber & 0x0F;
+    return &GPIO_PIN_ADDR(port, pin);
+}
+
 void lib_digitalio_setinterruptcallback(unsigned char pinnumber, digitalcallbackfunctptr callback)
 {
     // Not implemented, no need on real hardware...
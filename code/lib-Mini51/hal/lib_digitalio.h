@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <stdint.h>
 #include "projectsettings.h"
 
 #define DIGITALINPUT 0
@@ -45,3 +46,39 @@ void lib_digitalio_setoutput(unsigned char portandpinnumber,unsigned char value)
 
 typedef void (* digitalcallbackfunctptr)(unsigned char interruptnumber, unsigned char newpinstate);
 void lib_digitalio_setinterruptcallback(unsigned char portandpinnumber, digitalcallbackfunctptr callback);
+
+// Pin handles, for pins that are written in a loop.  lib_digitalio_getpin() does the port and pin decoding
+// once and returns the address of the pin's own data register, so setting, clearing, toggling or reading
+// the pin afterwards is a single load or store.  The pin still has to be set up with lib_digitalio_initpin().
+
+// digitalpin mypin=lib_digitalio_getpin(LEDOUTPUT);
+// lib_digitalio_pinon(mypin);
+
+typedef volatile uint32_t *digitalpin;
+
+digitalpin lib_digitalio_getpin(unsigned char portandpinnumber);
+
+static inline void lib_digitalio_pinset(digitalpin pin, unsigned char value)
+{
+    *pin = value ? 1 : 0;
+}
+
+static inline void lib_digitalio_pinon(digitalpin pin)
+{
+    *pin = 1;
+}
+
+static inline void lib_digitalio_pinoff(digitalpin pin)
+{
+    *pin = 0;
+}
+
+static inline void lib_digitalio_pintoggle(digitalpin pin)
+{
+    *pin ^= 1;
+}
+
+static inline unsigned char lib_digitalio_pinread(digitalpin pin)
+{
+    return *pin & 0x01;
+}
@@ -18,14 +18,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "lib_fp.h"
 #include <stdint.h>
 
-void lib_fp_constrain(fixedpointnum *lf, fixedpointnum low, fixedpointnum high)
-{
-    if (*lf < low)
-        *lf = low;
-    else if (*lf > high)
-        *lf = high;
-}
-
 // returns the equivalent angle within the range -180 and 180 degrees
 void lib_fp_constrain180(fixedpointnum *lf)
 {
@@ -35,82 +27,6 @@ void lib_fp_constrain180(fixedpointnum *lf)
         *lf -= FIXEDPOINT360;
 }
 
-//             D1 C1 B1 A1 (x)
-//           x D2 C2 B2 A2 (y)
-// -----------------------
-// z0 y0 D0 C0 B0 A0 x0 w0
-
-
-// A2*A1 -> w0,x0 (skip)
-// A2*B1 -> x0,A0 (unsigned, unsigned) 
-// A2*C1 -> A0,B0 (unsigned, unsigned) // do first
-// A2*D1 -> B0,C0 (unsigned, signed)
-// B2*A1 -> x0,A0 (unsigned, unsigned)
-// B2*B1 -> A0,B0 (unsigned, unsigned)
-// B2*C1 -> B0,C0 (unsigned, unsigned) 
-// B2*D1 -> C0,D0 (unsigned, signed) 
-// C2*A1 -> A0,B0 (unsigned, unsigned)
-// C2*B1   -> B0,C0 (unsigned, unsigned)
-// C2*C1 -> C0,D0 (unsigned, unsigned) // do second
-// C2*D1 -> D0,y0 (unsigned, signed)
-// D2*A1 -> B0,C0 (signed, unsigned)
-// D2*B1 -> C0,D0 (signed, unsigned)
-// D2*C1 -> D0,y0 (signed, unsigned)
-// D2*D1 -> y0,z0 (skip)
-
-
-// A2*C1 -> A0,B0 (unsigned, unsigned) // do first
-// C2*C1 -> C0,D0 (unsigned, unsigned)  // do second
-// B2*C1 -> B0,C0 (unsigned, unsigned)
-// D2*C1 -> D0,y0 (signed, unsigned)
-// B2*A1 -> x0,A0 (unsigned, unsigned)
-// C2*A1 -> A0,B0 (unsigned, unsigned)
-// D2*A1 -> B0,C0 (signed, unsigned)
-// A2*B1 -> x0,A0 (unsigned, unsigned) 
-// B2*B1 -> A0,B0 (unsigned, unsigned)
-// C2*B1   -> B0,C0 (unsigned, unsigned)
-// D2*B1 -> C0,D0 (signed, unsigned)
-// A2*D1 -> B0,C0 (unsigned, signed)
-// B2*D1 -> C0,D0 (unsigned, signed) 
-// C2*D1 -> D0,y0 (unsigned, signed)
-
-fixedpointnum lib_fp_multiply(fixedpointnum x, fixedpointnum y)
-{
-    // multiplies two fixed point numbers without overflowing and returns the result
-    int32_t xh = x >> FIXEDPOINTSHIFT;
-    uint32_t xl = x & 0xffff;
-    int32_t yh = y >> FIXEDPOINTSHIFT;
-    uint32_t yl = y & 0xffff;
-    return ((xh * yh) << FIXEDPOINTSHIFT) + xh * yl + yh * xl + ((xl * yl) >> FIXEDPOINTSHIFT);
-}
-
-void lib_fp_lowpassfilter(fixedpointnum *variable, fixedpointnum newvalue, fixedpointnum timesliver, fixedpointnum oneoverperiod, int timesliverextrashift)
-{   // updates a low pass filter variable.  It uses timesliver.  oneoverperiod is one over the time period
-    // over which the filter is averaged.  We use oneoverperiod to avoid having to use division.
-    // this does the equivalent of:
-    //    float fraction=timesliver/period;
-    //    variable=fraction*newvalue+(1-fraction)*variable;
-    // except it does it using fixed point arithmatic
-    // If timesliver is very small, resolution can be gained by keeping timesliver shifted left by some extra bits.
-    // Make sure variable can be also shifted left this same number of bits or else the following will overflow! 
-    fixedpointnum fraction = lib_fp_multiply(timesliver, oneoverperiod);
-
-    *variable = (lib_fp_multiply(fraction, newvalue) + lib_fp_multiply((FIXEDPOINTONE << timesliverextrashift) - fraction, *variable)) >> timesliverextrashift;
-
-    // the adder combines adding .5 for rounding error and adding .5 in the direction the newvalue is trying to pull us
-    // So we can zero in on the desired value.
-    if (newvalue > *variable)
-        ++ * variable;
-}
-
-fixedpointnum lib_fp_abs(fixedpointnum fp)
-{
-    if (fp < 0)
-        return (-fp);
-    else
-        return (fp);
-}
-
 // we may be able to make these unsigned ints and save space
 static const fixedpointnum biganglesinelookup[] = {  // every 8 degrees
     0,                          // sine(0)
@@ -49,7 +49,7 @@ static serialPort_t *lib_serial_getport(unsigned char serialportnumber)
 int lib_serial_availableoutputbuffersize(unsigned char serialportnumber)
 {
     // returns how many more bytes can fit in the outputbuffer
-    return 256; // TODO who cares
+    return uartTxFree(lib_serial_getport(serialportnumber));
 }
 
 // TODO: not implemented
@@ -96,6 +96,44 @@ void lib_serial_senddata(unsigned char serialportnumber, unsigned char *data, in
         lib_serial_sendchar(serialportnumber, *data++);
 }
 
+// wait for room for as much of the rest of the frame as fits in the buffer, or for one more byte if more
+// was written than the frame was begun with
+static void lib_serial_reserveframe(serialPort_t *port, serialframestruct * frame)
+{
+    int wanted = frame->unreserved;
+    if (wanted > (int) port->txBufferSize - 1)
+        wanted = port->txBufferSize - 1;
+    if (wanted < 1)
+        wanted = 1;
+    while (uartTxFree(port) < (uint32_t) wanted);
+    frame->room = wanted;
+    frame->unreserved = wanted < frame->unreserved ? frame->unreserved - wanted : 0;
+}
+
+void lib_serial_beginframe(unsigned char serialportnumber, serialframestruct * frame, int length)
+{
+    serialPort_t *port = lib_serial_getport(serialportnumber);
+    frame->serialportnumber = serialportnumber;
+    frame->buffer = port->txBuffer;
+    frame->size = port->txBufferSize;
+    frame->head = port->txBufferHead;
+    frame->unreserved = length;
+    lib_serial_reserveframe(port, frame);
+}
+
+void lib_serial_extendframe(serialframestruct * frame)
+{
+    // send what is written so far, the room for the rest frees up while it goes out
+    serialPort_t *port = lib_serial_getport(frame->serialportnumber);
+    uartTxCommit(port, frame->head);
+    lib_serial_reserveframe(port, frame);
+}
+
+void lib_serial_sendframe(serialframestruct * frame)
+{
+    uartTxCommit(lib_serial_getport(frame->serialportnumber), frame->head);
+}
+
 int lib_serial_numcharsavailable(unsigned char serialportnumber)
 {
     // returns number of characters available in the rx buffer
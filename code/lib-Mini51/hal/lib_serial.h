@@ -30,5 +30,32 @@ int lib_serial_availableoutputbuffersize(unsigned char serialportnumber);
 typedef void (* serialcallbackfunctptr)(unsigned char c);
 void lib_serial_setrxcallback(unsigned char serialportnumber,serialcallbackfunctptr callback);
 
+// Frames are written straight into the send buffer.  lib_serial_beginframe() reserves room for the whole frame,
+// the bytes go in with lib_serial_framechar() and lib_serial_sendframe() hands them to the interrupt in one go.
+// A frame longer than the buffer goes out in pieces, each one as soon as there is room for the next.  Nothing
+// else can be sent on the port between lib_serial_beginframe() and lib_serial_sendframe().
+typedef struct {
+    volatile unsigned char *buffer;
+    unsigned int head;                  // where the next byte goes, the interrupt stops short of it
+    unsigned int size;
+    int room;                           // reserved bytes that haven't been written yet
+    int unreserved;                     // bytes of the frame that there wasn't room for yet
+    unsigned char serialportnumber;
+} serialframestruct;
+
+void lib_serial_beginframe(unsigned char serialportnumber, serialframestruct * frame, int length);
+void lib_serial_extendframe(serialframestruct * frame);
+void lib_serial_sendframe(serialframestruct * frame);
+
+static inline void lib_serial_framechar(serialframestruct * frame, unsigned char c)
+{
+    if (!frame->room)
+        lib_serial_extendframe(frame);
+    frame->buffer[frame->head] = c;
+    if (++frame->head == frame->size)
+        frame->head = 0;
+    frame->room--;
+}
+
 
 #define USBPORTNUMBER 5
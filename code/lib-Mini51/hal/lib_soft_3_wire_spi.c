@@ -18,68 +18,63 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "hal.h"
 #include "lib_soft_3_wire_spi.h"
 
-static uint8_t pin_SDIO, pin_SCK, pin_SCS;
-void lib_soft_3_wire_spi_setSCK(uint8_t state);
-void lib_soft_3_wire_spi_setSDIO(uint8_t state);
+// Bit banged 3-wire SPI.  The A7105 sits on P1.2-P1.4, which can't be routed to the SPI peripheral (it only
+// comes out on port 0), so the bits are toggled by hand.  Going through lib_digitalio_setoutput() costs a
+// call and a port/pin decode for every edge, so the pins are resolved to handles once in
+// lib_soft_3_wire_spi_init() and each edge is a single store.  SDIO changes direction by flipping its two
+// bits in PMD.
+// At 22.1184 MHz a clock pulse is two stores, about 90 ns high, which is within the A7105's 10 MHz SPI.
+
+static digitalpin pin_SDIO, pin_SCK, pin_SCS;
+static volatile uint32_t *mode_SDIO;
+static uint32_t modemask_SDIO, modeoutput_SDIO;
 
 void lib_soft_3_wire_spi_setCS(uint8_t state)
 {
-    lib_digitalio_setoutput( pin_SCS, state);
+    lib_digitalio_pinset(pin_SCS, state);
 }
 
-void lib_soft_3_wire_spi_setSCK(uint8_t state)
+void lib_soft_3_wire_spi_init(uint8_t SDIO_portandpinnumber, uint8_t SCK_portandpinnumber, uint8_t SCS_portandpinnumber )
 {
-    lib_digitalio_setoutput( pin_SCK, state);
-}
+    lib_digitalio_initpin(SDIO_portandpinnumber, DIGITALOUTPUT);
+    lib_digitalio_initpin(SCK_portandpinnumber, DIGITALOUTPUT);
+    lib_digitalio_initpin(SCS_portandpinnumber, DIGITALOUTPUT);
 
-void lib_soft_3_wire_spi_setSDIO(uint8_t state)
-{
-    lib_digitalio_setoutput( pin_SDIO, state);
-}
+    pin_SDIO = lib_digitalio_getpin(SDIO_portandpinnumber);
+    pin_SCK = lib_digitalio_getpin(SCK_portandpinnumber);
+    pin_SCS = lib_digitalio_getpin(SCS_portandpinnumber);
+    mode_SDIO = &((GPIO_T *) (P0_BASE + 0x40 * ((SDIO_portandpinnumber & 0xF0) >> 4)))->PMD;
+    modemask_SDIO = 0x3 << ((SDIO_portandpinnumber & 0x0F) << 1);
+    modeoutput_SDIO = GPIO_PMD_OUTPUT << ((SDIO_portandpinnumber & 0x0F) << 1);
 
-void lib_soft_3_wire_spi_init(uint8_t SDIO_portandpinnumber, uint8_t SCK_portandpinnumber, uint8_t SCS_portandpinnumber )
-{
-    pin_SDIO = SDIO_portandpinnumber;
-    pin_SCK = SCK_portandpinnumber;
-    pin_SCS = SCS_portandpinnumber;
-    lib_digitalio_initpin(pin_SDIO, DIGITALOUTPUT);
-    lib_digitalio_initpin(pin_SCK, DIGITALOUTPUT);
-    lib_digitalio_initpin(pin_SCS, DIGITALOUTPUT);
     lib_soft_3_wire_spi_setCS(DIGITALOFF);
-    lib_soft_3_wire_spi_setSDIO(DIGITALOFF);
-    lib_soft_3_wire_spi_setSCK(DIGITALOFF);
+    lib_digitalio_pinoff(pin_SDIO);
+    lib_digitalio_pinoff(pin_SCK);
 }
 
 void lib_soft_3_wire_spi_write(uint8_t data) 
 {  
     uint8_t n=8; 
-    lib_soft_3_wire_spi_setSCK(DIGITALOFF);
-    lib_soft_3_wire_spi_setSDIO(DIGITALOFF);
+    lib_digitalio_pinoff(pin_SCK);
     while(n--) {
-        if(data&0x80) // MSB first
-            lib_soft_3_wire_spi_setSDIO(DIGITALON);
-        else 
-            lib_soft_3_wire_spi_setSDIO(DIGITALOFF);
-		lib_soft_3_wire_spi_setSCK(DIGITALON);
-		lib_soft_3_wire_spi_setSCK(DIGITALOFF);
+        lib_digitalio_pinset(pin_SDIO, data >> 7); // MSB first
+        lib_digitalio_pinon(pin_SCK);
+        lib_digitalio_pinoff(pin_SCK);
         data = data << 1;
     }
-    lib_soft_3_wire_spi_setSDIO(DIGITALON);
+    lib_digitalio_pinon(pin_SDIO);
 }
 
 uint8_t lib_soft_3_wire_spi_read(void) 
 {
     uint8_t result=0;
     uint8_t i;
-    lib_digitalio_initpin( pin_SDIO, DIGITALINPUT); 
+    *mode_SDIO &= ~modemask_SDIO;       // input
     for(i=0;i<8;i++) {                    
-        if( lib_digitalio_getinput(pin_SDIO)) 
-            result=(result<<1)|0x01;
-        else
-            result=result<<1;
-        lib_soft_3_wire_spi_setSCK(DIGITALON);
-        lib_soft_3_wire_spi_setSCK(DIGITALOFF);
+        result = (result << 1) | lib_digitalio_pinread(pin_SDIO);
+        lib_digitalio_pinon(pin_SCK);
+        lib_digitalio_pinoff(pin_SCK);
     }
-    lib_digitalio_initpin( pin_SDIO, DIGITALOUTPUT);
+    *mode_SDIO |= modeoutput_SDIO;
     return result;
 }
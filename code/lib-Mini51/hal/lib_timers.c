@@ -19,10 +19,11 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "lib_timers.h"
 
 // This code creates a timer to count microseconds and includes support for using this timer to run multiple
-// software timers.  The timer can run on either TIMER0 or TIMER1.  When run on TIMER1, a 16 bit timer is used
-// which gives us microsecond resolution and less interrupt overhead.  When run on TIMER0, we get 4 microsecond
-// resolution and more overhead.  Unsigned longs are used to store microseconds, so the longest intervals that
-// can be measured without extra code is about 70 minutes.
+// software timers.  TIMER1 counts HCLK cycles and interrupts once a millisecond.  The microseconds within the
+// millisecond come from its counter.  The Cortex-M0 has no divide instruction, so the cycles are converted
+// with a multiply by the reciprocal and a shift instead of a division.  SysTick is left to CLK_SysTickDelay().
+// Unsigned longs are used to store microseconds, so the longest intervals that can be measured without extra
+// code is about 70 minutes.
 
 // Usage:
 
@@ -35,22 +36,48 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // inittimers();
 //    lib_timers_delaymilliseconds(500) {}
 
-// current uptime for 1kHz systick timer. will rollover after 49 days. hopefully we won't care.
-static volatile uint32_t sysTickUptime = 0;
-static uint32_t sysTickLimit;
+// current uptime for 1kHz timer. will rollover after 49 days. hopefully we won't care.
+static volatile uint32_t millisecondsuptime = 0;
 
-// SysTick
-void SysTick_Handler(void)
+// microseconds = (cycles * cyclestomicroseconds) >> CYCLESTOMICROSECONDSSHIFT.  A millisecond is about
+// 22118 cycles, the largest product is about 2^30 so it doesn't overflow.
+#define CYCLESTOMICROSECONDSSHIFT 20
+static uint32_t cyclestomicroseconds;
+
+// control loop tick, counted by the TIMER0 interrupt
+static volatile uint32_t periodicticks = 0;
+static uint32_t lastperiodicticks;
+
+void TMR1_IRQHandler(void)
 {
-    sysTickUptime++;
+    TIMER_ClearIntFlag(TIMER1);
+    millisecondsuptime++;
+}
+
+void TMR0_IRQHandler(void)
+{
+    TIMER_ClearIntFlag(TIMER0);
+    periodicticks++;
 }
 
 // needs to be called once in the program before timers can be used
 void lib_timers_init(void)
-{                               
-    // SysTick
-    sysTickLimit = SystemCoreClock / 1000;
-    SysTick_Config(sysTickLimit);
+{
+    // lib_hal_init() and main() both call this.  Starting over would throw away the uptime.
+    if (TIMER1->TCSR & TIMER_TCSR_CEN_Msk)
+        return;
+
+    // the divisions are done here, once
+    cyclestomicroseconds = (uint32_t) (((1000000ULL << CYCLESTOMICROSECONDSSHIFT) + SystemCoreClock / 2) / SystemCoreClock);
+
+    // TIMER1 counts HCLK without a prescaler and restarts every millisecond.  TDR_EN keeps the counter readable.
+    CLK_EnableModuleClock(TMR1_MODULE);
+    CLK_SetModuleClock(TMR1_MODULE, CLK_CLKSEL1_TMR1_S_HCLK, 0);
+    TIMER1->TCSR = TIMER_PERIODIC_MODE | TIMER_TCSR_TDR_EN_Msk;
+    TIMER1->TCMPR = SystemCoreClock / 1000;
+    TIMER_EnableInt(TIMER1);
+    NVIC_EnableIRQ(TMR1_IRQn);
+    TIMER_Start(TIMER1);
 }
 
 uint32_t lib_timers_getcurrentmicroseconds(void)
@@ -58,11 +85,10 @@ uint32_t lib_timers_getcurrentmicroseconds(void)
     // returns microseconds since startup.  This mainly used internally because it wraps around.
     register uint32_t ms, cycle_cnt;
     do {
-        ms = sysTickUptime;
-        cycle_cnt = SysTick->VAL;
-    } while (ms != sysTickUptime);
-    // goebish timer patch, modified by victzh for performance and clarity
-    return (ms * 1000) + (sysTickLimit - cycle_cnt) / CyclesPerUs;
+        ms = millisecondsuptime;
+        cycle_cnt = TIMER1->TDR;
+    } while (ms != millisecondsuptime);
+    return (ms * 1000) + ((cycle_cnt * cyclestomicroseconds) >> CYCLESTOMICROSECONDSSHIFT);
 }
 
 unsigned long lib_timers_gettimermicroseconds(unsigned long starttime)
@@ -105,3 +131,42 @@ void lib_timers_delaymilliseconds(unsigned long delaymilliseconds)
     while (lib_timers_gettimermicroseconds(timercounts) < delaymilliseconds * 1000L) {
     }
 }
+
+void lib_timers_startperiodictick(unsigned long frequency)
+{
+    // run TIMER0 from HCLK and interrupt frequency times a second
+    SYS_UnlockReg();
+    CLK_EnableModuleClock(TMR0_MODULE);
+    CLK_SetModuleClock(TMR0_MODULE, CLK_CLKSEL1_TMR0_S_HCLK, 0);
+    SYS_LockReg();
+
+    TIMER_Open(TIMER0, TIMER_PERIODIC_MODE, frequency);
+    TIMER_EnableInt(TIMER0);
+    NVIC_EnableIRQ(TMR0_IRQn);
+    lastperiodicticks = periodicticks;
+    TIMER_Start(TIMER0);
+}
+
+unsigned char lib_timers_waitforperiodictick(void)
+{
+    // sleeps until the next tick and returns the number of ticks since the last call.  More than one
+    // means that the caller ran over its period.
+    uint32_t ticks;
+    for (;;) {
+        // interrupts are masked between the check and the sleep, so a tick can't slip in between them.
+        // A pending interrupt still wakes up the WFI, and runs as soon as they are unmasked.
+        __disable_irq();
+        ticks = periodicticks;
+        if (ticks != lastperiodicticks)
+            break;
+        __WFI();
+        __enable_irq();
+    }
+    __enable_irq();
+
+    ticks -= lastperiodicticks;
+    lastperiodicticks += ticks;
+    if (ticks > 255)
+        ticks = 255;
+    return (ticks);
+}
@@ -22,3 +22,5 @@ unsigned long lib_timers_starttimer(void);
 unsigned long lib_timers_gettimermicroseconds(unsigned long starttime);
 unsigned long lib_timers_gettimermicrosecondsandreset(unsigned long *starttime);
 void    lib_timers_delaymilliseconds(unsigned long delaymilliseconds);
+void    lib_timers_startperiodictick(unsigned long frequency);
+unsigned char lib_timers_waitforperiodictick(void);
@@ -0,0 +1,853 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Decodes the A7105 SPI traffic of a Saleae Logic CSV export (time,packet id,MOSI: 0xNN rows, the input of
+// reverse/A7105/quadcsv.py) without holding the capture in memory, and keeps what it found in an index next to
+// it, so that questions like "the 0x20 packets on channel 0x28 between 3 s and 4 s" are answered from the
+// index instead of from the capture.  The capture is mapped, not read, and cut into chunks at line boundaries
+// that a pool of threads decodes into frames.  The frames are then written in order, with repeats of the
+// same frame folded into one entry as quadcsv.py does, followed by snapshots of the register writes every
+// CHECKPOINTENTRIES entries and lists of the entries by FIFO packet type (the first payload byte) and by
+// channel (PLL Register I at the time).  An index that is older than the capture, or of another size, is
+// made again.
+//
+// Listed frames are decoded the way a7105.py does it and come out in the format of the decoded captures in
+// reverse/A7105/rawdata, so they can go straight into rxtiming-check and rx-replay.  The one difference is
+// the time: quadcsv.py stamps each line with the start of the frame after it, here it is the frame's own.
+
+#define INDEXMAGIC          "A7105IX1"
+#define MAXFRAMEBYTES       24          // kept in the index, an A7105 FIFO frame is 17
+#define MAXPARSEBYTES       256         // compared when folding repeats
+#define MINCHUNKBYTES       (1 << 20)
+#define MAXCHUNKBYTES       (16 << 20)
+#define CHUNKSPERTHREAD     4
+#define CHECKPOINTENTRIES   4096
+#define NUMREGISTERS        0x33
+
+#define STROBE_BIT          0x80
+#define READ_BIT            0x40
+#define REG_MODE            0x00
+#define REG_FIFO            0x05
+#define REG_PLL1            0x0F
+#define REG_PLL2            0x10
+#define REG_PLL3            0x11
+#define REG_PLL4            0x12
+#define REG_PLL5            0x13
+#define REG_RSSI            0x1D
+#define FXTAL               16000000.0
+
+#define ENTRY_CHANNELKNOWN  0x01        // PLL Register I has been written before this entry
+
+typedef struct {
+    int64_t time;               // nanoseconds, from the capture's time column
+    uint32_t repeats;           // identical frames straight after this one
+    uint8_t length;             // bytes in the frame, only the first MAXFRAMEBYTES are kept
+    uint8_t channel;            // PLL Register I after this frame
+    uint8_t flags;
+    uint8_t reserved;
+    uint8_t bytes[MAXFRAMEBYTES];
+} captureentry;
+
+typedef struct {
+    uint8_t registers[NUMREGISTERS];    // the last value written to each register, before the entry
+    uint8_t reserved[56 - NUMREGISTERS];
+} capturecheckpoint;
+
+// followed by the entries, the checkpoints, then typestart[257] and the entry numbers by type, and
+// channelstart[257] and the entry numbers by channel, each of these starting on 8 bytes
+typedef struct {
+    char magic[8];
+    uint64_t sourcesize;        // of the capture the index was made from
+    int64_t sourcemtime;
+    uint64_t entries;
+    uint64_t frames;
+    uint64_t reserved;
+} captureindexheader;
+
+typedef struct {
+    size_t start, end;          // the frames that start on a line in here
+    captureentry *entries;
+    size_t count, size;
+    uint64_t frames;
+    bool done;
+} capturechunk;
+
+typedef struct {
+    const captureindexheader *header;
+    const captureentry *entries;
+    const capturecheckpoint *checkpoints;
+    const uint64_t *typestart, *channelstart;
+    const uint32_t *types, *channels;
+} captureindex;
+
+static const char *strobes[8] = {
+    "Sleep Mode", "Idle Mode", "Standby Mode", "PLL Mode", "RX Mode", "TX Mode",
+    "FIFO Write pointer reset", "FIFO Read pointer reset"
+};
+
+static const char *registernames[NUMREGISTERS] = {
+    "Mode Register", "Mode Control Register", "Calibration Control Register", "FIFO Register I",
+    "FIFO Register II", "FIFO DATA Register", "ID DATA Register", "RC OSC Register I",
+    "RC OSC Register II", "RC OSC Register III", "CKO Pin Control Register", "GIO1 Pin Control Register I",
+    "GIO2 Pin Control Register II", "Clock Register", "Data Rate Register", "PLL Register I",
+    "PLL Register II", "PLL Register III", "PLL Register IV", "PLL Register V",
+    "TX Register I", "TX Register II", "Delay Register I", "Delay Register II",
+    "RX Register", "RX Gain Register I", "RX Gain Register II", "RX Gain Register III",
+    "RX Gain Register IV", "RSSI Threshold Register", "ADC Control Register", "Code Register I",
+    "Code Register II", "Code Register III", "IF Calibration Register I", "IF Calibration Register II",
+    "VCO current Calibration Register", "VCO Single band Calibration Register I",
+    "VCO Single band Calibration Register II", "Battery detect Register",
+    "TX test Register", "Rx DEM test Register I", "Rx DEM test Register II", "Charge Pump Current Register",
+    "Crystal test Register", "PLL test Register", "VCO test Register I", "VCO test Register II",
+    "IFAT Register", "RScale Register", "Filter test Register"
+};
+
+static const char *capture;
+static size_t capturesize;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    capturechunk *chunks;
+    size_t count;
+    size_t next;                // the next chunk to decode
+    size_t written;             // chunks that are in the index
+    size_t window;              // chunks that can be decoded ahead of the writing
+} work = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static double seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static size_t align8(size_t offset)
+{
+    return (offset + 7) & ~(size_t) 7;
+}
+
+static int hexdigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// one row of the export, false for the header and anything else that isn't one
+static bool parseline(const char *p, const char *end, int64_t *time, long long *id, uint8_t *byte)
+{
+    bool negative = p < end && *p == '-';
+    if (negative)
+        p++;
+    if (p >= end || *p < '0' || *p > '9')
+        return false;
+    int64_t whole = 0, fraction = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        whole = whole * 10 + (*p++ - '0');
+    int digits = 0;
+    if (p < end && *p == '.')
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+            if (digits < 9) {
+                fraction = fraction * 10 + (*p - '0');
+                digits++;
+            }
+    for (; digits < 9; digits++)
+        fraction *= 10;
+    *time = negative ? -(whole * 1000000000LL + fraction) : whole * 1000000000LL + fraction;
+    if (p >= end || *p++ != ',')
+        return false;
+
+    // the packet id is empty at times, quadcsv.py takes that as -1
+    *id = -1;
+    if (p < end && *p >= '0' && *p <= '9')
+        for (*id = 0; p < end && *p >= '0' && *p <= '9'; p++)
+            *id = *id * 10 + (*p - '0');
+    if (p >= end || *p++ != ',')
+        return false;
+
+    while (p < end && *p == ' ')
+        p++;
+    if (end - p >= 5 && !memcmp(p, "MOSI:", 5))
+        for (p += 5; p < end && *p == ' '; p++)
+            ;
+    if (end - p < 3 || p[0] != '0' || (p[1] != 'x' && p[1] != 'X') || hexdigit(p[2]) < 0)
+        return false;
+    int value = hexdigit(p[2]);
+    if (end - p >= 4 && hexdigit(p[3]) >= 0)
+        value = (value << 4) | hexdigit(p[3]);
+    *byte = (uint8_t) value;
+    return true;
+}
+
+static const char *nextline(const char *p)
+{
+    const char *newline = memchr(p, '\n', capture + capturesize - p);
+    return newline ? newline + 1 : capture + capturesize;
+}
+
+static void addentry(capturechunk *chunk, int64_t time, const uint8_t *bytes, unsigned length)
+{
+    if (chunk->count == chunk->size) {
+        chunk->size = chunk->size ? chunk->size * 2 : 4096;
+        chunk->entries = realloc(chunk->entries, chunk->size * sizeof(captureentry));
+        if (!chunk->entries) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    captureentry *entry = &chunk->entries[chunk->count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->time = time;
+    entry->length = length > 255 ? 255 : length;
+    memcpy(entry->bytes, bytes, length < MAXFRAMEBYTES ? length : MAXFRAMEBYTES);
+}
+
+/**
+ * @brief      Decode the frames that start in a chunk
+ * @param      chunk
+ * @return     None
+ * @details    A frame is the rows with the same packet id.  The rows at the start of the chunk that carry on
+ *             the last frame of the chunk before are skipped, that chunk reads on past its end to finish it.
+ *             A frame that is the same as the one before only counts as a repeat of it.
+ */
+static void decodechunk(capturechunk *chunk)
+{
+    const char *p = capture + chunk->start, *end = capture + chunk->end, *fileend = capture + capturesize;
+    int64_t time, frametime = 0;
+    long long id, frameid = 0, previousid = 0;
+    uint8_t byte;
+    bool inframe = false, skipping = false;
+    static __thread uint8_t frame[MAXPARSEBYTES], last[MAXPARSEBYTES];
+    unsigned length = 0, lastlength = 0;
+    bool havelast = false;
+
+    // the id of the last row before the chunk
+    if (chunk->start) {
+        const char *line = p;
+        while (line > capture && !skipping) {
+            const char *lineend = line;
+            for (line--; line > capture && line[-1] != '\n'; line--)
+                ;
+            skipping = parseline(line, lineend, &time, &previousid, &byte);
+        }
+    }
+
+    for (const char *next; p < fileend; p = next) {
+        next = nextline(p);
+        if (!parseline(p, next, &time, &id, &byte))
+            continue;
+        if (skipping && id == previousid)
+            continue;
+        skipping = false;
+
+        if (!inframe || id != frameid) {
+            if (p >= end)
+                break;
+            if (inframe) {
+                unsigned compared = length < MAXPARSEBYTES ? length : MAXPARSEBYTES;
+                if (havelast && length == lastlength && !memcmp(frame, last, compared))
+                    chunk->entries[chunk->count - 1].repeats++;
+                else
+                    addentry(chunk, frametime, frame, length);
+                memcpy(last, frame, compared);
+                lastlength = length;
+                havelast = true;
+                chunk->frames++;
+            }
+            inframe = true;
+            frameid = id;
+            frametime = time;
+            length = 0;
+        }
+        if (length < MAXPARSEBYTES)
+            frame[length] = byte;
+        length++;
+    }
+
+    if (inframe) {
+        unsigned compared = length < MAXPARSEBYTES ? length : MAXPARSEBYTES;
+        if (havelast && length == lastlength && !memcmp(frame, last, compared))
+            chunk->entries[chunk->count - 1].repeats++;
+        else
+            addentry(chunk, frametime, frame, length);
+        chunk->frames++;
+    }
+}
+
+static void *worker(void *unused)
+{
+    for (;;) {
+        pthread_mutex_lock(&work.lock);
+        while (work.next < work.count && work.next >= work.written + work.window)
+            pthread_cond_wait(&work.changed, &work.lock);
+        if (work.next >= work.count) {
+            pthread_mutex_unlock(&work.lock);
+            return NULL;
+        }
+        capturechunk *chunk = &work.chunks[work.next++];
+        pthread_mutex_unlock(&work.lock);
+
+        decodechunk(chunk);
+
+        pthread_mutex_lock(&work.lock);
+        chunk->done = true;
+        pthread_cond_broadcast(&work.changed);
+        pthread_mutex_unlock(&work.lock);
+    }
+}
+
+static bool samebytes(const captureentry *a, const captureentry *b)
+{
+    return a->length == b->length && a->length <= MAXFRAMEBYTES && !memcmp(a->bytes, b->bytes, a->length);
+}
+
+// a FIFO frame, read or written, with a payload to take the type from
+static bool fifoframe(const captureentry *entry)
+{
+    return !(entry->bytes[0] & STROBE_BIT) && (entry->bytes[0] & ~READ_BIT) == REG_FIFO && entry->length >= 2;
+}
+
+static bool registerwrite(const captureentry *entry)
+{
+    return !(entry->bytes[0] & (STROBE_BIT | READ_BIT)) && entry->bytes[0] < NUMREGISTERS && entry->length >= 2;
+}
+
+static bool openindex(const char *indexname, const struct stat *source, captureindex *index)
+{
+    int fd = open(indexname, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat status;
+    if (fstat(fd, &status) || (size_t) status.st_size < sizeof(captureindexheader)) {
+        close(fd);
+        return false;
+    }
+    const char *base = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return false;
+
+    const captureindexheader *header = (const captureindexheader *) base;
+    size_t offset = sizeof(*header), checkpoints = (header->entries + CHECKPOINTENTRIES - 1) / CHECKPOINTENTRIES;
+    if (memcmp(header->magic, INDEXMAGIC, 8) || header->sourcesize != (uint64_t) source->st_size
+        || header->sourcemtime != (int64_t) source->st_mtime) {
+        munmap((void *) base, status.st_size);
+        return false;
+    }
+    index->header = header;
+    index->entries = (const captureentry *) (base + offset);
+    offset += header->entries * sizeof(captureentry);
+    index->checkpoints = (const capturecheckpoint *) (base + offset);
+    offset += checkpoints * sizeof(capturecheckpoint);
+    index->typestart = (const uint64_t *) (base + offset);
+    offset += 257 * sizeof(uint64_t);
+    index->types = (const uint32_t *) (base + offset);
+    offset = align8(offset + index->typestart[256] * sizeof(uint32_t));
+    index->channelstart = (const uint64_t *) (base + offset);
+    offset += 257 * sizeof(uint64_t);
+    index->channels = (const uint32_t *) (base + offset);
+    return true;
+}
+
+/**
+ * @brief      Decode a capture into an index
+ * @param      capturename, indexname, source  the capture's stat, threads
+ * @return     0, or 1 if the index couldn't be written
+ * @details    The index is written to indexname.tmp and renamed when it is complete.
+ */
+static int buildindex(const char *capturename, const char *indexname, const struct stat *source, int threads)
+{
+    double started = seconds();
+    int fd = open(capturename, O_RDONLY);
+    if (fd < 0) {
+        perror(capturename);
+        return 1;
+    }
+    capturesize = source->st_size;
+    capture = capturesize ? mmap(NULL, capturesize, PROT_READ, MAP_PRIVATE, fd, 0) : "";
+    close(fd);
+    if (capture == MAP_FAILED) {
+        perror(capturename);
+        return 1;
+    }
+    if (capturesize)
+        madvise((void *) capture, capturesize, MADV_SEQUENTIAL);
+
+    // cut at line starts
+    size_t chunkbytes = capturesize / (threads * CHUNKSPERTHREAD);
+    if (chunkbytes < MINCHUNKBYTES)
+        chunkbytes = MINCHUNKBYTES;
+    if (chunkbytes > MAXCHUNKBYTES)
+        chunkbytes = MAXCHUNKBYTES;
+    work.count = capturesize / chunkbytes + 1;
+    work.chunks = calloc(work.count, sizeof(capturechunk));
+    size_t start = 0, count = 0;
+    while (start < capturesize) {
+        size_t end = start + chunkbytes;
+        end = end >= capturesize ? capturesize : (size_t) (nextline(capture + end) - capture);
+        work.chunks[count].start = start;
+        work.chunks[count++].end = end;
+        start = end;
+    }
+    work.count = count;
+    work.next = work.written = 0;
+    work.window = threads * CHUNKSPERTHREAD;
+
+    pthread_t *workers = calloc(threads, sizeof(pthread_t));
+    for (int i = 0; i < threads; ++i)
+        pthread_create(&workers[i], NULL, worker, NULL);
+
+    char tmpname[4096 + 8];
+    snprintf(tmpname, sizeof(tmpname), "%s.tmp", indexname);
+    FILE *file = fopen(tmpname, "w+b");
+    if (!file) {
+        perror(tmpname);
+        exit(1);
+    }
+    captureindexheader header;
+    memset(&header, 0, sizeof(header));
+    fwrite(&header, sizeof(header), 1, file);
+
+    // in order, so that the registers and the channel follow the writes, and repeats on either side of a
+    // chunk boundary fold together
+    uint8_t registers[NUMREGISTERS] = { 0 };
+    bool channelknown = false;
+    uint64_t typecount[256] = { 0 }, channelcount[256] = { 0 };
+    capturecheckpoint *checkpoints = NULL;
+    size_t numcheckpoints = 0;
+    captureentry pending;
+    bool havepending = false;
+
+    for (size_t i = 0; i <= work.count; ++i) {
+        capturechunk *chunk = NULL;
+        if (i < work.count) {
+            chunk = &work.chunks[i];
+            pthread_mutex_lock(&work.lock);
+            while (!chunk->done)
+                pthread_cond_wait(&work.changed, &work.lock);
+            pthread_mutex_unlock(&work.lock);
+            header.frames += chunk->frames;
+        }
+
+        for (size_t j = 0; chunk ? j < chunk->count : havepending; ++j) {
+            if (chunk && havepending && samebytes(&pending, &chunk->entries[j])) {
+                pending.repeats += 1 + chunk->entries[j].repeats;
+                continue;
+            }
+            if (havepending) {
+                if (!(header.entries % CHECKPOINTENTRIES)) {
+                    checkpoints = realloc(checkpoints, (numcheckpoints + 1) * sizeof(capturecheckpoint));
+                    memset(&checkpoints[numcheckpoints], 0, sizeof(capturecheckpoint));
+                    memcpy(checkpoints[numcheckpoints++].registers, registers, NUMREGISTERS);
+                }
+                if (registerwrite(&pending)) {
+                    registers[pending.bytes[0]] = pending.bytes[1];
+                    if (pending.bytes[0] == REG_PLL1)
+                        channelknown = true;
+                }
+                pending.channel = registers[REG_PLL1];
+                pending.flags = channelknown ? ENTRY_CHANNELKNOWN : 0;
+                if (fifoframe(&pending))
+                    typecount[pending.bytes[1]]++;
+                if (channelknown)
+                    channelcount[pending.channel]++;
+                fwrite(&pending, sizeof(pending), 1, file);
+                header.entries++;
+            }
+            if ((havepending = chunk != NULL))
+                pending = chunk->entries[j];
+        }
+
+        if (chunk) {
+            free(chunk->entries);
+            chunk->entries = NULL;
+            pthread_mutex_lock(&work.lock);
+            work.written++;
+            pthread_cond_broadcast(&work.changed);
+            pthread_mutex_unlock(&work.lock);
+        }
+    }
+    for (int i = 0; i < threads; ++i)
+        pthread_join(workers[i], NULL);
+    free(workers);
+    free(work.chunks);
+    if (capturesize)
+        munmap((void *) capture, capturesize);
+
+    fwrite(checkpoints, sizeof(capturecheckpoint), numcheckpoints, file);
+    free(checkpoints);
+
+    // the lists by type and by channel go in where the counts say once all the entries are written
+    uint64_t typestart[257], channelstart[257];
+    typestart[0] = channelstart[0] = 0;
+    for (int i = 0; i < 256; ++i) {
+        typestart[i + 1] = typestart[i] + typecount[i];
+        channelstart[i + 1] = channelstart[i] + channelcount[i];
+    }
+    size_t entriesoffset = sizeof(header);
+    size_t typeoffset = entriesoffset + header.entries * sizeof(captureentry) + numcheckpoints * sizeof(capturecheckpoint);
+    size_t channeloffset = align8(typeoffset + sizeof(typestart) + typestart[256] * sizeof(uint32_t));
+    size_t total = channeloffset + sizeof(channelstart) + channelstart[256] * sizeof(uint32_t);
+    fseek(file, typeoffset, SEEK_SET);
+    fwrite(typestart, sizeof(typestart), 1, file);
+    fseek(file, channeloffset, SEEK_SET);
+    fwrite(channelstart, sizeof(channelstart), 1, file);
+    fflush(file);
+    if (ftruncate(fileno(file), total)) {
+        perror(tmpname);
+        exit(1);
+    }
+
+    char *base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(file), 0);
+    if (base == MAP_FAILED) {
+        perror(tmpname);
+        exit(1);
+    }
+    const captureentry *entries = (const captureentry *) (base + entriesoffset);
+    uint32_t *types = (uint32_t *) (base + typeoffset + sizeof(typestart));
+    uint32_t *channels = (uint32_t *) (base + channeloffset + sizeof(channelstart));
+    uint64_t typefill[256], channelfill[256];
+    memcpy(typefill, typestart, sizeof(typefill));
+    memcpy(channelfill, channelstart, sizeof(channelfill));
+    for (uint64_t i = 0; i < header.entries; ++i) {
+        if (fifoframe(&entries[i]))
+            types[typefill[entries[i].bytes[1]]++] = (uint32_t) i;
+        if (entries[i].flags & ENTRY_CHANNELKNOWN)
+            channels[channelfill[entries[i].channel]++] = (uint32_t) i;
+    }
+
+    memcpy(header.magic, INDEXMAGIC, 8);
+    header.sourcesize = source->st_size;
+    header.sourcemtime = source->st_mtime;
+    memcpy(base, &header, sizeof(header));
+    munmap(base, total);
+    if (fclose(file) || rename(tmpname, indexname)) {
+        perror(indexname);
+        return 1;
+    }
+
+    double elapsed = seconds() - started;
+    fprintf(stderr, "%s: indexed %llu frames in %llu entries, %.0f MB in %.2f s (%.0f MB/s) on %d threads\n",
+            indexname, (unsigned long long) header.frames, (unsigned long long) header.entries,
+            capturesize / 1e6, elapsed, capturesize / 1e6 / (elapsed > 0 ? elapsed : 1e-9), threads);
+    return 0;
+}
+
+static void append(char *text, size_t size, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+static void append(char *text, size_t size, const char *format, ...)
+{
+    size_t used = strlen(text);
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(text + used, size - used, format, arguments);
+    va_end(arguments);
+}
+
+static void appendfifo(char *text, size_t size, const captureentry *entry)
+{
+    unsigned stored = entry->length < MAXFRAMEBYTES ? entry->length : MAXFRAMEBYTES;
+    for (unsigned i = 0; i < stored; ++i)
+        append(text, size, i ? " | 0x%02x" : "0x%02x", entry->bytes[i]);
+    if (entry->length > stored)
+        append(text, size, " ...");
+}
+
+/**
+ * @brief      Decode a frame as decodeSPIPacket() in reverse/A7105/a7105.py does
+ * @param      text, size, entry, registers  the last value written to each register, this frame's included
+ * @return     None
+ */
+static void decodeentry(char *text, size_t size, const captureentry *entry, const uint8_t *registers)
+{
+    const uint8_t *packet = entry->bytes;
+    unsigned stored = entry->length < MAXFRAMEBYTES ? entry->length : MAXFRAMEBYTES;
+    unsigned reg = packet[0] & ~READ_BIT;
+    bool read = packet[0] & READ_BIT;
+
+    text[0] = 0;
+    if (packet[0] & STROBE_BIT) {
+        append(text, size, "S %s", strobes[(packet[0] >> 4) & 0x07]);
+        return;
+    }
+    append(text, size, read ? "R " : "W ");
+
+    if (reg == REG_MODE && !read)
+        append(text, size, "Device Reset");
+    else if (reg == REG_MODE && stored >= 2)
+        append(text, size, "MODE: %s%s%s%s%s%s%s", packet[1] & 0x40 ? "FECERR " : "FECOK  ",
+               packet[1] & 0x20 ? "CRCERR " : "CRCOK  ", packet[1] & 0x10 ? "RFEN  " : "RFDIS ",
+               packet[1] & 0x08 ? "XEN  " : "XDIS ", packet[1] & 0x04 ? "PLLEN  " : "PLLDIS ",
+               packet[1] & 0x02 ? "TRXEN  " : "TRXDIS ", packet[1] & 0x01 ? "TX " : "RX ");
+    else if (reg == REG_FIFO && stored >= 11 && packet[1] == 0x20) {
+        // throttle, rudder, elevator, aileron
+        append(text, size, "T: %2.0f R: %2.0f E: %2.0f A: %2.0f %s ", packet[3] / 255.0 * 100,
+               (packet[5] - 128) / 127.0 * 100, -(packet[7] - 128) / 127.0 * 100, -(packet[9] - 128) / 127.0 * 100,
+               packet[10] & 0x08 ? "Flips Enabled" : "Flips Disabled");
+        appendfifo(text, size, entry);
+    } else if (reg == REG_FIFO) {
+        append(text, size, "FIFO ");
+        appendfifo(text, size, entry);
+    } else if (reg == REG_PLL1 && read && stored >= 2)
+        append(text, size, "PLL Register I = %02x", packet[1]);
+    else if (reg == REG_PLL1 && stored >= 2) {
+        int dbl = (registers[REG_PLL2] >> 7) & 0x01;
+        int rrc = (registers[REG_PLL2] >> 5) & 0x03;
+        int bip = ((registers[REG_PLL2] & 0x01) << 8) + registers[REG_PLL3];
+        int bfp = (registers[REG_PLL4] << 8) + registers[REG_PLL5];
+        int chr = (registers[REG_PLL2] >> 1) & 0x0F;
+        double base = (dbl + 1) * (FXTAL / (rrc + 1)) * (bip + bfp / 65536.0);
+        double spacing = FXTAL * (dbl + 1) / 4.0 / (chr + 1);
+        char frequency[32];
+        // as python prints a float
+        snprintf(frequency, sizeof(frequency), "%.12g", (base + registers[REG_PLL1] * spacing) / 1000000);
+        if (!strpbrk(frequency, ".en"))
+            strcat(frequency, ".0");
+        append(text, size, "CH %d (%sMHz)", registers[REG_PLL1], frequency);
+    } else if (reg == REG_RSSI && read && stored >= 2)
+        append(text, size, "RSSI = %.3fV", 1.2 * packet[1] / 256.0);
+    else if (reg == REG_RSSI && stored >= 2)
+        append(text, size, "RSSI Thershld Register [%02X]", packet[1]);
+    else if (reg < NUMREGISTERS) {
+        append(text, size, "%s [", registernames[reg]);
+        for (unsigned i = 1; i < stored; ++i)
+            append(text, size, i > 1 ? " %02X" : "%02X", packet[i]);
+        append(text, size, entry->length > stored ? " ...]" : "]");
+    } else
+        append(text, size, "- unknown register! %02X", reg);
+}
+
+// the register writes up to and including an entry, from the checkpoint before it
+static const uint8_t *registersat(const captureindex *index, uint64_t entry)
+{
+    static uint8_t registers[NUMREGISTERS];
+    static uint64_t upto = UINT64_MAX;          // the entries before this one are in registers
+
+    if (upto > entry || entry - upto >= CHECKPOINTENTRIES) {
+        memcpy(registers, index->checkpoints[entry / CHECKPOINTENTRIES].registers, NUMREGISTERS);
+        upto = entry / CHECKPOINTENTRIES * CHECKPOINTENTRIES;
+    }
+    for (; upto <= entry; ++upto)
+        if (registerwrite(&index->entries[upto]))
+            registers[index->entries[upto].bytes[0]] = index->entries[upto].bytes[1];
+    return registers;
+}
+
+// the first entry at or after a time
+static uint64_t firstentry(const captureindex *index, int64_t time)
+{
+    uint64_t low = 0, high = index->header->entries;
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        if (index->entries[middle].time < time)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+// the first place in a list of entry numbers that is at or after an entry
+static uint64_t firstinlist(const uint32_t *list, uint64_t low, uint64_t high, uint64_t entry)
+{
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        if (list[middle] < entry)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+static void summary(const char *name, const captureindex *index)
+{
+    const captureindexheader *header = index->header;
+    printf("%s: %llu frames in %llu entries", name, (unsigned long long) header->frames,
+           (unsigned long long) header->entries);
+    if (header->entries)
+        printf(", %f s to %f s", index->entries[0].time / 1e9, index->entries[header->entries - 1].time / 1e9);
+    printf("\n  FIFO packet types:");
+    for (int i = 0; i < 256; ++i)
+        if (index->typestart[i + 1] > index->typestart[i])
+            printf(" 0x%02x %llu", i, (unsigned long long) (index->typestart[i + 1] - index->typestart[i]));
+    printf("\n  channels:");
+    for (int i = 0; i < 256; ++i)
+        if (index->channelstart[i + 1] > index->channelstart[i])
+            printf(" 0x%02x %llu", i, (unsigned long long) (index->channelstart[i + 1] - index->channelstart[i]));
+    printf("\n");
+}
+
+static void usage(const char *name)
+{
+    printf("usage: %s [-j threads] [-i index] [-r] [-l] [-x] [-n name] [-b seconds] [-e seconds]\n"
+           "       [-t type] [-c channel] [-p pattern] capture.csv\n"
+           "  -j  threads to decode with, one per cpu by default\n"
+           "  -i  the index file, capture.csv.idx by default\n"
+           "  -r  make the index again even if it is up to date\n"
+           "  -l  list the frames instead of summing them up, any of the filters below does too\n"
+           "  -x  list the frames as bytes, not decoded\n"
+           "  -n  the name that starts each listed line, remote by default\n"
+           "  -b  -e  only frames from, before this time in the capture\n"
+           "  -t  only FIFO frames with this packet type, 0x20 for the control packets\n"
+           "  -c  only frames sent or received on this channel\n"
+           "  -p  only frames whose decoded text has this in it\n", name);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *indexname = NULL, *name = "remote", *pattern = NULL;
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN), type = -1, channel = -1;
+    bool rebuild = false, list = false, raw = false;
+    int64_t from = INT64_MIN, to = INT64_MAX;
+    int option;
+
+    while ((option = getopt(argc, argv, "j:i:rlxn:b:e:t:c:p:h")) != -1) {
+        switch (option) {
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            case 'i':
+                indexname = optarg;
+                break;
+            case 'r':
+                rebuild = true;
+                break;
+            case 'l':
+                list = true;
+                break;
+            case 'x':
+                raw = true;
+                break;
+            case 'n':
+                name = optarg;
+                break;
+            case 'b':
+                from = llround(atof(optarg) * 1e9);
+                list = true;
+                break;
+            case 'e':
+                to = llround(atof(optarg) * 1e9);
+                list = true;
+                break;
+            case 't':
+                type = (int) strtol(optarg, NULL, 0) & 0xFF;
+                list = true;
+                break;
+            case 'c':
+                channel = (int) strtol(optarg, NULL, 0) & 0xFF;
+                list = true;
+                break;
+            case 'p':
+                pattern = optarg;
+                list = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+    if (threads < 1)
+        threads = 1;
+
+    const char *capturename = argv[optind];
+    char defaultindex[4096];
+    if (!indexname) {
+        snprintf(defaultindex, sizeof(defaultindex), "%s.idx", capturename);
+        indexname = defaultindex;
+    }
+    struct stat source;
+    if (stat(capturename, &source)) {
+        perror(capturename);
+        return 1;
+    }
+
+    captureindex index;
+    if (rebuild || !openindex(indexname, &source, &index)) {
+        if (buildindex(capturename, indexname, &source, threads) || !openindex(indexname, &source, &index)) {
+            fprintf(stderr, "%s: can't read the index back\n", indexname);
+            return 1;
+        }
+    }
+
+    if (!list) {
+        summary(strrchr(capturename, '/') ? strrchr(capturename, '/') + 1 : capturename, &index);
+        return 0;
+    }
+
+    // walk the shortest list that covers the filters
+    uint64_t first = firstentry(&index, from), last = firstentry(&index, to);
+    const uint32_t *entries = NULL;
+    uint64_t position = first, end = last;
+    if (type >= 0 && (channel < 0 || index.typestart[type + 1] - index.typestart[type]
+                                     <= index.channelstart[channel + 1] - index.channelstart[channel])) {
+        entries = index.types;
+        position = firstinlist(entries, index.typestart[type], index.typestart[type + 1], first);
+        end = firstinlist(entries, position, index.typestart[type + 1], last);
+    } else if (channel >= 0) {
+        entries = index.channels;
+        position = firstinlist(entries, index.channelstart[channel], index.channelstart[channel + 1], first);
+        end = firstinlist(entries, position, index.channelstart[channel + 1], last);
+    }
+
+    char text[512];
+    for (; position < end; ++position) {
+        uint64_t number = entries ? entries[position] : position;
+        const captureentry *entry = &index.entries[number];
+        if (type >= 0 && !(fifoframe(entry) && entry->bytes[1] == type))
+            continue;
+        if (channel >= 0 && !((entry->flags & ENTRY_CHANNELKNOWN) && entry->channel == channel))
+            continue;
+        if (pattern || !raw) {
+            bool pll = !(entry->bytes[0] & (STROBE_BIT | READ_BIT)) && entry->bytes[0] == REG_PLL1;
+            decodeentry(text, sizeof(text), entry, pll ? registersat(&index, number) : NULL);
+            if (pattern && !strstr(text, pattern))
+                continue;
+        }
+        printf("%s %f ", name, entry->time / 1e9);
+        if (raw) {
+            unsigned stored = entry->length < MAXFRAMEBYTES ? entry->length : MAXFRAMEBYTES;
+            for (unsigned i = 0; i < stored; ++i)
+                printf(i ? " %02x" : "%02x", entry->bytes[i]);
+        } else
+            fputs(text, stdout);
+        if (entry->repeats)
+            printf(" (Repeated %u times)", entry->repeats);
+        printf("\n");
+    }
+    return 0;
+}
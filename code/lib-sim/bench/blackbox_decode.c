@@ -0,0 +1,704 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "blackbox.h"
+#include "serial.h"
+
+// Decodes a blackbox log (the format is in src/blackbox.h) as it streams in, from the file bradwii-sim -b writes or
+// from the MSP_BLACKBOX_READ responses a configurator saved as they came off the serial port.  Nothing but the
+// current frame and fixed size statistics is kept, so a log of any length goes through in the same memory.
+//
+// -o writes every field as a column of float32s in physical units (prefix.gyro_roll.f32 and so on, all with the
+// same number of rows) and the gyro spectrum as prefix.spectrum.csv.  -c writes the same columns as one CSV.
+// Then it prints:
+//   the loop time histogram, from timesliver
+//   the gyro noise spectrum of each axis, Welch's method with a Hann window and half overlapped segments.  The
+//   FFTs are done by a thread per cpu while the log is still being decoded.
+//   how often each motor sat at ARMED_MIN_MOTOR_OUTPUT or MAX_MOTOR_OUTPUT while the mixer was running
+//   the PID output of each axis, taken back out of the motor outputs the way bradwii.c mixes them, and how much of
+//   it is the D term (gyrorate times the D gain, with the gain scheduling of bradwii.c).  The log has no angle
+//   errors, so P and I are only seen together, as the rest.  Frames with a saturated motor are left out.
+//   the stretches in which no rx channel changed.  The log keeps the decoded sticks, not the packets, so a held
+//   stick looks like a lost packet here; short stretches are normal, long ones with the sticks moving around them
+//   are the gaps.
+
+#define DEFAULTFFTSIZE 256
+#define MINFFTSIZE 16
+#define MAXFFTSIZE 4096
+#define JOBQUEUESIZE 64         // segments waiting for a worker, the decoder waits when the queue is full
+#define LOOPTIMEBUCKETUS 100
+#define LOOPTIMEBUCKETS 64      // the last one counts everything longer
+#define RXHOLDBUCKETS 8         // doubling from 50 ms
+#define RXHOLDFIRSTMS 50
+#define MAXFIELDS 64
+
+// the microseconds of MSP_STATUS are (timesliver * 15) >> 8, this gets back to real ones
+#define TIMESLIVERMICROSECONDS (256.0 / 15 * 1e6 / (1 << (16 + 8)))
+
+typedef struct {
+    uint8_t divisor;
+    uint8_t rxchannels;
+    uint8_t motors;
+    uint8_t keyframeinterval;
+    uint8_t gyroshift;
+    uint8_t accshift;
+    uint8_t rxshift;
+    uint8_t batteryshift;
+    uint16_t loopfrequency;
+    int numfields;
+} blackboxheader;
+
+// the file, and in msp mode the piece of the log taken out of the last MSP_BLACKBOX_READ response
+static struct {
+    FILE *file;
+    uint8_t buffer[1 << 16];
+    size_t head, tail;
+    bool msp;
+    uint8_t log[256];
+    size_t loghead, logtail;
+    uint32_t nextoffset;        // of the log
+    unsigned long responses, duplicates;
+    bool gap;
+} input;
+
+// the FFT jobs, a segment of each gyro axis
+typedef struct {
+    float sample[3][MAXFFTSIZE];
+} fftjob;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    fftjob *jobs;
+    int head, tail, count;
+    bool done;
+} work = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+typedef struct {
+    double power[3][MAXFFTSIZE / 2 + 1];
+    unsigned long segments;
+} fftsum;
+
+static int fftsize = DEFAULTFFTSIZE;
+static float window[MAXFFTSIZE];
+static double windowpower;
+
+static int readfilebyte(void)
+{
+    if (input.head == input.tail) {
+        input.head = 0;
+        input.tail = fread(input.buffer, 1, sizeof(input.buffer), input.file);
+        if (!input.tail)
+            return -1;
+    }
+    return input.buffer[input.head++];
+}
+
+// takes MSP_BLACKBOX_READ responses apart until one has the next piece of the log
+static bool readmspresponse(void)
+{
+    uint8_t payload[256];
+    int c;
+
+    while (!input.gap && (c = readfilebyte()) >= 0) {
+        if (c != '$' || readfilebyte() != 'M' || readfilebyte() != '>')
+            continue;
+        int size = readfilebyte();
+        int command = readfilebyte();
+        if (size < 0 || command < 0)
+            return false;
+        uint8_t checksum = size ^ command;
+        for (int i = 0; i < size; ++i) {
+            if ((c = readfilebyte()) < 0)
+                return false;
+            payload[i] = c;
+            checksum ^= c;
+        }
+        if (readfilebyte() != checksum || command != MSP_BLACKBOX_READ || size < 8)
+            continue;
+
+        uint32_t offset = payload[0] | payload[1] << 8 | payload[2] << 16 | (uint32_t) payload[3] << 24;
+        input.responses++;
+        if (offset + (size - 8) <= input.nextoffset) {
+            input.duplicates++;
+            continue;
+        }
+        if (offset > input.nextoffset) {
+            fprintf(stderr, "the responses skip from offset %u to %u, decoding stops there\n", input.nextoffset, offset);
+            input.gap = true;
+            return false;
+        }
+        size_t skip = input.nextoffset - offset;
+        input.logtail = size - 8 - skip;
+        memcpy(input.log, payload + 8 + skip, input.logtail);
+        input.loghead = 0;
+        input.nextoffset += input.logtail;
+        return true;
+    }
+    return false;
+}
+
+static int readlogbyte(void)
+{
+    if (!input.msp)
+        return readfilebyte();
+    if (input.loghead == input.logtail && !readmspresponse())
+        return -1;
+    return input.log[input.loghead++];
+}
+
+static bool readvarint(uint32_t *value)
+{
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        int c = readlogbyte();
+        if (c < 0)
+            return false;
+        result |= (uint32_t) (c & 0x7F) << shift;
+        if (c < 0x80) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+    return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+static void fft(double *re, double *im, int n)
+{
+    for (int i = 1, j = 0; i < n; ++i) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            double t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+    for (int length = 2; length <= n; length <<= 1) {
+        double angle = -2 * M_PI / length;
+        double wre = cos(angle), wim = sin(angle);
+        for (int i = 0; i < n; i += length) {
+            double ure = 1, uim = 0;
+            for (int j = 0; j < length / 2; ++j) {
+                double *are = &re[i + j], *aim = &im[i + j];
+                double *bre = &re[i + j + length / 2], *bim = &im[i + j + length / 2];
+                double tre = *bre * ure - *bim * uim;
+                double tim = *bre * uim + *bim * ure;
+                *bre = *are - tre;
+                *bim = *aim - tim;
+                *are += tre;
+                *aim += tim;
+                double nextre = ure * wre - uim * wim;
+                uim = ure * wim + uim * wre;
+                ure = nextre;
+            }
+        }
+    }
+}
+
+static void fftsegment(fftsum *sum, const fftjob *job)
+{
+    double re[MAXFFTSIZE], im[MAXFFTSIZE];
+
+    for (int axis = 0; axis < 3; ++axis) {
+        double mean = 0;
+        for (int i = 0; i < fftsize; ++i)
+            mean += job->sample[axis][i];
+        mean /= fftsize;
+        for (int i = 0; i < fftsize; ++i) {
+            re[i] = (job->sample[axis][i] - mean) * window[i];
+            im[i] = 0;
+        }
+        fft(re, im, fftsize);
+        for (int i = 0; i <= fftsize / 2; ++i)
+            sum->power[axis][i] += re[i] * re[i] + im[i] * im[i];
+    }
+    sum->segments++;
+}
+
+static void makewindow(void)
+{
+    windowpower = 0;
+    for (int i = 0; i < fftsize; ++i) {
+        window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / fftsize);
+        windowpower += (double) window[i] * window[i];
+    }
+}
+
+static void *fftworker(void *arg)
+{
+    fftsum *sum = arg;
+    fftjob job;
+
+    for (;;) {
+        pthread_mutex_lock(&work.lock);
+        while (!work.count && !work.done)
+            pthread_cond_wait(&work.changed, &work.lock);
+        if (!work.count) {
+            pthread_mutex_unlock(&work.lock);
+            return NULL;
+        }
+        memcpy(&job, &work.jobs[work.head], sizeof(job));
+        work.head = (work.head + 1) % JOBQUEUESIZE;
+        work.count--;
+        pthread_cond_broadcast(&work.changed);
+        pthread_mutex_unlock(&work.lock);
+
+        fftsegment(sum, &job);
+    }
+}
+
+static void queuejob(const fftjob *job)
+{
+    pthread_mutex_lock(&work.lock);
+    while (work.count == JOBQUEUESIZE)
+        pthread_cond_wait(&work.changed, &work.lock);
+    memcpy(&work.jobs[work.tail], job, sizeof(*job));
+    work.tail = (work.tail + 1) % JOBQUEUESIZE;
+    work.count++;
+    pthread_cond_broadcast(&work.changed);
+    pthread_mutex_unlock(&work.lock);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-j threads] [-n fft size] [-o prefix] [-c file.csv] [-d roll,pitch,yaw] [-g factor] log\n",
+            name);
+    fprintf(stderr, "  log  bradwii-sim -b output, or saved MSP_BLACKBOX_READ responses.  - reads stdin\n");
+    fprintf(stderr, "  -j   threads for the gyro FFTs, default one per cpu\n");
+    fprintf(stderr, "  -n   FFT segment length, a power of 2 up to %d, default %d\n", MAXFFTSIZE, DEFAULTFFTSIZE);
+    fprintf(stderr, "  -o   write each column to prefix.name.f32 and the gyro spectrum to prefix.spectrum.csv\n");
+    fprintf(stderr, "  -c   write the columns as CSV\n");
+    fprintf(stderr, "  -d   the D gains of the flight, default the X4's 90,90,90\n");
+    fprintf(stderr, "  -g   GAIN_SCHEDULING_FACTOR of the flight, default %g\n", (double) GAIN_SCHEDULING_FACTOR);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *prefix = NULL, *csvname = NULL;
+    double dgain[3] = { 90, 90, 90 };
+    double gainscheduling = GAIN_SCHEDULING_FACTOR;
+    int option;
+
+    while ((option = getopt(argc, argv, "j:n:o:c:d:g:h")) != -1) {
+        switch (option) {
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            case 'n':
+                fftsize = atoi(optarg);
+                break;
+            case 'o':
+                prefix = optarg;
+                break;
+            case 'c':
+                csvname = optarg;
+                break;
+            case 'd':
+                if (sscanf(optarg, "%lf,%lf,%lf", &dgain[0], &dgain[1], &dgain[2]) != 3)
+                    usage(argv[0]);
+                break;
+            case 'g':
+                gainscheduling = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || fftsize < MINFFTSIZE || fftsize > MAXFFTSIZE || (fftsize & (fftsize - 1)))
+        usage(argv[0]);
+    if (threads < 1)
+        threads = 1;
+
+    input.file = strcmp(argv[optind], "-") ? fopen(argv[optind], "rb") : stdin;
+    if (!input.file) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    // a log starts with the magic, saved responses with $M>
+    int first = readfilebyte();
+    if (first < 0) {
+        fprintf(stderr, "%s is empty\n", argv[optind]);
+        return 1;
+    }
+    input.head--;
+    input.msp = first == '$';
+
+    uint8_t headerbytes[BLACKBOXHEADERSIZE];
+    for (int i = 0; i < BLACKBOXHEADERSIZE; ++i) {
+        int c = readlogbyte();
+        if (c < 0) {
+            fprintf(stderr, "%s: no blackbox header\n", argv[optind]);
+            return 1;
+        }
+        headerbytes[i] = c;
+    }
+    if (memcmp(headerbytes, BLACKBOXMAGIC, 4)) {
+        fprintf(stderr, "%s: not a blackbox log\n", argv[optind]);
+        return 1;
+    }
+    blackboxheader header = {
+        headerbytes[4], headerbytes[5], headerbytes[6], headerbytes[7], headerbytes[8], headerbytes[9],
+        headerbytes[10], headerbytes[11], headerbytes[12] | headerbytes[13] << 8
+    };
+    header.numfields = 3 + 3 + header.rxchannels + header.motors + 2;
+    if (header.numfields > MAXFIELDS || header.motors != 4 || !header.divisor) {
+        fprintf(stderr, "%s: can't decode a log of %d rx channels and %d motors\n", argv[optind], header.rxchannels,
+                header.motors);
+        return 1;
+    }
+    int gyrofield = 0, accfield = 3, rxfield = 6, motorfield = 6 + header.rxchannels;
+    int timefield = motorfield + header.motors, batteryfield = timefield + 1;
+
+    // the columns, in physical units
+    char names[MAXFIELDS + 1][32];
+    double scale[MAXFIELDS + 1];
+    static const char *axisnames[3] = { "roll", "pitch", "yaw" };
+    for (int i = 0; i < 3; ++i) {
+        snprintf(names[gyrofield + i], sizeof(names[0]), "gyro_%s", axisnames[i]);
+        scale[gyrofield + i] = (double) (1 << header.gyroshift) / 65536;
+        snprintf(names[accfield + i], sizeof(names[0]), "acc_%c", 'x' + i);
+        scale[accfield + i] = (double) (1 << header.accshift) / 65536;
+    }
+    for (int i = 0; i < header.rxchannels; ++i) {
+        snprintf(names[rxfield + i], sizeof(names[0]), "rx%d", i);
+        scale[rxfield + i] = (double) (1 << header.rxshift) / 65536;
+    }
+    for (int i = 0; i < header.motors; ++i) {
+        snprintf(names[motorfield + i], sizeof(names[0]), "motor%d", i);
+        scale[motorfield + i] = 1;
+    }
+    strcpy(names[timefield], "looptime_us");
+    scale[timefield] = TIMESLIVERMICROSECONDS;
+    strcpy(names[batteryfield], "battery_v");
+    scale[batteryfield] = (double) (1 << header.batteryshift) / 65536;
+    strcpy(names[header.numfields], "time_s");
+
+    FILE *columns[MAXFIELDS + 1] = { NULL };
+    if (prefix) {
+        for (int i = 0; i <= header.numfields; ++i) {
+            char name[4096];
+            snprintf(name, sizeof(name), "%s.%s.f32", prefix, names[i]);
+            if (!(columns[i] = fopen(name, "wb"))) {
+                perror(name);
+                return 1;
+            }
+        }
+    }
+    FILE *csv = NULL;
+    if (csvname) {
+        if (!(csv = fopen(csvname, "w"))) {
+            perror(csvname);
+            return 1;
+        }
+        fprintf(csv, "%s", names[header.numfields]);
+        for (int i = 0; i < header.numfields; ++i)
+            fprintf(csv, ",%s", names[i]);
+        fprintf(csv, "\n");
+    }
+
+    makewindow();
+    work.jobs = malloc(JOBQUEUESIZE * sizeof(fftjob));
+    pthread_t *workers = calloc(threads, sizeof(pthread_t));
+    fftsum *sums = calloc(threads, sizeof(fftsum));
+    for (int i = 0; i < threads; ++i)
+        pthread_create(&workers[i], NULL, fftworker, &sums[i]);
+
+    // decode
+    int32_t value[MAXFIELDS] = { 0 };
+    unsigned long frames = 0, skippedframes = 0, keyframes = 0;
+    unsigned long looptime[LOOPTIMEBUCKETS] = { 0 };
+    double looptimesum = 0, looptimemin = 1e30, looptimemax = 0;
+    double seconds = 0;
+    unsigned long mixerframes = 0, saturatedframes = 0, saturatedlow[4] = { 0 }, saturatedhigh[4] = { 0 };
+    double pidsquared[3] = { 0 }, dsquared[3] = { 0 }, restsquared[3] = { 0 };
+    unsigned long pidframes = 0;
+    unsigned long rxholds[RXHOLDBUCKETS] = { 0 };
+    double rxhold = 0, rxholdmax = 0, rxholdmaxat = 0;
+    int32_t lastrx[MAXFIELDS];
+    fftjob job;
+    int segmentfill = 0;
+    bool truncated = false;
+    int trigger = 0;
+    double triggerseconds = 0;
+
+    for (;;) {
+        int tag = readlogbyte();
+        if (tag < 0 || tag == 0xFF)
+            break;
+        if (tag == 'S') {
+            uint32_t skipped;
+            if (!readvarint(&skipped)) {
+                truncated = true;
+                break;
+            }
+            skippedframes += skipped;
+            seconds += skipped * header.divisor * value[timefield] * TIMESLIVERMICROSECONDS * 1e-6;
+            continue;
+        }
+        if (tag == 'T') {
+            if ((trigger = readlogbyte()) < 0) {
+                truncated = true;
+                break;
+            }
+            triggerseconds = seconds;
+            continue;
+        }
+        if ((tag != 'I' && tag != 'P') || (tag == 'P' && !frames)) {
+            fprintf(stderr, "bad frame tag 0x%02x after %lu frames, decoding stops there\n", tag, frames);
+            break;
+        }
+        int32_t field[MAXFIELDS];
+        bool complete = true;
+        for (int i = 0; i < header.numfields && complete; ++i) {
+            uint32_t raw;
+            complete = readvarint(&raw);
+            field[i] = tag == 'I' ? unzigzag(raw) : value[i] + unzigzag(raw);
+        }
+        if (!complete) {
+            truncated = true;
+            break;
+        }
+        memcpy(value, field, sizeof(field));
+        keyframes += tag == 'I';
+
+        // columns
+        double framemicroseconds = value[timefield] * TIMESLIVERMICROSECONDS;
+        for (int i = 0; i <= header.numfields && prefix; ++i) {
+            float f = i < header.numfields ? value[i] * scale[i] : seconds;
+            fwrite(&f, sizeof(f), 1, columns[i]);
+        }
+        if (csv) {
+            fprintf(csv, "%.6f", seconds);
+            for (int i = 0; i < header.numfields; ++i)
+                fprintf(csv, ",%.6g", value[i] * scale[i]);
+            fprintf(csv, "\n");
+        }
+
+        // loop time
+        int bucket = framemicroseconds / LOOPTIMEBUCKETUS;
+        looptime[bucket < LOOPTIMEBUCKETS ? bucket : LOOPTIMEBUCKETS - 1]++;
+        looptimesum += framemicroseconds;
+        if (framemicroseconds < looptimemin)
+            looptimemin = framemicroseconds;
+        if (framemicroseconds > looptimemax)
+            looptimemax = framemicroseconds;
+
+        // gyro segments, each half overlaps the one before
+        for (int axis = 0; axis < 3; ++axis)
+            job.sample[axis][segmentfill] = value[gyrofield + axis] * scale[gyrofield + axis];
+        if (++segmentfill == fftsize) {
+            queuejob(&job);
+            for (int axis = 0; axis < 3; ++axis)
+                memmove(job.sample[axis], job.sample[axis] + fftsize / 2, fftsize / 2 * sizeof(float));
+            segmentfill = fftsize / 2;
+        }
+
+        // motors and pid, while the mixer runs (setallmotoroutputs() puts them all at MIN_MOTOR_OUTPUT otherwise)
+        const int32_t *m = &value[motorfield];
+        bool mixing = false, saturated = false;
+        for (int i = 0; i < 4; ++i)
+            mixing |= m[i] != MIN_MOTOR_OUTPUT;
+        if (mixing) {
+            mixerframes++;
+            for (int i = 0; i < 4; ++i) {
+                if (m[i] <= ARMED_MIN_MOTOR_OUTPUT) {
+                    saturatedlow[i]++;
+                    saturated = true;
+                }
+                if (m[i] >= MAX_MOTOR_OUTPUT) {
+                    saturatedhigh[i]++;
+                    saturated = true;
+                }
+            }
+            saturatedframes += saturated;
+        }
+        if (mixing && !saturated) {
+            // bradwii.c: motor 0 is T-R+P-Y, 1 is T-R-P+Y, 2 is T+R+P+Y, 3 is T+R-P-Y in 1/1000ths, the yaw pid
+            // output is negated before mixing
+            double throttle = (m[0] + m[1] + m[2] + m[3]) / 4.0 - 1000;
+            double pid[3] = {
+                (m[2] + m[3] - m[0] - m[1]) / 4.0,
+                (m[0] + m[2] - m[1] - m[3]) / 4.0,
+                -(m[1] + m[2] - m[0] - m[3]) / 4.0
+            };
+            double gain = (throttle / 1000 - 0.5) * gainscheduling + 1;
+            for (int axis = 0; axis < 3; ++axis) {
+                double gyro = value[gyrofield + axis] * scale[gyrofield + axis];
+                double d = -gain * gyro * dgain[axis] / 65536 * 1000;
+                pidsquared[axis] += pid[axis] * pid[axis];
+                dsquared[axis] += d * d;
+                restsquared[axis] += (pid[axis] - d) * (pid[axis] - d);
+            }
+            pidframes++;
+        }
+
+        // rx holds
+        if (frames && !memcmp(lastrx, &value[rxfield], header.rxchannels * sizeof(int32_t)))
+            rxhold += framemicroseconds * header.divisor / 1000;
+        else {
+            if (rxhold >= RXHOLDFIRSTMS) {
+                int b = 0;
+                while (b < RXHOLDBUCKETS - 1 && rxhold >= RXHOLDFIRSTMS << (b + 1))
+                    ++b;
+                rxholds[b]++;
+            }
+            if (rxhold > rxholdmax) {
+                rxholdmax = rxhold;
+                rxholdmaxat = seconds - rxhold / 1000;
+            }
+            rxhold = 0;
+        }
+        memcpy(lastrx, &value[rxfield], header.rxchannels * sizeof(int32_t));
+
+        seconds += framemicroseconds * header.divisor * 1e-6;
+        frames++;
+    }
+
+    pthread_mutex_lock(&work.lock);
+    work.done = true;
+    pthread_cond_broadcast(&work.changed);
+    pthread_mutex_unlock(&work.lock);
+    for (int i = 0; i < threads; ++i)
+        pthread_join(workers[i], NULL);
+    for (int i = 1; i < threads; ++i) {
+        for (int axis = 0; axis < 3; ++axis)
+            for (int b = 0; b <= fftsize / 2; ++b)
+                sums[0].power[axis][b] += sums[i].power[axis][b];
+        sums[0].segments += sums[i].segments;
+    }
+    if (!sums[0].segments && segmentfill >= MINFFTSIZE) {
+        // a log shorter than a segment, which the window before a trigger usually is, gets one segment as long
+        // as it can be
+        while (fftsize > segmentfill)
+            fftsize >>= 1;
+        makewindow();
+        fftsegment(&sums[0], &job);
+    }
+    for (int i = 0; i <= header.numfields && prefix; ++i)
+        fclose(columns[i]);
+    if (csv)
+        fclose(csv);
+
+    // report
+    if (input.msp)
+        printf("%lu MSP_BLACKBOX_READ responses, %lu repeated, %u bytes of log\n", input.responses, input.duplicates,
+               input.nextoffset);
+    printf("%lu frames (%lu I, %lu skipped by the recorder) over %.2f s, every %d loop passes%s\n", frames, keyframes,
+           skippedframes, seconds, header.divisor, truncated ? ", the last one cut off" : "");
+    if (trigger)
+        printf("triggered by %s at %.2f s: %.2f s of frames before it, %.2f s after\n",
+               trigger == BLACKBOXTRIGGERIMPACT ? "an impact" : trigger == BLACKBOXTRIGGERDISARM ? "disarming" : "?",
+               triggerseconds, triggerseconds, seconds - triggerseconds);
+    else
+        printf("not triggered, the log was read while armed or the flight was cut off\n");
+    if (!frames)
+        return 0;
+
+    double samplerate = frames / seconds;
+    printf("\nloop time: min %.0f us, avg %.0f us, max %.0f us (%.1f Hz)\n", looptimemin, looptimesum / frames,
+           looptimemax, frames * 1e6 / looptimesum);
+    for (int b = 0; b < LOOPTIMEBUCKETS; ++b) {
+        if (!looptime[b])
+            continue;
+        if (b < LOOPTIMEBUCKETS - 1)
+            printf("  %5d-%5d us %6.2f%%\n", b * LOOPTIMEBUCKETUS, (b + 1) * LOOPTIMEBUCKETUS, 100.0 * looptime[b] / frames);
+        else
+            printf("  %5d+      us %6.2f%%\n", b * LOOPTIMEBUCKETUS, 100.0 * looptime[b] / frames);
+    }
+
+    printf("\ngyro noise up to %.1f Hz, %lu segments of %d samples at %.1f Hz on %d thread%s:\n", samplerate / 2,
+           sums[0].segments, fftsize, samplerate, threads, threads == 1 ? "" : "s");
+    FILE *spectrum = NULL;
+    if (prefix) {
+        char name[4096];
+        snprintf(name, sizeof(name), "%s.spectrum.csv", prefix);
+        if ((spectrum = fopen(name, "w")))
+            fprintf(spectrum, "frequency_hz,roll_dps2_per_hz,pitch_dps2_per_hz,yaw_dps2_per_hz\n");
+    }
+    if (sums[0].segments) {
+        // one sided power spectral density in (deg/s)^2/Hz
+        double norm = 2.0 / (sums[0].segments * windowpower * samplerate);
+        for (int b = 0; b <= fftsize / 2 && spectrum; ++b) {
+            fprintf(spectrum, "%.3f", b * samplerate / fftsize);
+            for (int axis = 0; axis < 3; ++axis)
+                fprintf(spectrum, ",%.6g", sums[0].power[axis][b] * norm);
+            fprintf(spectrum, "\n");
+        }
+        for (int axis = 0; axis < 3; ++axis) {
+            double total = 0;
+            int peak = 1;
+            for (int b = 1; b <= fftsize / 2; ++b) {
+                total += sums[0].power[axis][b] * norm * samplerate / fftsize;
+                if (sums[0].power[axis][b] > sums[0].power[axis][peak])
+                    peak = b;
+            }
+            printf("  %-5s rms %7.2f deg/s, strongest at %6.1f Hz (%.3g (deg/s)^2/Hz)\n", axisnames[axis], sqrt(total),
+                   peak * samplerate / fftsize, sums[0].power[axis][peak] * norm);
+        }
+    } else
+        printf("  fewer than %d frames\n", MINFFTSIZE);
+    if (spectrum)
+        fclose(spectrum);
+
+    printf("\nmotors, %lu frames with the mixer running, %.1f%% of them with a motor saturated:\n", mixerframes,
+           mixerframes ? 100.0 * saturatedframes / mixerframes : 0);
+    for (int i = 0; i < 4; ++i)
+        printf("  motor%d  at %d %5.1f%%, at %d %5.1f%%\n", i, ARMED_MIN_MOTOR_OUTPUT,
+               mixerframes ? 100.0 * saturatedlow[i] / mixerframes : 0, MAX_MOTOR_OUTPUT,
+               mixerframes ? 100.0 * saturatedhigh[i] / mixerframes : 0);
+
+    printf("\npid output rms in motor units, %lu unsaturated frames, D gains %g,%g,%g:\n", pidframes, dgain[0],
+           dgain[1], dgain[2]);
+    for (int axis = 0; axis < 3 && pidframes; ++axis)
+        printf("  %-5s total %7.2f, D %7.2f, P+I %7.2f\n", axisnames[axis], sqrt(pidsquared[axis] / pidframes),
+               sqrt(dsquared[axis] / pidframes), sqrt(restsquared[axis] / pidframes));
+
+    printf("\nrx unchanged for %d ms or more:\n", RXHOLDFIRSTMS);
+    for (int b = 0; b < RXHOLDBUCKETS; ++b) {
+        if (!rxholds[b])
+            continue;
+        if (b < RXHOLDBUCKETS - 1)
+            printf("  %5d-%5d ms %6lu\n", RXHOLDFIRSTMS << b, RXHOLDFIRSTMS << (b + 1), rxholds[b]);
+        else
+            printf("  %5d+      ms %6lu\n", RXHOLDFIRSTMS << b, rxholds[b]);
+    }
+    if (rxholdmax > 0)
+        printf("  longest %.0f ms from %.2f s\n", rxholdmax, rxholdmaxat);
+    return 0;
+}
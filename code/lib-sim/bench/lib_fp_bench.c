@@ -0,0 +1,372 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lib_fp.h"
+
+// Speed and accuracy of every kernel in lib_fp.c, measured on the host.  Each kernel is run over its
+// whole input domain (or a large random sample of it when the domain is too big) and compared with the
+// same math done in double precision.  ns/op is host time, so only compare it between runs on the same
+// machine.  Use it to see whether a change to a kernel made it faster or slower, not to budget the loop.
+
+// Errors are in the unit of the result: degrees for atan2, fractions of the true value ("rel") for the
+// square roots, plain numbers for the rest.  One fixedpointnum LSB is 1/65536 = 0.0000153.
+
+// The checksum is of every result a kernel gave in its accuracy pass.  The makefile also builds this bench as
+// lib_fp-bench-32bit, with FIXEDPOINTMULTIPLY64BIT=0 like the firmware, and -c prints only the checksums, so that
+// the two multiplies can be checked to give the same results to the bit.
+
+#define NUMSAMPLES      1000000         // random inputs per kernel
+#define TIMINGPASSES    20              // passes over the inputs when timing
+
+#define FPTODOUBLE(x)   ((double) (x) / FIXEDPOINTONE)
+
+typedef struct {
+    const char *name;
+    const char *unit;
+    unsigned long samples;
+    double nanoseconds;         // per call
+    double maxerror;
+    double squaredsum;
+    uint32_t checksum;          // FNV-1a of the results
+    char worst[64];             // input with the largest error
+} benchresult;
+
+static uint32_t randomstate = 1;
+static volatile fixedpointnum sink;
+static fixedpointnum inputx[NUMSAMPLES];
+static fixedpointnum inputy[NUMSAMPLES];
+static fixedpointnum inputz[NUMSAMPLES];
+
+static benchresult results[16];
+static int numresults;
+
+static uint32_t randomnumber(void)
+{
+    // xorshift32, so that runs are repeatable for a given seed
+    randomstate ^= randomstate << 13;
+    randomstate ^= randomstate >> 17;
+    randomstate ^= randomstate << 5;
+    return randomstate;
+}
+
+static double randomuniform(double low, double high)
+{
+    return low + (high - low) * ((randomnumber() + 0.5) / 4294967296.0);
+}
+
+static fixedpointnum randomfixedpointnum(double low, double high)
+{
+    return (fixedpointnum) lrint(randomuniform(low, high) * FIXEDPOINTONE);
+}
+
+static fixedpointnum randomlogfixedpointnum(double smallest, double largest)
+{
+    // spread evenly over the orders of magnitude, so small values get as many samples as big ones
+    double value = exp(randomuniform(log(smallest), log(largest)));
+    fixedpointnum fp = (fixedpointnum) lrint(value * FIXEDPOINTONE);
+    return fp ? fp : 1;
+}
+
+static double seconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static benchresult *newresult(const char *name, const char *unit)
+{
+    benchresult *result = &results[numresults++];
+    memset(result, 0, sizeof(*result));
+    result->name = name;
+    result->unit = unit;
+    result->checksum = 2166136261u;
+    return result;
+}
+
+static fixedpointnum addoutput(benchresult * result, fixedpointnum output)
+{
+    // adds a result to the checksum and passes it through
+    for (int i = 0; i < 32; i += 8) {
+        result->checksum ^= (uint8_t) (output >> i);
+        result->checksum *= 16777619u;
+    }
+    return output;
+}
+
+static bool adderror(benchresult * result, double error)
+{
+    // returns true if this is the worst error so far, so the caller can record the input
+    error = fabs(error);
+    result->samples++;
+    result->squaredsum += error * error;
+    if (error <= result->maxerror && result->samples > 1)
+        return false;
+    result->maxerror = error;
+    return true;
+}
+
+static void benchmultiply(void)
+{
+    benchresult *result = newresult("lib_fp_multiply", "1");
+
+    // any x, and a y that keeps the product in range
+    for (int i = 0; i < NUMSAMPLES; ++i) {
+        inputx[i] = randomfixedpointnum(-32768, 32767);
+        double limit = fmin(32767.0 / fmax(fabs(FPTODOUBLE(inputx[i])), 1e-9), 32767.0);
+        inputy[i] = randomfixedpointnum(-limit, limit);
+    }
+
+    double start = seconds();
+    for (int pass = 0; pass < TIMINGPASSES; ++pass)
+        for (int i = 0; i < NUMSAMPLES; ++i)
+            sink = lib_fp_multiply(inputx[i], inputy[i]);
+    result->nanoseconds = (seconds() - start) * 1e9 / ((double) TIMINGPASSES * NUMSAMPLES);
+
+    for (int i = 0; i < NUMSAMPLES; ++i) {
+        // the exact product has 32 fractional bits, compare in integers so nothing is lost to rounding
+        int64_t exact = (int64_t) inputx[i] * inputy[i];
+        int64_t difference = ((int64_t) addoutput(result, lib_fp_multiply(inputx[i], inputy[i])) << FIXEDPOINTSHIFT) - exact;
+        if (adderror(result, difference / 4294967296.0))
+            snprintf(result->worst, sizeof(result->worst), "%.6f*%.6f", FPTODOUBLE(inputx[i]), FPTODOUBLE(inputy[i]));
+    }
+}
+
+static void benchlowpassfilter(const char *name, int extrashift)
+{
+    benchresult *result = newresult(name, "1");
+
+    // the filter periods the firmware uses (1/60 s to 4 s), variable and new value small enough to be shifted
+    // by extrashift, and timeslivers up to the 20 ms the loop allows, but never longer than the period
+    static const fixedpointnum oneoverperiods[] = {
+        FIXEDPOINTONEOVERONESIXTYITH, FIXEDPOINTONEOVERONESIXTEENTH, FIXEDPOINTONEOVERONEFOURTH, FIXEDPOINTONEOVERONE,
+        FIXEDPOINTONEOVERFOUR
+    };
+#define NUMPERIODS (sizeof(oneoverperiods) / sizeof(oneoverperiods[0]))
+    double limit = 32767.0 / (1 << extrashift);
+    for (int i = 0; i < NUMSAMPLES; ++i) {
+        inputx[i] = randomfixedpointnum(-limit, limit);
+        inputy[i] = randomfixedpointnum(-limit, limit);
+        inputz[i] = randomfixedpointnum(0, fmin(0.02, 1 / FPTODOUBLE(oneoverperiods[i % NUMPERIODS]))) << extrashift;
+    }
+
+    double start = seconds();
+    for (int pass = 0; pass < TIMINGPASSES; ++pass)
+        for (int i = 0; i < NUMSAMPLES; ++i) {
+            fixedpointnum variable = inputx[i];
+            lib_fp_lowpassfilter(&variable, inputy[i], inputz[i], oneoverperiods[i % NUMPERIODS], extrashift);
+            sink = variable;
+        }
+    result->nanoseconds = (seconds() - start) * 1e9 / ((double) TIMINGPASSES * NUMSAMPLES);
+
+    for (int i = 0; i < NUMSAMPLES; ++i) {
+        fixedpointnum oneoverperiod = oneoverperiods[i % NUMPERIODS];
+        fixedpointnum variable = inputx[i];
+        lib_fp_lowpassfilter(&variable, inputy[i], inputz[i], oneoverperiod, extrashift);
+        addoutput(result, variable);
+
+        double fraction = FPTODOUBLE(inputz[i]) / (1 << extrashift) * FPTODOUBLE(oneoverperiod);
+        double exact = fraction * FPTODOUBLE(inputy[i]) + (1 - fraction) * FPTODOUBLE(inputx[i]);
+        if (adderror(result, FPTODOUBLE(variable) - exact))
+            snprintf(result->worst, sizeof(result->worst), "v=%.6f new=%.6f dt=%.6f 1/T=%.3f", FPTODOUBLE(inputx[i]),
+                     FPTODOUBLE(inputy[i]), FPTODOUBLE(inputz[i]) / (1 << extrashift), FPTODOUBLE(oneoverperiod));
+    }
+}
+
+static void benchsineorcosine(const char *name, fixedpointnum(*function) (fixedpointnum), double (*exactfunction) (double))
+{
+    benchresult *result = newresult(name, "1");
+
+    // every angle from -360 to 360 degrees, one LSB apart
+    double start = seconds();
+    for (fixedpointnum angle = -FIXEDPOINT360; angle <= FIXEDPOINT360; ++angle)
+        sink = function(angle);
+    result->nanoseconds = (seconds() - start) * 1e9 / (2.0 * FIXEDPOINT360 + 1);
+
+    for (fixedpointnum angle = -FIXEDPOINT360; angle <= FIXEDPOINT360; ++angle) {
+        double exact = exactfunction(FPTODOUBLE(angle) * M_PI / 180.0);
+        if (adderror(result, FPTODOUBLE(addoutput(result, function(angle))) - exact))
+            snprintf(result->worst, sizeof(result->worst), "%.6f deg", FPTODOUBLE(angle));
+    }
+}
+
+static void benchatan2(void)
+{
+    benchresult *result = newresult("lib_fp_atan2", "deg");
+
+    // vectors in every direction with lengths from one LSB to 8192.  The CORDIC overflows above about 14000.
+    for (int i = 0; i < NUMSAMPLES; ++i) {
+        double length = FPTODOUBLE(randomlogfixedpointnum(1.0 / FIXEDPOINTONE, 8192));
+        double angle = randomuniform(-M_PI, M_PI);
+        inputx[i] = (fixedpointnum) lrint(length * cos(angle) * FIXEDPOINTONE);
+        inputy[i] = (fixedpointnum) lrint(length * sin(angle) * FIXEDPOINTONE);
+    }
+
+    double start = seconds();
+    for (int pass = 0; pass < TIMINGPASSES; ++pass)
+        for (int i = 0; i < NUMSAMPLES; ++i)
+            sink = lib_fp_atan2(inputy[i], inputx[i]);
+    result->nanoseconds = (seconds() - start) * 1e9 / ((double) TIMINGPASSES * NUMSAMPLES);
+
+    for (int i = 0; i < NUMSAMPLES; ++i) {
+        if (!inputx[i] && !inputy[i])
+            continue;
+        double error = FPTODOUBLE(addoutput(result, lib_fp_atan2(inputy[i], inputx[i]))) - atan2(inputy[i], inputx[i]) * 180.0 / M_PI;
+        // -180 and 180 are the same angle
+        if (error > 180)
+            error -= 360;
+        if (error < -180)
+            error += 360;
+        if (adderror(result, error))
+            snprintf(result->worst, sizeof(result->worst), "y=%.6f x=%.6f", FPTODOUBLE(inputy[i]), FPTODOUBLE(inputx[i]));
+    }
+}
+
+static void benchsquareroot(const char *name, fixedpointnum(*function) (fixedpointnum), double power)
+{
+    benchresult *result = newresult(name, "rel");
+
+    // every input from one LSB to 16, where the results are the least accurate, then a log spread up to 32767
+    for (int i = 0; i < NUMSAMPLES; ++i)
+        inputx[i] = randomlogfixedpointnum(1.0 / FIXEDPOINTONE, 32767);
+
+    double start = seconds();
+    for (int pass = 0; pass < TIMINGPASSES; ++pass)
+        for (int i = 0; i < NUMSAMPLES; ++i)
+            sink = function(inputx[i]);
+    result->nanoseconds = (seconds() - start) * 1e9 / ((double) TIMINGPASSES * NUMSAMPLES);
+
+    for (fixedpointnum x = 1; x <= 16 * FIXEDPOINTONE; ++x) {
+        double exact = pow(FPTODOUBLE(x), power);
+        if (adderror(result, FPTODOUBLE(addoutput(result, function(x))) / exact - 1))
+            snprintf(result->worst, sizeof(result->worst), "%.6f", FPTODOUBLE(x));
+    }
+    for (int i = 0; i < NUMSAMPLES; ++i) {
+        double exact = pow(FPTODOUBLE(inputx[i]), power);
+        if (adderror(result, FPTODOUBLE(addoutput(result, function(inputx[i]))) / exact - 1))
+            snprintf(result->worst, sizeof(result->worst), "%.6f", FPTODOUBLE(inputx[i]));
+    }
+}
+
+static void benchstringtofixedpointnum(void)
+{
+    benchresult *result = newresult("lib_fp_stringtofixedpointnum", "1");
+    static char strings[NUMSAMPLES / 10][24];
+    const int numstrings = NUMSAMPLES / 10;
+
+    // integer parts over the whole range, 0 to 8 digits after the decimal point
+    for (int i = 0; i < numstrings; ++i) {
+        int digits = randomnumber() % 9;
+        double value = randomuniform(-32767, 32767);
+        if (digits)
+            snprintf(strings[i], sizeof(strings[i]), "%.*f", digits, value);
+        else
+            snprintf(strings[i], sizeof(strings[i]), "%ld", lrint(value));
+    }
+
+    // the function writes into the string when it has more than 6 decimals, so always work on a copy
+    char copy[24];
+    double start = seconds();
+    for (int pass = 0; pass < TIMINGPASSES; ++pass)
+        for (int i = 0; i < numstrings; ++i) {
+            strcpy(copy, strings[i]);
+            sink = lib_fp_stringtofixedpointnum(copy);
+        }
+    result->nanoseconds = (seconds() - start) * 1e9 / ((double) TIMINGPASSES * numstrings);
+
+    for (int i = 0; i < numstrings; ++i) {
+        strcpy(copy, strings[i]);
+        if (adderror(result, FPTODOUBLE(addoutput(result, lib_fp_stringtofixedpointnum(copy))) - strtod(strings[i], NULL)))
+            snprintf(result->worst, sizeof(result->worst), "%.40s", strings[i]);
+    }
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-s seed] [-o results.csv] [-c]\n", program);
+    fprintf(stderr, "  -s  seed for the random inputs\n");
+    fprintf(stderr, "  -o  also write the results in CSV format\n");
+    fprintf(stderr, "  -c  print only the checksum of each kernel's results\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *csvfile = NULL;
+    bool checksumsonly = false;
+    int option;
+
+    while ((option = getopt(argc, argv, "s:o:ch")) != -1) {
+        switch (option) {
+            case 's':
+                randomstate = (uint32_t) strtoul(optarg, NULL, 0);
+                if (!randomstate)
+                    randomstate = 1;
+                break;
+            case 'o':
+                csvfile = fopen(optarg, "w");
+                if (!csvfile) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 'c':
+                checksumsonly = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    benchmultiply();
+    benchlowpassfilter("lib_fp_lowpassfilter", TIMESLIVEREXTRASHIFT);
+    benchlowpassfilter("lib_fp_lowpassfilter unshifted", 0);
+    benchsineorcosine("lib_fp_sine", lib_fp_sine, sin);
+    benchsineorcosine("lib_fp_cosine", lib_fp_cosine, cos);
+    benchatan2();
+    benchsquareroot("lib_fp_invsqrt", lib_fp_invsqrt, -0.5);
+    benchsquareroot("lib_fp_sqrt", lib_fp_sqrt, 0.5);
+    benchstringtofixedpointnum();
+
+    if (checksumsonly) {
+        for (int i = 0; i < numresults; ++i)
+            printf("%-32s %08x\n", results[i].name, results[i].checksum);
+        return 0;
+    }
+
+    printf("%-32s %8s %12s %12s %5s %8s  %s\n", "kernel", "ns/op", "max error", "rms error", "unit", "checksum",
+           "worst input");
+    if (csvfile)
+        fprintf(csvfile, "kernel,samples,nsperop,maxerror,rmserror,unit,checksum,worstinput\n");
+    for (int i = 0; i < numresults; ++i) {
+        benchresult *result = &results[i];
+        double rms = sqrt(result->squaredsum / result->samples);
+        printf("%-32s %8.2f %12.3g %12.3g %5s %08x  %s\n", result->name, result->nanoseconds, result->maxerror, rms,
+               result->unit, result->checksum, result->worst);
+        if (csvfile)
+            fprintf(csvfile, "%s,%lu,%.3f,%.6g,%.6g,%s,%08x,\"%s\"\n", result->name, result->samples,
+                    result->nanoseconds, result->maxerror, rms, result->unit, result->checksum, result->worst);
+    }
+    if (csvfile)
+        fclose(csvfile);
+    return 0;
+}
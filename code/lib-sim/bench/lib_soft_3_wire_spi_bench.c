@@ -0,0 +1,157 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <time.h>
+
+#include "hal.h"
+#include "lib_soft_3_wire_spi.h"
+
+// The Mini51 3-wire SPI from lib-Mini51/hal, run against GPIO registers in memory, next to the version that
+// went through lib_digitalio_setoutput() for every edge.  Both move the same bytes the way the A7105 driver
+// does (a 16 byte payload at a time).  ns/byte is host time, so only the ratio between the two means much.
+// The pins are only memory here, so nothing answers on SDIO.  The checks make sure both versions leave the
+// pins and the SDIO direction the same and read back what is on the pin.
+
+#define SDIOPIN     (DIGITALPORT1 | 2)  // same pins as rx_x4.c
+#define SCKPIN      (DIGITALPORT1 | 3)
+#define SCSPIN      (DIGITALPORT1 | 4)
+
+#define PAYLOADSIZE 16
+#define TIMINGPASSES 200000
+
+GPIO_T sim_gpioports[6];
+volatile uint32_t sim_gpiopins[6 * 8];
+
+static volatile uint8_t sink;
+static int failures;
+
+// the implementation before the pin addresses were cached
+
+static void reference_write(uint8_t data)
+{
+    uint8_t n = 8;
+    lib_digitalio_setoutput(SCKPIN, DIGITALOFF);
+    lib_digitalio_setoutput(SDIOPIN, DIGITALOFF);
+    while (n--) {
+        if (data & 0x80)        // MSB first
+            lib_digitalio_setoutput(SDIOPIN, DIGITALON);
+        else
+            lib_digitalio_setoutput(SDIOPIN, DIGITALOFF);
+        lib_digitalio_setoutput(SCKPIN, DIGITALON);
+        lib_digitalio_setoutput(SCKPIN, DIGITALOFF);
+        data = data << 1;
+    }
+    lib_digitalio_setoutput(SDIOPIN, DIGITALON);
+}
+
+static uint8_t reference_read(void)
+{
+    uint8_t result = 0;
+    lib_digitalio_initpin(SDIOPIN, DIGITALINPUT);
+    for (int i = 0; i < 8; i++) {
+        if (lib_digitalio_getinput(SDIOPIN))
+            result = (result << 1) | 0x01;
+        else
+            result = result << 1;
+        lib_digitalio_setoutput(SCKPIN, DIGITALON);
+        lib_digitalio_setoutput(SCKPIN, DIGITALOFF);
+    }
+    lib_digitalio_initpin(SDIOPIN, DIGITALOUTPUT);
+    return result;
+}
+
+static double seconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void check(const char *what, uint32_t got, uint32_t expected)
+{
+    if (got == expected)
+        return;
+    printf("FAILED: %s is 0x%x, expected 0x%x\n", what, got, expected);
+    failures++;
+}
+
+static void checkpins(const char *after)
+{
+    char what[64];
+    snprintf(what, sizeof(what), "P1 PMD after %s", after);
+    check(what, sim_gpioports[1].PMD, 0x15 << 4);     // P1.2-P1.4 outputs
+    snprintf(what, sizeof(what), "SDIO after %s", after);
+    check(what, GPIO_PIN_ADDR(1, 2), 1);
+    snprintf(what, sizeof(what), "SCK after %s", after);
+    check(what, GPIO_PIN_ADDR(1, 3), 0);
+}
+
+static void checkbothversions(void)
+{
+    lib_soft_3_wire_spi_init(SDIOPIN, SCKPIN, SCSPIN);
+    check("P1 PMD after init", sim_gpioports[1].PMD, 0x15 << 4);
+    check("SCS after init", GPIO_PIN_ADDR(1, 4), 0);
+
+    reference_write(0xA5);
+    checkpins("reference write");
+    lib_soft_3_wire_spi_write(0xA5);
+    checkpins("write");
+
+    // a read leaves SDIO as an output again, with whatever the A7105 last put on it
+    for (uint32_t level = 0; level < 2; ++level) {
+        GPIO_PIN_ADDR(1, 2) = level;
+        check("reference read", reference_read(), level ? 0xFF : 0x00);
+        check("read", lib_soft_3_wire_spi_read(), level ? 0xFF : 0x00);
+        check("P1 PMD after read", sim_gpioports[1].PMD, 0x15 << 4);
+    }
+    GPIO_PIN_ADDR(1, 2) = 1;
+}
+
+static double timewrite(void (*write) (uint8_t))
+{
+    double start = seconds();
+    for (int pass = 0; pass < TIMINGPASSES; ++pass)
+        for (uint8_t i = 0; i < PAYLOADSIZE; ++i)
+            write(i * 37);
+    return (seconds() - start) * 1e9 / ((double) TIMINGPASSES * PAYLOADSIZE);
+}
+
+static double timeread(uint8_t(*read) (void))
+{
+    double start = seconds();
+    for (int pass = 0; pass < TIMINGPASSES; ++pass)
+        for (int i = 0; i < PAYLOADSIZE; ++i)
+            sink = read();
+    return (seconds() - start) * 1e9 / ((double) TIMINGPASSES * PAYLOADSIZE);
+}
+
+int main(void)
+{
+    checkbothversions();
+
+    double referencewrite = timewrite(reference_write);
+    double fastwrite = timewrite(lib_soft_3_wire_spi_write);
+    double referenceread = timeread(reference_read);
+    double fastread = timeread(lib_soft_3_wire_spi_read);
+
+    printf("%-32s %14s %14s %8s\n", "operation", "lib_digitalio", "cached pins", "speedup");
+    printf("%-32s %11.2f ns %11.2f ns %7.1fx\n", "lib_soft_3_wire_spi_write", referencewrite, fastwrite,
+           referencewrite / fastwrite);
+    printf("%-32s %11.2f ns %11.2f ns %7.1fx\n", "lib_soft_3_wire_spi_read", referenceread, fastread,
+           referenceread / fastread);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,624 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <limits.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "hal.h"
+#include "drv_serial.h"
+#include "lib_serial.h"
+#include "bradwii.h"
+#include "serial.h"
+#include "profiler.h"
+#include "rx.h"
+#include "blackbox.h"
+
+// The MSP responses of src/serial.c, built for serial port 0 and written by the lib-Mini51 serial driver into
+// memory that stands in for the UART.  Each request goes into the RX buffer the way the UART interrupt puts it
+// there, serialcheckforaction() answers it, and the TX buffer is emptied through UART_IRQHandler() as the THRE
+// interrupt does.  Every response is checked (header, size, command, checksum) and the THRE interrupt enables it
+// took are counted, each one is a read-modify-write of IER and an NVIC write on the Mini51.  Then the sending
+// alone is timed against the per byte path serial.c used before: lib_serial_sendchar() and a checksum update
+// for every byte.  ns are host time, so only the ratio between the two means much.
+//
+// The dispatch table is checked next: a request shorter than its command's payload gets an error and changes
+// nothing, a short response is sent while the TX buffer has room for it but not for a long one, and MSP_MULTIPLE
+// sends the responses of the commands it lists, and refuses the ones it can't, as MSP_SET_TELEMETRY does.
+// MSP_BLACKBOX_READ is checked against a log of known bytes, at its start, its end and past it, and with the
+// data flash unavailable.
+//
+// Last, a configurator asks for attitude, IMU, motor and RC data over a 115200 baud link for LINKSECONDS, first
+// by polling one request at a time and then by subscribing with MSP_SET_TELEMETRY.  The main loop gets to
+// serialcheckforaction() every SERIALTASKMICROSECONDS and the UART sends at its real rate in between.  The
+// frames that arrive are checked and counted per command.  Then it takes snapshots of attitude, RC, motors, status
+// and battery, one request per command and then all of them in one MSP_MULTIPLE.
+
+#define TIMINGPASSES 200000
+#define UNKNOWNCOMMAND 199
+
+#define LINKSECONDS 10
+#define SERIALTASKMICROSECONDS 1000
+#define UARTBYTESPERSECOND 11520        // 115200 baud, 10 bits a byte
+#define HOSTTURNAROUNDMICROSECONDS 1000 // from a response to the next request, the latency of a USB serial adapter
+#define REQUESTMICROSECONDS 521         // the 6 bytes of a request on the wire
+#define LARGESTSTREAMED 24              // MSP_RAW_IMU, the budget can be overrun by one response
+
+static const unsigned char streamed[] = { MSP_ATTITUDE, MSP_RAW_IMU, MSP_MOTOR, MSP_RC };
+static const unsigned char snapshot[] = { MSP_ATTITUDE, MSP_RC, MSP_MOTOR, MSP_STATUS, MSP_BAT };
+static const unsigned char snapshotsizes[] = { 6, 16, 16, 10, 3 };
+
+static const unsigned char commands[] = {
+    MSP_IDENT, MSP_STATUS, MSP_RAW_IMU, MSP_RC, MSP_ATTITUDE, MSP_MOTOR, MSP_PID, MSP_BOX,
+    MSP_BAT, MSP_LOOP_PROFILE, MSP_LINK_STATS, MSP_BOXNAMES, UNKNOWNCOMMAND
+};
+
+SYS_T sim_sys;
+UART_T sim_uart;
+CLK_T sim_clk;
+
+globalstruct global;
+usersettingsstruct usersettings;
+const char checkboxnames[] = "Arm;" "Thr. Helper;" "Alt. Hold;" "Mag. Hold;" "Pos. Hold;" "Ret. Home;" "Semi Acro;"
+    "Full Acro;" "High Rates;" "High Angle;" "Auto Tune;" "Uncrashable;" "Headfree;" "Yaw Hold;";
+unsigned int lib_i2c_error_count;
+
+static profilerentrystruct profilerentry;
+static linkstatsstruct linkstats;
+static bool blackboxunavailable;        // as when drv_hal.c couldn't set up the data flash
+
+static unsigned char response[512];
+static unsigned int responselength;
+static unsigned long interruptenables;
+static bool sendatonce;         // empty the TX buffer as soon as its interrupt is enabled
+static volatile unsigned char sink;
+static int failures;
+
+// the configurator's end of the link, it takes the responses apart as they come in
+static struct {
+    int state;
+    unsigned char size, command, checksum, count;
+} host;
+static unsigned long framesreceived[256];
+static unsigned long lastframecommand;
+static bool framecomplete;
+static unsigned long benchmicroseconds;
+
+// what serial.c calls in the rest of the firmware
+void imuupdateeulerattitude(void)
+{
+}
+
+void calibratecompass(void)
+{
+}
+
+void calibrategyroandaccelerometer(bool both)
+{
+}
+
+void defaultusersettings(void)
+{
+}
+
+void writeusersettingstoeeprom(void)
+{
+}
+
+void resetprofiler(void)
+{
+}
+
+profilerentrystruct *getprofilerentry(unsigned char entry)
+{
+    return &profilerentry;
+}
+
+unsigned short profileraveragemicroseconds(profilerentrystruct * entry)
+{
+    return 0;
+}
+
+linkstatsstruct *getlinkstats(unsigned char secondsago)
+{
+    return &linkstats;
+}
+
+// the byte at index i of the log is its low byte
+size_t blackboxread(void *dst, unsigned long index, size_t size)
+{
+    if (blackboxunavailable || index >= BLACKBOXSIZE)
+        return 0;
+    if (size > BLACKBOXSIZE - index)
+        size = BLACKBOXSIZE - index;
+    for (size_t i = 0; i < size; ++i)
+        ((unsigned char *) dst)[i] = index + i;
+    return size;
+}
+
+unsigned long lib_timers_starttimer(void)
+{
+    return benchmicroseconds;
+}
+
+unsigned long lib_timers_gettimermicroseconds(unsigned long starttime)
+{
+    return benchmicroseconds - starttime;
+}
+
+void UART_IRQHandler(void);
+
+// what lib-Mini51/hal/drv_serial.c calls in the StdDriver
+void CLK_EnableModuleClock(uint32_t u32ModuleIdx)
+{
+}
+
+void UART_Open(UART_T * uart, uint32_t u32baudrate)
+{
+}
+
+static void hostreceive(unsigned char c)
+{
+    if (host.state == 0)
+        host.state = c == '$';
+    else if (host.state == 1)
+        host.state = c == 'M' ? 2 : 0;
+    else if (host.state == 2)
+        host.state = c == '>' || c == '!' ? 3 : 0;
+    else if (host.state == 3) {
+        host.size = host.checksum = c;
+        host.count = 0;
+        host.state = 4;
+    } else if (host.state == 4) {
+        host.command = c;
+        host.checksum ^= c;
+        host.state = 5;
+    } else if (host.count < host.size) {
+        host.checksum ^= c;
+        host.count++;
+    } else {
+        if (host.checksum == c) {
+            framesreceived[host.command]++;
+            lastframecommand = host.command;
+            framecomplete = true;
+        } else {
+            printf("FAILED: bad checksum on a %u byte response to %u\n", host.size, host.command);
+            failures++;
+        }
+        host.state = 0;
+    }
+}
+
+// as the THRE interrupt would, for up to limit bytes
+static int sendtxbytes(int limit)
+{
+    int sent = 0;
+    while (sent < limit && (UART->IER & UART_IER_THRE_IEN_Msk)) {
+        uint32_t tail = serialPort1.txBufferTail;
+        UART->ISR = UART_ISR_THRE_INT_Msk;
+        UART_IRQHandler();
+        if (serialPort1.txBufferTail != tail) {
+            if (responselength < sizeof(response))
+                response[responselength++] = UART->THR;
+            hostreceive(UART->THR);
+            sent++;
+        }
+    }
+    UART->ISR = 0;
+    return sent;
+}
+
+static void sendtxbuffer(void)
+{
+    sendtxbytes(INT_MAX);
+}
+
+void UART_EnableInt(UART_T * uart, uint32_t u32InterruptFlag)
+{
+    uart->IER |= u32InterruptFlag;
+    interruptenables++;
+    if (sendatonce)
+        sendtxbuffer();
+}
+
+static double seconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void receive(unsigned char c)
+{
+    serialPort1.rxBuffer[serialPort1.rxBufferHead] = c;
+    serialPort1.rxBufferHead = (serialPort1.rxBufferHead + 1) % serialPort1.rxBufferSize;
+}
+
+static void requestwithdata(unsigned char command, const unsigned char *data, unsigned char size)
+{
+    unsigned char checksum = size ^ command;
+    receive('$');
+    receive('M');
+    receive('<');
+    receive(size);
+    receive(command);
+    for (int i = 0; i < size; ++i) {
+        receive(data[i]);
+        checksum ^= data[i];
+    }
+    receive(checksum);
+}
+
+static void request(unsigned char command)
+{
+    requestwithdata(command, NULL, 0);
+}
+
+// SERIALTASKMICROSECONDS of the link: the main loop calls serialcheckforaction() and the UART sends what it can
+// until the next time.  Returns the number of bytes the call put in the send buffer.
+static unsigned int linkstep(double *uartcredit)
+{
+    uint32_t head = serialPort1.txBufferHead;
+    serialcheckforaction();
+    unsigned int percall = (serialPort1.txBufferHead + serialPort1.txBufferSize - head) % serialPort1.txBufferSize;
+
+    responselength = 0;
+    framecomplete = false;
+    *uartcredit += UARTBYTESPERSECOND * SERIALTASKMICROSECONDS / 1e6;
+    *uartcredit -= sendtxbytes((int) *uartcredit);
+    if (!(UART->IER & UART_IER_THRE_IEN_Msk))
+        *uartcredit = 0;        // the line was idle for the rest of the time
+    return percall;
+}
+
+// LINKSECONDS of the configurator asking for the streamed commands, returns the largest number of bytes put in
+// the send buffer by one call of serialcheckforaction()
+static unsigned int runlink(bool subscribe)
+{
+    unsigned long end = benchmicroseconds + LINKSECONDS * 1000000UL;
+    unsigned long nextrequest = benchmicroseconds;
+    unsigned int nextstreamed = 0, mostpercall = 0;
+    bool waiting = false;
+    double uartcredit = 0;
+
+    memset(framesreceived, 0, sizeof(framesreceived));
+    if (subscribe) {
+        unsigned char pairs[sizeof(streamed) * 2];
+        for (unsigned int i = 0; i < sizeof(streamed); ++i) {
+            pairs[i * 2] = streamed[i];
+            pairs[i * 2 + 1] = 250;     // more than the link can carry
+        }
+        requestwithdata(MSP_SET_TELEMETRY, pairs, sizeof(pairs));
+    }
+
+    for (; benchmicroseconds < end; benchmicroseconds += SERIALTASKMICROSECONDS) {
+        if (!subscribe && !waiting && (long) (benchmicroseconds - nextrequest) >= 0) {
+            request(streamed[nextstreamed]);
+            nextstreamed = (nextstreamed + 1) % sizeof(streamed);
+            waiting = true;
+        }
+
+        unsigned int percall = linkstep(&uartcredit);
+        if (percall > mostpercall)
+            mostpercall = percall;
+        if (waiting && framecomplete) {
+            waiting = false;
+            nextrequest = benchmicroseconds + HOSTTURNAROUNDMICROSECONDS + REQUESTMICROSECONDS;
+        }
+    }
+
+    // stop the subscription, and let the last frames out
+    if (subscribe) {
+        requestwithdata(MSP_SET_TELEMETRY, NULL, 0);
+        serialcheckforaction();
+    }
+    sendtxbuffer();
+    return mostpercall;
+}
+
+// LINKSECONDS of the configurator taking snapshots, a request for each command in turn or one MSP_MULTIPLE for all
+// of them.  Returns the snapshots per second.
+static double runsnapshots(bool batched)
+{
+    unsigned long end = benchmicroseconds + LINKSECONDS * 1000000UL;
+    unsigned long nextrequest = benchmicroseconds;
+    unsigned long snapshots = 0;
+    unsigned int next = 0;
+    bool waiting = false;
+    double uartcredit = 0;
+
+    for (; benchmicroseconds < end; benchmicroseconds += SERIALTASKMICROSECONDS) {
+        if (!waiting && (long) (benchmicroseconds - nextrequest) >= 0) {
+            if (batched)
+                requestwithdata(MSP_MULTIPLE, snapshot, sizeof(snapshot));
+            else
+                request(snapshot[next]);
+            waiting = true;
+        }
+        linkstep(&uartcredit);
+        if (waiting && framecomplete) {
+            waiting = false;
+            if (batched || ++next == sizeof(snapshot)) {
+                snapshots++;
+                next = 0;
+            }
+            nextrequest = benchmicroseconds + HOSTTURNAROUNDMICROSECONDS + REQUESTMICROSECONDS;
+        }
+    }
+    sendtxbuffer();
+    return snapshots / (double) LINKSECONDS;
+}
+
+static void reportlink(const char *name, unsigned int mostpercall)
+{
+    unsigned long total = 0;
+    printf("%-10s", name);
+    for (unsigned int i = 0; i < sizeof(streamed); ++i) {
+        printf(" %7.1f/s", framesreceived[streamed[i]] / (double) LINKSECONDS);
+        total += framesreceived[streamed[i]];
+    }
+    printf(" %8.1f/s %12u\n", total / (double) LINKSECONDS, mostpercall);
+}
+
+static void checkresponse(unsigned char command)
+{
+    unsigned char size = response[3], checksum = 0;
+    bool known = command != UNKNOWNCOMMAND;
+    if (responselength < 6 || memcmp(response, known ? "$M>" : "$M!", 3) || responselength != size + 6u
+        || response[4] != command) {
+        printf("FAILED: %d: %u bytes, header %.3s size %u command %u\n", command, responselength, response,
+               size, response[4]);
+        failures++;
+        return;
+    }
+    for (unsigned int i = 3; i < responselength - 1; ++i)
+        checksum ^= response[i];
+    if (checksum != response[responselength - 1]) {
+        printf("FAILED: %d: checksum 0x%02x, expected 0x%02x\n", command, response[responselength - 1], checksum);
+        failures++;
+    }
+}
+
+// the send path serial.c used before, one lib_serial_sendchar() and checksum update per byte
+static void reference_send(const unsigned char *bytes, unsigned int length)
+{
+    unsigned char checksum = 0;
+    for (unsigned int i = 0; i < length; ++i) {
+        lib_serial_sendchar(0, bytes[i]);
+        checksum ^= bytes[i];
+    }
+    sink = checksum;
+}
+
+static void frame_send(const unsigned char *bytes, unsigned int length)
+{
+    serialframestruct frame;
+    unsigned char checksum = 0;
+    lib_serial_beginframe(0, &frame, length);
+    for (unsigned int i = 0; i < length; ++i) {
+        lib_serial_framechar(&frame, bytes[i]);
+        checksum ^= bytes[i];
+    }
+    lib_serial_sendframe(&frame);
+    sink = checksum;
+}
+
+static double timesend(void (*send) (const unsigned char *, unsigned int), const unsigned char *bytes,
+                       unsigned int length)
+{
+    double elapsed = 0;
+    for (int pass = 0; pass < TIMINGPASSES; ++pass) {
+        double start = seconds();
+        send(bytes, length);
+        elapsed += seconds() - start;
+        responselength = 0;
+        sendtxbuffer();
+    }
+    return elapsed * 1e9 / TIMINGPASSES;
+}
+
+static double timeresponse(unsigned char command)
+{
+    double elapsed = 0;
+    for (int pass = 0; pass < TIMINGPASSES / 10; ++pass) {
+        request(command);
+        double start = seconds();
+        serialcheckforaction();
+        elapsed += seconds() - start;
+        responselength = 0;
+        sendtxbuffer();
+    }
+    return elapsed * 1e9 / (TIMINGPASSES / 10);
+}
+
+static void checkdispatch(void)
+{
+    unsigned char shortpid[3] = { 1, 2, 3 };
+    fixedpointnum pgain = usersettings.pid_pgain[0];
+    responselength = 0;
+    requestwithdata(MSP_SET_PID, shortpid, sizeof(shortpid));
+    serialcheckforaction();
+    sendtxbuffer();
+    if (responselength < 3 || memcmp(response, "$M!", 3) || usersettings.pid_pgain[0] != pgain) {
+        printf("FAILED: a %u byte MSP_SET_PID was taken\n", (unsigned int) sizeof(shortpid));
+        failures++;
+    }
+
+    // MSP_PID leaves less room than MSP_LOOP_PROFILE needs, but enough for MSP_ATTITUDE
+    request(MSP_PID);
+    serialcheckforaction();
+    int room = lib_serial_availableoutputbuffersize(0);
+    request(MSP_ATTITUDE);
+    serialcheckforaction();
+    if (lib_serial_availableoutputbuffersize(0) != room - 12) {
+        printf("FAILED: MSP_ATTITUDE waited with %d bytes of room\n", room);
+        failures++;
+    }
+    responselength = 0;
+    sendtxbuffer();
+
+    // the sizes of the snapshot responses, one after the other
+    responselength = 0;
+    requestwithdata(MSP_MULTIPLE, snapshot, sizeof(snapshot));
+    serialcheckforaction();
+    sendtxbuffer();
+    checkresponse(MSP_MULTIPLE);
+    unsigned int position = 5;
+    for (unsigned int i = 0; i < sizeof(snapshot) && position < responselength; ++i) {
+        if (response[position] != snapshotsizes[i]) {
+            printf("FAILED: MSP_MULTIPLE sent %u bytes for %u\n", response[position], snapshot[i]);
+            failures++;
+        }
+        position += 1 + response[position];
+    }
+    if (position != responselength - 1u) {
+        printf("FAILED: MSP_MULTIPLE responses take %u of %u bytes\n", position - 5, responselength - 6);
+        failures++;
+    }
+
+    // an in message, more than fits in the send buffer, and a response that can be shorter than its table entry
+    static const unsigned char refused[3][6] = {
+        { MSP_ATTITUDE, MSP_SET_PID },
+        { MSP_ATTITUDE, MSP_RC, MSP_MOTOR, MSP_STATUS, MSP_RAW_IMU },
+        { MSP_ATTITUDE, MSP_BLACKBOX_READ }
+    };
+    static const unsigned char refusedsize[3] = { 2, 5, 2 };
+    for (int i = 0; i < 3; ++i) {
+        responselength = 0;
+        requestwithdata(MSP_MULTIPLE, refused[i], refusedsize[i]);
+        serialcheckforaction();
+        sendtxbuffer();
+        if (responselength < 3 || memcmp(response, "$M!", 3)) {
+            printf("FAILED: MSP_MULTIPLE of %d commands wasn't refused\n", refusedsize[i]);
+            failures++;
+        }
+    }
+
+    // responses that would wait for the UART, or be errors, can't be pushed
+    static const unsigned char unpushable[] = {
+        MSP_BOXNAMES, MSP_MULTIPLE, UNKNOWNCOMMAND, MSP_SET_PID, MSP_BLACKBOX_READ
+    };
+    for (unsigned int i = 0; i < sizeof(unpushable); ++i) {
+        unsigned char pair[2] = { unpushable[i], 50 };
+        responselength = 0;
+        requestwithdata(MSP_SET_TELEMETRY, pair, sizeof(pair));
+        serialcheckforaction();
+        sendtxbuffer();
+        if (responselength < 3 || memcmp(response, "$M!", 3)) {
+            printf("FAILED: MSP_SET_TELEMETRY took %u\n", unpushable[i]);
+            failures++;
+        }
+    }
+}
+
+static unsigned long responselong(unsigned int position)
+{
+    return response[position] | response[position + 1] << 8 | (unsigned long) response[position + 2] << 16
+        | (unsigned long) response[position + 3] << 24;
+}
+
+// the offset comes back with the size of the log and the bytes from there on, as many as there are up to 32
+static void checkblackboxread(void)
+{
+    static const unsigned long offsets[] = { 0, 32, BLACKBOXSIZE - 10, BLACKBOXSIZE, BLACKBOXSIZE + 100, 64 };
+    for (unsigned int i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i) {
+        unsigned long offset = offsets[i];
+        unsigned char payload[4] = { offset, offset >> 8, offset >> 16, offset >> 24 };
+        unsigned int expected = offset >= BLACKBOXSIZE ? 0 : BLACKBOXSIZE - offset < 32 ? BLACKBOXSIZE - offset : 32;
+
+        blackboxunavailable = i == sizeof(offsets) / sizeof(offsets[0]) - 1;
+        if (blackboxunavailable)
+            expected = 0;
+        responselength = 0;
+        requestwithdata(MSP_BLACKBOX_READ, payload, sizeof(payload));
+        serialcheckforaction();
+        sendtxbuffer();
+        checkresponse(MSP_BLACKBOX_READ);
+        if (responselength != 6 + 8 + expected || responselong(5) != offset || responselong(9) != BLACKBOXSIZE) {
+            printf("FAILED: MSP_BLACKBOX_READ at %lu%s: %u bytes, offset %lu, size %lu\n", offset,
+                   blackboxunavailable ? " without the flash" : "", responselength, responselong(5), responselong(9));
+            failures++;
+            continue;
+        }
+        for (unsigned int j = 0; j < expected; ++j) {
+            if (response[13 + j] != (unsigned char) (offset + j)) {
+                printf("FAILED: MSP_BLACKBOX_READ at %lu: byte %u is %u\n", offset, j, response[13 + j]);
+                failures++;
+                break;
+            }
+        }
+    }
+    blackboxunavailable = false;
+}
+
+int main(void)
+{
+    serialinit();
+    linkstats.validpackets = 100;
+    linkstats.rssi = 80;
+
+    printf("%-8s %6s %23s %14s %14s %8s %14s\n", "command", "bytes", "THRE enables old -> new", "sendchar",
+           "frame", "speedup", "whole request");
+    for (unsigned int i = 0; i < sizeof(commands); ++i) {
+        unsigned char command = commands[i];
+
+        sendatonce = true;
+        responselength = 0;
+        interruptenables = 0;
+        request(command);
+        serialcheckforaction();
+        sendatonce = false;
+        checkresponse(command);
+        unsigned long enables = interruptenables;
+
+        unsigned char bytes[sizeof(response)];
+        unsigned int length = responselength;
+        memcpy(bytes, response, length);
+
+        // a response longer than the TX buffer only goes out while the interrupt empties it
+        if (length < serialPort1.txBufferSize) {
+            double referencens = timesend(reference_send, bytes, length);
+            double framens = timesend(frame_send, bytes, length);
+            printf("%-8d %6u %16u -> %-4lu %11.1f ns %11.1f ns %7.1fx %11.1f ns\n", command, length, length,
+                   enables, referencens, framens, referencens / framens, timeresponse(command));
+        } else
+            printf("%-8d %6u %16u -> %-4lu %14s %14s %8s %14s\n", command, length, length, enables, "-", "-", "-",
+                   "-");
+    }
+
+    checkdispatch();
+    checkblackboxread();
+
+    printf("\n%d s at 115200 baud, serialcheckforaction() every %d us, %d us host turnaround, %d byte budget\n",
+           LINKSECONDS, SERIALTASKMICROSECONDS, HOSTTURNAROUNDMICROSECONDS, MSP_TELEMETRY_BYTES_PER_LOOP);
+    printf("%-10s", "");
+    for (unsigned int i = 0; i < sizeof(streamed); ++i)
+        printf(" %9d", streamed[i]);
+    printf(" %10s %12s\n", "frames", "most a call");
+    reportlink("polled", runlink(false));
+    unsigned int mostpercall = runlink(true);
+    reportlink("pushed", mostpercall);
+    if (mostpercall > MSP_TELEMETRY_BYTES_PER_LOOP - 1 + LARGESTSTREAMED) {
+        printf("FAILED: %u bytes in one call\n", mostpercall);
+        failures++;
+    }
+
+    printf("\nsnapshots of");
+    for (unsigned int i = 0; i < sizeof(snapshot); ++i)
+        printf(" %d", snapshot[i]);
+    printf(": %.1f/s with a request each, %.1f/s with MSP_MULTIPLE\n", runsnapshots(false), runsnapshots(true));
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,310 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bradwii.h"
+#include "rx.h"
+#include "lib_timers.h"
+#include "sim.h"
+
+// Replays the FIFO frames of a capture decoded by reverse/A7105/quadcsv.py through the unmodified rx_x4.c, with the
+// A7105 model of lib-sim/model in between.  The frames go on the air at their times in the capture, on the channel
+// and id the quad is listening on, and initrx()/readrx() run once per control loop tick as in bradwii.c.  Nothing
+// else of the firmware runs.
+//
+// Frames written by the handset (W FIFO, or W T: for a control packet) are what it sent, they are on the air
+// until 2.06 ms after the write.
+// Frames read by the handset (R FIFO) are what a quad sent it, they were on the air just before the read.
+// By default the handset model binds with the quad first and the capture replaces its control packets after
+// that.  With -u the capture is on the air from power on and the quad has to bind from it.
+
+#define AIRNANOSECONDS      2060000ULL
+#define LOOPFREQUENCY       400         // CONTROL_LOOP_FREQUENCY in config_X4.h
+#define LOOPTIMESLIVER      ((FIXEDPOINTONE << TIMESLIVEREXTRASHIFT) / LOOPFREQUENCY)
+#define MAXFRAMES           16384
+#define TAILNANOSECONDS     100000000ULL        // keep going after the last frame, for the timeouts
+#define GIVEUPNANOSECONDS   60000000000ULL      // the handset model never bound
+
+#define FPTODOUBLE(x)       ((double) (x) / FIXEDPOINTONE)
+
+enum {
+    OUTCOME_NONE = 0,
+    OUTCOME_ACCEPTED,           // readrx() took it as a packet from the bound handset
+    OUTCOME_BIND,               // read while binding
+    OUTCOME_BADCHECKSUM,
+    OUTCOME_REJECTED,           // good checksum, but readrx() didn't take it (another tx id)
+    OUTCOME_NOTREAD,            // landed in the FIFO but the quad never read it out
+    OUTCOME_NOTHEARD,           // the quad wasn't listening
+    OUTCOME_NOTSENT,
+    NUMOUTCOMES
+};
+
+static const char *outcomenames[NUMOUTCOMES] = {
+    "", "accepted", "bind", "bad checksum", "rejected", "not read", "not heard", "not sent"
+};
+
+globalstruct global;
+unsigned long timeslivertimer;
+
+static uint64_t now;
+static uint32_t loopcpunanoseconds = SIM_DEFAULT_LOOP_CPU_US * 1000;
+
+static simreplayframe frames[MAXFRAMES];
+static unsigned char outcomes[MAXFRAMES];
+static unsigned long writtenframes, readframes;
+
+uint64_t sim_nanoseconds(void)
+{
+    return now;
+}
+
+void sim_advance(uint32_t nanoseconds)
+{
+    now += nanoseconds;
+    sim_a7105_update(now);
+}
+
+// the rest of the control loop, which doesn't run here
+void sim_chargeloop(void)
+{
+    sim_advance(loopcpunanoseconds);
+}
+
+void sim_recordloop(unsigned long microseconds)
+{
+}
+
+static double walltime(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// "remote 4.000279 R FIFO 0x45 | 0xe1 | ... | 0x89", the first byte is the SPI command
+static unsigned long readcapture(const char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    if (!file)
+        return 0;
+
+    unsigned long count = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), file) && count < MAXFRAMES) {
+        double seconds;
+        char kind[8];
+        int offset = -1;
+        if (sscanf(line, "%*s %lf %7s %n", &seconds, kind, &offset) != 2 || offset < 0)
+            continue;
+
+        // the bytes come after FIFO, or after the sticks for the control packets a7105.py decodes
+        char *field = strstr(line + offset, "0x");
+        if (!field)
+            continue;
+        unsigned int command = strtoul(field, &field, 16);
+        int bytes = 0;
+        while (bytes < 16 && (field = strchr(field, '|')))
+            frames[count].payload[bytes++] = strtoul(field + 1, &field, 16);
+        if (bytes != 16 || (command & 0x3F) != 0x05)
+            continue;
+
+        frames[count].end = (uint64_t) (seconds * 1e9 + 0.5);
+        if (kind[0] == 'W') {
+            frames[count].end += AIRNANOSECONDS;
+            writtenframes++;
+        } else
+            readframes++;
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+static bool goodchecksum(const simreplayframe * frame)
+{
+    uint8_t sum = 0;
+    for (int i = 0; i < 16; i++)
+        sum += frame->payload[i];
+    return sum == 0;
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-u] [-v] [-c loop cpu us] capture.csv\n", program);
+    fprintf(stderr, "  -u  the capture is on the air from power on, the quad binds from it\n");
+    fprintf(stderr, "  -v  print every frame: what became of it, its latency and the sticks after it\n");
+    fprintf(stderr, "  -c  CPU time charged per control loop pass besides readrx(), default %d us\n", SIM_DEFAULT_LOOP_CPU_US);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    bool afterbinding = true, verbose = false;
+    int option;
+    while ((option = getopt(argc, argv, "uvc:h")) != -1) {
+        switch (option) {
+            case 'u':
+                afterbinding = false;
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            case 'c':
+                loopcpunanoseconds = atoi(optarg) * 1000;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+
+    unsigned long count = readcapture(argv[optind]);
+    if (!count) {
+        printf("%s: no FIFO frames\n", argv[optind]);
+        return 1;
+    }
+
+    sim_a7105_init();
+    sim_a7105_replay(frames, count, afterbinding);
+    global.batteryvoltage = FIXEDPOINTCONSTANT(3.9);
+    global.started = 1;
+    global.flymode = LEVELFLIGHTMODE;
+
+    double wallstart = walltime();
+    initrx();
+    lib_timers_startperiodictick(LOOPFREQUENCY);
+
+    unsigned long calls = 0, firstopen = 0;
+    uint64_t rxnanoseconds = 0, maxrxnanoseconds = 0, replaystart = 0;
+    double rxwalltime = 0;
+    fixedpointnum minstick[4] = { FIXEDPOINTONE * 2, FIXEDPOINTONE * 2, FIXEDPOINTONE * 2, FIXEDPOINTONE * 2 };
+    fixedpointnum maxstick[4] = { -FIXEDPOINTONE * 2, -FIXEDPOINTONE * 2, -FIXEDPOINTONE * 2, -FIXEDPOINTONE * 2 };
+    static const unsigned char stickindexes[4] = { THROTTLEINDEX, YAWINDEX, PITCHINDEX, ROLLINDEX };
+
+    while (!sim_a7105_replaydone() || now < frames[count - 1].end + replaystart + TAILNANOSECONDS) {
+        if (!frames[0].sent && now > GIVEUPNANOSECONDS)
+            break;
+
+        global.timesliver = lib_timers_waitforperiodictick() * LOOPTIMESLIVER;
+
+        bool bound = rxbound();
+        unsigned long failsafetimer = global.failsafetimer;
+        uint64_t callstart = now;
+        double wallcallstart = walltime();
+        readrx();
+        rxwalltime += walltime() - wallcallstart;
+        calls++;
+        rxnanoseconds += now - callstart;
+        if (now - callstart > maxrxnanoseconds)
+            maxrxnanoseconds = now - callstart;
+        if (frames[0].sent && !replaystart)
+            replaystart = frames[0].sent + AIRNANOSECONDS - frames[0].end;
+
+        // what became of the frames since the last call
+        for (unsigned long i = firstopen; i < count && frames[i].sent; i++) {
+            simreplayframe *frame = &frames[i];
+            if (outcomes[i])
+                continue;
+            if (frame->read >= callstart) {
+                if (!bound)
+                    outcomes[i] = OUTCOME_BIND;
+                else if (global.failsafetimer != failsafetimer)
+                    outcomes[i] = OUTCOME_ACCEPTED;
+                else
+                    outcomes[i] = goodchecksum(frame) ? OUTCOME_REJECTED : OUTCOME_BADCHECKSUM;
+                if (outcomes[i] == OUTCOME_ACCEPTED && frame->payload[0] == 0x20)
+                    for (int x = 0; x < 4; x++) {
+                        fixedpointnum value = global.rxvalues[stickindexes[x]];
+                        if (value < minstick[x])
+                            minstick[x] = value;
+                        if (value > maxstick[x])
+                            maxstick[x] = value;
+                    }
+                if (verbose) {
+                    printf("%10.6f 0x%02x %-12s latency %5lu us", frame->end / 1e9, frame->payload[0],
+                           outcomenames[outcomes[i]], (unsigned long) ((frame->read - frame->received) / 1000));
+                    if (outcomes[i] == OUTCOME_ACCEPTED)
+                        printf("  throttle %6.3f yaw %6.3f pitch %6.3f roll %6.3f", FPTODOUBLE(global.rxvalues[THROTTLEINDEX]),
+                               FPTODOUBLE(global.rxvalues[YAWINDEX]), FPTODOUBLE(global.rxvalues[PITCHINDEX]),
+                               FPTODOUBLE(global.rxvalues[ROLLINDEX]));
+                    printf("\n");
+                }
+            } else if (!frame->received && now > frame->sent + AIRNANOSECONDS)
+                outcomes[i] = OUTCOME_NOTHEARD;
+            else if (frame->received && i + 1 < count && frames[i + 1].received)
+                outcomes[i] = OUTCOME_NOTREAD;
+            if (verbose && outcomes[i] >= OUTCOME_NOTREAD)
+                printf("%10.6f 0x%02x %s\n", frame->end / 1e9, frame->payload[0], outcomenames[outcomes[i]]);
+        }
+        while (firstopen < count && outcomes[firstopen])
+            firstopen++;
+    }
+    double wallseconds = walltime() - wallstart;
+
+    unsigned long totals[NUMOUTCOMES] = { 0 }, types[256] = { 0 };
+    uint64_t latency = 0, maxlatency = 0;
+    unsigned long latencies = 0;
+    for (unsigned long i = 0; i < count; i++) {
+        if (!outcomes[i])
+            outcomes[i] = !frames[i].sent ? OUTCOME_NOTSENT : frames[i].received ? OUTCOME_NOTREAD : OUTCOME_NOTHEARD;
+        totals[outcomes[i]]++;
+        types[frames[i].payload[0]]++;
+        if (frames[i].read) {
+            uint64_t waited = frames[i].read - frames[i].received;
+            latency += waited;
+            if (waited > maxlatency)
+                maxlatency = waited;
+            latencies++;
+        }
+    }
+
+    const char *name = strrchr(argv[optind], '/') ? strrchr(argv[optind], '/') + 1 : argv[optind];
+    double captureseconds = (frames[count - 1].end - frames[0].end) / 1e9;
+    printf("%s: %lu frames over %.2f s, %lu written by the handset, %lu read by it\n", name, count, captureseconds,
+           writtenframes, readframes);
+    printf("frame types:");
+    for (int type = 0; type < 256; type++)
+        if (types[type])
+            printf(" 0x%02x x%lu", type, types[type]);
+    printf("\n");
+    if (simradio.bindcompletens)
+        printf("handset model bound after %.3f s, ", simradio.bindcompletens / 1e9);
+    printf("quad %s\n", rxbound() ? "bound" : "not bound");
+    for (int outcome = OUTCOME_ACCEPTED; outcome < NUMOUTCOMES; outcome++)
+        printf("%s%lu %s", outcome == OUTCOME_ACCEPTED ? "frames: " : ", ", totals[outcome], outcomenames[outcome]);
+    printf("\n");
+    if (latencies)
+        printf("latency, in the FIFO until read out: avg %lu us, max %lu us\n",
+               (unsigned long) (latency / latencies / 1000), (unsigned long) (maxlatency / 1000));
+    if (maxstick[0] >= minstick[0])
+        printf("sticks: throttle %.3f to %.3f, yaw %.3f to %.3f, pitch %.3f to %.3f, roll %.3f to %.3f\n",
+               FPTODOUBLE(minstick[0]), FPTODOUBLE(maxstick[0]), FPTODOUBLE(minstick[1]), FPTODOUBLE(maxstick[1]),
+               FPTODOUBLE(minstick[2]), FPTODOUBLE(maxstick[2]), FPTODOUBLE(minstick[3]), FPTODOUBLE(maxstick[3]));
+    else
+        printf("sticks: no control packets accepted\n");
+    printf("readrx: %lu calls, Mini51 time (simulated) avg %lu us max %lu us\n", calls,
+           (unsigned long) (rxnanoseconds / calls / 1000), (unsigned long) (maxrxnanoseconds / 1000));
+    printf("throughput: %.1f frames/s accepted, %.1f frames/s read\n", totals[OUTCOME_ACCEPTED] / captureseconds,
+           latencies / captureseconds);
+    // the only line that changes from run to run, make replay-check leaves it out
+    printf("host: readrx %.0f ns avg, replay ran at %.0fx real time\n", rxwalltime * 1e9 / calls, now / 1e9 / wallseconds);
+    return 0;
+}
@@ -0,0 +1,181 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rxtiming.h"
+
+// Runs src/rxtiming.c against the handset's own SPI traffic, as decoded by reverse/A7105/quadcsv.py.  Each
+// capture gives the times the handset's packets go out: the end of the air time after each TX strobe, or when
+// only FIFO reads were captured, the reads (the handset reads the quad's telemetry once per cycle of its own).
+// The receiver is modelled the way rx_x4.c runs it: the radio is polled once per control loop pass, only when
+// rxtiming_expectingpacket() says so, and a packet that comes while an earlier one hasn't been picked up is lost.
+// A capture fails if a packet is lost that polling on every pass would have picked up.
+
+#define POLLMICROSECONDS    2500UL      // CONTROL_LOOP_FREQUENCY 400
+#define AIRMICROSECONDS     2060UL      // TX strobe to TRER clear in handset_start_decode.csv
+#define MAXPACKETS          8192
+
+static const char *defaultcaptures[] = {
+    "../reverse/A7105/rawdata/handset_start_decode.csv",
+    "../reverse/A7105/rawdata/handset_updown_decode.csv",
+    "../reverse/A7105/rawdata/handset_batterie_decode_0xE0.csv",
+    "../reverse/A7105/rawdata/handset_batterie_decode_0xE1.csv",
+};
+
+static unsigned long packets[MAXPACKETS];
+
+// packet times in microseconds from the start of the capture, the TX strobes if there are any
+static int readcapture(const char *filename, const char **source)
+{
+    FILE *file = fopen(filename, "r");
+    if (!file)
+        return -1;
+
+    static unsigned long reads[MAXPACKETS];
+    int transmits = 0, fiforeads = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        double seconds;
+        char kind[8], what[32];
+        if (sscanf(line, "%*s %lf %7s %31s", &seconds, kind, what) != 3)
+            continue;
+        unsigned long microseconds = (unsigned long) (seconds * 1e6 + 0.5);
+        if (!strcmp(kind, "S") && !strcmp(what, "TX") && transmits < MAXPACKETS)
+            packets[transmits++] = microseconds + AIRMICROSECONDS;
+        else if (!strcmp(kind, "R") && !strcmp(what, "FIFO") && fiforeads < MAXPACKETS)
+            reads[fiforeads++] = microseconds;
+    }
+    fclose(file);
+
+    if (transmits) {
+        *source = "TX strobes";
+        return transmits;
+    }
+    memcpy(packets, reads, fiforeads * sizeof(reads[0]));
+    *source = "FIFO reads";
+    return fiforeads;
+}
+
+static int compareintervals(const void *a, const void *b)
+{
+    unsigned long x = *(const unsigned long *) a, y = *(const unsigned long *) b;
+    return x < y ? -1 : x > y;
+}
+
+// the most common spacing of the packets, to hold the learned period against
+static unsigned long medianinterval(int count)
+{
+    static unsigned long intervals[MAXPACKETS];
+    for (int i = 1; i < count; ++i)
+        intervals[i - 1] = packets[i] - packets[i - 1];
+    qsort(intervals, count - 1, sizeof(intervals[0]), compareintervals);
+    return intervals[(count - 1) / 2];
+}
+
+// the first pass at or after a packet, the one that polling on every pass picks it up on
+static unsigned long firstpass(unsigned long packet)
+{
+    return (packet + POLLMICROSECONDS - 1) / POLLMICROSECONDS * POLLMICROSECONDS;
+}
+
+static int checkcapture(const char *filename)
+{
+    const char *source;
+    int count = readcapture(filename, &source);
+    if (count < 0) {
+        printf("%s: can't open\n", filename);
+        return 1;
+    }
+    if (count < 2) {
+        printf("%s: no packets\n", filename);
+        return 1;
+    }
+
+    rxtimingstruct timing;
+    rxtiming_init(&timing);
+
+    // the control loop's passes start on a tick of their own, not in step with the handset
+    unsigned long now = packets[0] - packets[0] % POLLMICROSECONDS;
+    unsigned long polls = 0, passes = 0, picked = 0, lost = 0, lostanyway = 0, lockedpasses = 0;
+    unsigned long latency = 0, maxlatency = 0, extralatency = 0, maxextralatency = 0;
+    int next = 0;
+    bool waiting = false;
+    unsigned long waitingsince = 0;
+
+    while (next < count || waiting) {
+        // packets that went by since the last pass
+        while (next < count && packets[next] <= now) {
+            if (waiting) {
+                // the radio already holds one, polling on every pass would have had it out by now?
+                if (packets[next] > firstpass(waitingsince))
+                    lost++;
+                else
+                    lostanyway++;
+            } else {
+                waiting = true;
+                waitingsince = packets[next];
+            }
+            next++;
+        }
+
+        passes++;
+        if (rxtiming_locked(&timing))
+            lockedpasses++;
+        if (rxtiming_expectingpacket(&timing, now)) {
+            polls++;
+            if (waiting) {
+                rxtiming_packet(&timing, now);
+                unsigned long seen = now - waitingsince;
+                unsigned long extra = now - firstpass(waitingsince);
+                latency += seen;
+                if (seen > maxlatency)
+                    maxlatency = seen;
+                extralatency += extra;
+                if (extra > maxextralatency)
+                    maxextralatency = extra;
+                picked++;
+                waiting = false;
+            }
+        }
+        now += POLLMICROSECONDS;
+    }
+
+    const char *name = strrchr(filename, '/') ? strrchr(filename, '/') + 1 : filename;
+    printf("%s: %d packets from %s, median spacing %lu us\n", name, count, source, medianinterval(count));
+    printf("  learned period %.1f us, %s at the end, locked for %.0f%% of the passes\n",
+           (double) timing.period / (1 << RXTIMINGPERIODSHIFT), rxtiming_locked(&timing) ? "locked" : "not locked",
+           100.0 * lockedpasses / passes);
+    printf("  %lu picked up, %lu lost to skipped polls, %lu that polling on every pass would lose too\n", picked, lost,
+           lostanyway);
+    printf("  polled on %lu of %lu passes (%.0f%%), latency avg %lu us max %lu us, %lu us avg %lu us max more than polling every pass\n",
+           polls, passes, 100.0 * polls / passes, latency / picked, maxlatency, extralatency / picked, maxextralatency);
+    return lost ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    int failures = 0;
+    if (argc > 1)
+        for (int i = 1; i < argc; ++i)
+            failures += checkcapture(argv[i]);
+    else
+        for (unsigned i = 0; i < sizeof(defaultcaptures) / sizeof(defaultcaptures[0]); ++i)
+            failures += checkcapture(defaultcaptures[i]);
+    return failures ? 1 : 0;
+}
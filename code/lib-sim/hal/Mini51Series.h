@@ -0,0 +1,127 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Host stand-in for the Nuvoton device header.  Found ahead of lib-Mini51/hal on the include path, so the
+// Mini51 hal.h and the other lib-Mini51 headers are used as they are.  Only the register blocks and
+// CMSIS helpers that code in src/ touches directly are provided.
+
+#include <stdint.h>
+
+typedef struct {
+    volatile uint32_t P0_MFP;
+    volatile uint32_t P1_MFP;
+    volatile uint32_t P2_MFP;
+    volatile uint32_t P3_MFP;
+    volatile uint32_t P4_MFP;
+    volatile uint32_t P5_MFP;
+} SYS_T;
+
+extern SYS_T sim_sys;
+#define SYS (&sim_sys)
+
+extern uint32_t SystemCoreClock;
+extern uint32_t CyclesPerUs;
+
+void CLK_SysTickDelay(uint32_t us);
+
+// GPIO, laid out as on the Mini51 (ports 0x40 apart, one data register per pin) so that the lib-Mini51 pin
+// code can run against memory.  Only lib-sim/bench uses it, the simulator has its own lib_digitalio.c.
+typedef struct {
+    volatile uint32_t PMD;
+    volatile uint32_t OFFD;
+    volatile uint32_t DOUT;
+    volatile uint32_t DMASK;
+    volatile uint32_t PIN;
+    volatile uint32_t DBEN;
+    volatile uint32_t IMD;
+    volatile uint32_t IEN;
+    volatile uint32_t ISRC;
+    uint32_t reserved[7];
+} GPIO_T;
+
+extern GPIO_T sim_gpioports[6];
+extern volatile uint32_t sim_gpiopins[6 * 8];
+
+#define P0_BASE                     ((uintptr_t) sim_gpioports)
+#define GPIOBIT0_BASE               ((uintptr_t) sim_gpiopins)
+#define GPIO_PIN_ADDR(port, pin)    (*((volatile uint32_t *)((GPIOBIT0_BASE+(0x20*(port))) + ((pin)<<2))))
+#define GPIO_PIN_MAX                8
+#define GPIO_PMD_INPUT              0x0UL
+#define GPIO_PMD_OUTPUT             0x1UL
+
+static inline void GPIO_SetMode(GPIO_T * PORT, uint32_t pin_mask, uint32_t mode)
+{
+    for (uint32_t i = 0; i < GPIO_PIN_MAX; i++)
+        if (pin_mask & (1 << i))
+            PORT->PMD = (PORT->PMD & ~(0x3 << (i << 1))) | (mode << (i << 1));
+}
+
+// UART and the clock bits that lib-Mini51/hal/drv_serial.c sets up, so that the lib-Mini51 serial code can run
+// against memory in lib-sim/bench/msp_bench.c.  The bench calls UART_IRQHandler() itself to empty the TX buffer.
+typedef struct {
+    union {
+        volatile uint32_t RBR;
+        volatile uint32_t THR;
+    };
+    volatile uint32_t IER;
+    volatile uint32_t FCR;
+    volatile uint32_t LCR;
+    volatile uint32_t MCR;
+    volatile uint32_t MSR;
+    volatile uint32_t FSR;
+    volatile uint32_t ISR;
+} UART_T;
+
+typedef struct {
+    volatile uint32_t CLKSEL1;
+    volatile uint32_t CLKDIV;
+} CLK_T;
+
+extern UART_T sim_uart;
+extern CLK_T sim_clk;
+#define UART                        (&sim_uart)
+#define CLK                         (&sim_clk)
+
+#define UART_IER_RDA_IEN_Msk        (1ul << 0)
+#define UART_IER_THRE_IEN_Msk       (1ul << 1)
+#define UART_IER_BUF_ERR_IEN_Msk    (1ul << 5)
+#define UART_FCR_RFR_Msk            (1ul << 1)
+#define UART_FCR_TFR_Msk            (1ul << 2)
+#define UART_FSR_RX_OVER_IF_Msk     (1ul << 0)
+#define UART_FSR_PEF_Msk            (1ul << 4)
+#define UART_FSR_FEF_Msk            (1ul << 5)
+#define UART_FSR_BIF_Msk            (1ul << 6)
+#define UART_ISR_RDA_IF_Msk         (1ul << 0)
+#define UART_ISR_RDA_INT_Msk        (1ul << 8)
+#define UART_ISR_THRE_INT_Msk       (1ul << 9)
+#define UART_ISR_BUF_ERR_INT_Msk    (1ul << 13)
+#define UART_WRITE(uart, u8Data)    ((uart)->THR = (u8Data))
+#define UART_READ(uart)             ((uart)->RBR)
+
+#define SYS_MFP_P12_RXD             0x00000400UL
+#define SYS_MFP_P12_Msk             0x00000404UL
+#define SYS_MFP_P13_TXD             0x00000800UL
+#define SYS_MFP_P13_Msk             0x00000808UL
+#define CLK_CLKSEL1_UART_S_Msk      (3ul << 24)
+#define CLK_CLKSEL1_UART_S_IRC22M   0x02000000UL
+#define CLK_CLKDIV_UART_N_Msk       (0xFul << 8)
+#define CLK_CLKDIV_UART(x)          (((x)-1) << 8)
+#define UART_MODULE                 0
+
+void CLK_EnableModuleClock(uint32_t u32ModuleIdx);
+void UART_Open(UART_T * uart, uint32_t u32baudrate);
+void UART_EnableInt(UART_T * uart, uint32_t u32InterruptFlag);
@@ -0,0 +1,114 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "drv_pwm.h"
+#include "lib_timers.h"
+#include "lib_i2c.h"
+#include "sim.h"
+
+#include "config.h"
+#include "defs.h"
+
+// Host version of lib-Mini51/hal/drv_hal.c.  The data flash page used as EEPROM is kept in RAM,
+// erased at startup, so every run starts from the default user settings.  So are the blackbox pages,
+// which are charged the time the flash takes to erase and program them.
+
+#define FLASH_PAGE_SIZE                 ((uint16_t)0x200)
+#define EEP_SIZE                        (FLASH_PAGE_SIZE)
+
+static uint8_t dataflash[EEP_SIZE];
+
+#if (BLACKBOX==YES)
+#define BLACKBOX_SIZE                   (BLACKBOX_PAGES * FLASH_PAGE_SIZE)
+
+static uint8_t blackboxflash[BLACKBOX_SIZE];
+static uint32_t blackboxprogrammed;     // the end of the last word programmed
+#endif
+
+void lib_hal_init(void)
+{
+    memset(dataflash, 0xFF, sizeof(dataflash));
+#if (BLACKBOX==YES)
+    memset(blackboxflash, 0xFF, sizeof(blackboxflash));
+#endif
+
+    lib_timers_init();
+
+    // Init PWM clock and hardware
+    drv_pwm_config_t pwm;
+    pwmInit(&pwm);
+    lib_i2c_init();
+}
+
+size_t eeprom_write_block(const void *src, uint16_t index, size_t size)
+{
+    if (index + size > EEP_SIZE)
+        return 0;
+    memcpy(&dataflash[index], src, size);
+    return size;
+}
+
+void eeprom_commit(void)
+{
+}
+
+size_t eeprom_read_block(void *dst, uint16_t index, size_t size)
+{
+    if (index + size > EEP_SIZE)
+        return 0;
+    memcpy(dst, &dataflash[index], size);
+    return size;
+}
+
+#if (BLACKBOX==YES)
+void blackbox_erase_page(uint8_t page)
+{
+    sim_advance(SIM_NS_FLASH_PAGE_ERASE);
+    if (page < BLACKBOX_PAGES)
+        memset(&blackboxflash[page * FLASH_PAGE_SIZE], 0xFF, FLASH_PAGE_SIZE);
+}
+
+void blackbox_write_word(uint32_t index, uint32_t data)
+{
+    // programming can only clear bits
+    sim_advance(SIM_NS_FLASH_WORD);
+    if (index + 4 > BLACKBOX_SIZE)
+        return;
+    for (int i = 0; i < 4; ++i)
+        blackboxflash[index + i] &= ((uint8_t *) &data)[i];
+    if (index + 4 > blackboxprogrammed)
+        blackboxprogrammed = index + 4;
+}
+
+size_t blackbox_read_block(void *dst, uint32_t index, size_t size)
+{
+    if (index + size > BLACKBOX_SIZE)
+        return 0;
+    memcpy(dst, &blackboxflash[index], size);
+    return size;
+}
+
+uint32_t sim_blackbox(const uint8_t **flash)
+{
+    *flash = blackboxflash;
+    return blackboxprogrammed;
+}
+#else
+uint32_t sim_blackbox(const uint8_t **flash)
+{
+    return 0;
+}
+#endif
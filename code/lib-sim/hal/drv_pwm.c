@@ -0,0 +1,43 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "drv_pwm.h"
+#include "config.h"
+#include "sim.h"
+
+// Motor outputs go straight to the rigid body model.  Same 1000..2000 range as lib-Mini51/hal/drv_pwm.c.
+
+bool pwmInit(drv_pwm_config_t *init)
+{
+    for (int i = 0; i < 4; ++i)
+        sim_quad_setmotor(i, 0);
+    return false;
+}
+
+void pwmWriteMotor(uint8_t index, uint16_t value)
+{
+    sim_advance(SIM_NS_PWM_WRITE);
+    sim_quad_setmotor(index, (value - 1000) / 1000.0);
+}
+
+void pwmWriteServo(uint8_t index, uint16_t value)
+{
+}
+
+uint16_t pwmRead(uint8_t channel)
+{
+    return 0;
+}
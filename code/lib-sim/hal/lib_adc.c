@@ -0,0 +1,71 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "lib_fp.h"
+#include "lib_adc.h"
+#include "config.h"
+#include "sim.h"
+
+// 10 bit ADC with a conversion time of about 137us, as set up in lib-Mini51/hal/lib_adc.c.
+// Voltages on the pins come from sim_adc_inputvoltage().
+
+// ADC reference voltage defined in config_*.h as fixedpointnum
+#define FP_ADC_REF_VOLTAGE FIXEDPOINTCONSTANT(ADC_REF_VOLTAGE)
+
+static lib_adc_channel_t selectedchannel;
+static uint64_t conversionend;
+static uint32_t conversiondata;
+
+void lib_adc_init(void)
+{
+}
+
+void lib_adc_select_channel(lib_adc_channel_t channel)
+{
+    // changing channel stops a conversion in progress
+    selectedchannel = channel;
+    conversionend = 0;
+}
+
+bool lib_adc_is_busy(void)
+{
+    sim_advance(SIM_NS_ADC_POLL);
+    return sim_nanoseconds() < conversionend;
+}
+
+void lib_adc_startconv(void)
+{
+    double value = sim_adc_inputvoltage(selectedchannel) / ADC_REF_VOLTAGE * 1024;
+    if (value < 0)
+        value = 0;
+    if (value > 1023)
+        value = 1023;
+    conversiondata = (uint32_t) value;
+    conversionend = sim_nanoseconds() + SIM_NS_ADC_CONVERSION;
+}
+
+// Returns measured absolute voltage as fixedpointnum
+fixedpointnum lib_adc_read_volt(void)
+{
+    fixedpointnum voltage = (fixedpointnum) conversiondata << (FIXEDPOINTSHIFT - 10);
+    return lib_fp_multiply(voltage, FP_ADC_REF_VOLTAGE);
+}
+
+// Returns ADC result as fixedpointnum between 0..1
+fixedpointnum lib_adc_read_raw(void)
+{
+    return (fixedpointnum) conversiondata << (FIXEDPOINTSHIFT - 10);
+}
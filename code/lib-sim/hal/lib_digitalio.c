@@ -0,0 +1,57 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "lib_digitalio.h"
+#include "sim.h"
+
+// Pin state is only remembered, so the sim can report LEDs.  Inputs read back as low.  Pin handles point
+// into the same array, like the Mini51 pin data registers, and cost no simulated time.
+
+static volatile uint32_t outputs[0x60];
+
+SYS_T sim_sys;
+
+void lib_digitalio_initpin(unsigned char portandpinnumber, unsigned char output)
+{
+    sim_advance(SIM_NS_GPIO);
+}
+
+unsigned char lib_digitalio_getinput(unsigned char portandpinnumber)
+{
+    sim_advance(SIM_NS_GPIO);
+    return 0;
+}
+
+void lib_digitalio_setoutput(unsigned char portandpinnumber, unsigned char value)
+{
+    sim_advance(SIM_NS_GPIO);
+    if (portandpinnumber < sizeof(outputs) / sizeof(outputs[0]))
+        outputs[portandpinnumber] = value ? 1 : 0;
+}
+
+digitalpin lib_digitalio_getpin(unsigned char portandpinnumber)
+{
+    return &outputs[portandpinnumber < sizeof(outputs) / sizeof(outputs[0]) ? portandpinnumber : 0];
+}
+
+void lib_digitalio_setinterruptcallback(unsigned char pinnumber, digitalcallbackfunctptr callback)
+{
+}
+
+uint8_t sim_digitalio_getoutput(uint8_t portandpinnumber)
+{
+    return portandpinnumber < sizeof(outputs) / sizeof(outputs[0]) ? outputs[portandpinnumber] : 0;
+}
@@ -0,0 +1,126 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "lib_i2c.h"
+#include "sim.h"
+
+// Transaction level I2C master.  The bus is replayed against the sensor models in sim_sensors.c
+// and each byte and bus condition is charged at the clock rate lib-Mini51/hal/lib_i2c.c sets up.
+
+// referenced from app/serial.c
+unsigned int lib_i2c_error_count = 0;
+
+static uint8_t currentaddress;  // 7 bit address of the device being talked to
+static bool reading;
+static bool registerset;        // the first byte written after a start selects the register
+static uint8_t currentregister;
+
+void lib_i2c_init(void)
+{
+}
+
+void lib_i2c_setclockspeed(unsigned char speed)
+{
+}
+
+unsigned char lib_i2c_write(unsigned char data)
+{
+    sim_advance(SIM_NS_I2C_BYTE);
+    if (!registerset) {
+        currentregister = data;
+        registerset = true;
+        return 0;
+    }
+    if (!sim_i2c_write(currentaddress, currentregister++, data)) {
+        lib_i2c_error_count++;
+        return 1;
+    }
+    return 0;
+}
+
+unsigned char lib_i2c_start(unsigned char address)
+{
+    sim_advance(SIM_NS_I2C_CONDITION + SIM_NS_I2C_BYTE);
+    currentaddress = address >> 1;
+    reading = (address & I2C_READ) != 0;
+    registerset = reading;
+    return 0;
+}
+
+char lib_i2c_start_wait(unsigned char address)
+{
+    return lib_i2c_start(address);
+}
+
+unsigned char lib_i2c_rep_start(unsigned char address)
+{
+    return lib_i2c_start(address);
+}
+
+void lib_i2c_stop(void)
+{
+    sim_advance(SIM_NS_I2C_CONDITION);
+}
+
+static unsigned char readbyte(void)
+{
+    uint8_t data = 0xFF;
+    sim_advance(SIM_NS_I2C_BYTE);
+    if (!reading || !sim_i2c_read(currentaddress, currentregister, &data, 1))
+        lib_i2c_error_count++;
+    currentregister = sim_i2c_nextregister(currentaddress, currentregister);
+    return data;
+}
+
+unsigned char lib_i2c_readack(void)
+{
+    return readbyte();
+}
+
+unsigned char lib_i2c_readnak(void)
+{
+    return readbyte();
+}
+
+void lib_i2c_writereg(unsigned char address, unsigned char reg, unsigned char value)
+{
+    lib_i2c_start((address << 1) + I2C_WRITE);
+    lib_i2c_write(reg);
+    lib_i2c_write(value);
+    lib_i2c_stop();
+}
+
+unsigned char lib_i2c_readreg(unsigned char address, unsigned char reg)
+{
+    lib_i2c_start((address << 1) + I2C_WRITE);
+    lib_i2c_write(reg);
+    lib_i2c_rep_start((address << 1) + I2C_READ);
+    unsigned char returnvalue = lib_i2c_readnak();
+    lib_i2c_stop();
+    return (returnvalue);
+}
+
+void lib_i2c_readdata(unsigned char address, unsigned char reg, unsigned char *data, unsigned char length)
+{
+    lib_i2c_start((address << 1) + I2C_WRITE);
+    lib_i2c_write(reg);
+    lib_i2c_rep_start((address << 1) + I2C_READ);
+    while (--length) {
+        *data++ = lib_i2c_readack();
+    }
+    *data = lib_i2c_readnak();
+    lib_i2c_stop();
+}
@@ -0,0 +1,43 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "lib_soft_3_wire_spi.h"
+#include "sim.h"
+
+// Byte level replacement for the bit banged 3-wire SPI.  Chip select low selects the A7105 model.
+
+void lib_soft_3_wire_spi_setCS(uint8_t state)
+{
+    sim_advance(SIM_NS_SPI_CS);
+    sim_a7105_select(state == DIGITALOFF);
+}
+
+void lib_soft_3_wire_spi_init(uint8_t SDIO_portandpinnumber, uint8_t SCK_portandpinnumber, uint8_t SCS_portandpinnumber)
+{
+    lib_soft_3_wire_spi_setCS(DIGITALON);
+}
+
+void lib_soft_3_wire_spi_write(uint8_t data)
+{
+    sim_advance(SIM_NS_SPI_BYTE);
+    sim_a7105_write(data);
+}
+
+uint8_t lib_soft_3_wire_spi_read(void)
+{
+    sim_advance(SIM_NS_SPI_BYTE);
+    return sim_a7105_read();
+}
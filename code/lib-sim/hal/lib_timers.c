@@ -0,0 +1,125 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hal.h"
+#include "lib_timers.h"
+#include "sim.h"
+
+// Same interface as lib-Mini51/hal/lib_timers.c, but the time base is the simulated clock.  Every read
+// of the clock costs the time the real timer read takes, so busy waits make progress.
+
+extern unsigned long timeslivertimer;
+
+uint32_t SystemCoreClock = 22118400;
+uint32_t CyclesPerUs = 22;
+
+// control loop tick
+static uint64_t periodicticknanoseconds;
+static uint64_t nextperiodictick;
+static uint64_t lastperiodicwait;
+
+void lib_timers_init(void)
+{
+}
+
+uint32_t lib_timers_getcurrentmicroseconds(void)
+{
+    // returns microseconds since startup.  This mainly used internally because it wraps around.
+    sim_advance(SIM_NS_TIMER_READ);
+    return (uint32_t) (sim_nanoseconds() / 1000);
+}
+
+unsigned long lib_timers_gettimermicroseconds(unsigned long starttime)
+{
+    // returns microseconds since this timer was started
+    uint32_t currenttime = lib_timers_getcurrentmicroseconds();
+    if ((uint32_t) starttime > currenttime)     // we have wrapped around
+    {
+        return (0xFFFFFFFF - (uint32_t) starttime + currenttime);
+    } else {
+        return (currenttime - (uint32_t) starttime);
+    }
+}
+
+unsigned long lib_timers_gettimermicrosecondsandreset(unsigned long *starttime)
+{
+    // returns microseconds since this timer was started and then reset the start time
+    // this allows us to keep checking the time without losing any time
+
+    // calculatetimesliver() resets its timer once per pass through the main loop.  Charge the loop's
+    // arithmetic here, so that it shows up in this pass and in the profiler's timesliver stage.
+    bool timesliver = starttime == &timeslivertimer;
+    if (timesliver)
+        sim_chargeloop();
+
+    uint32_t currenttime = lib_timers_getcurrentmicroseconds();
+    uint32_t returnvalue;
+
+    if ((uint32_t) *starttime > currenttime)    // we have wrapped around
+    {
+        returnvalue = (0xFFFFFFFF - (uint32_t) *starttime + currenttime);
+    } else {
+        returnvalue = (currenttime - (uint32_t) *starttime);
+    }
+    *starttime = currenttime;
+
+    if (timesliver)
+        sim_recordloop(returnvalue);
+    return (returnvalue);
+}
+
+unsigned long lib_timers_starttimer()
+{                               // start a timer
+    return (lib_timers_getcurrentmicroseconds());
+}
+
+void lib_timers_delaymilliseconds(unsigned long delaymilliseconds)
+{
+    unsigned long timercounts = lib_timers_starttimer();
+    while (lib_timers_gettimermicroseconds(timercounts) < delaymilliseconds * 1000L) {
+    }
+}
+
+void lib_timers_startperiodictick(unsigned long frequency)
+{
+    periodicticknanoseconds = 1000000000ULL / frequency;
+    nextperiodictick = sim_nanoseconds() + periodicticknanoseconds;
+    lastperiodicwait = sim_nanoseconds();
+}
+
+unsigned char lib_timers_waitforperiodictick(void)
+{
+    // charge the loop's arithmetic first, a pass that takes longer than a tick misses the next one
+    sim_chargeloop();
+
+    // sleep until the next tick, then count the ticks that have gone by
+    uint64_t now = sim_nanoseconds();
+    if (now < nextperiodictick)
+        sim_advance(nextperiodictick - now);
+    unsigned long ticks = 0;
+    while (nextperiodictick <= sim_nanoseconds()) {
+        nextperiodictick += periodicticknanoseconds;
+        ++ticks;
+    }
+
+    sim_recordloop((sim_nanoseconds() - lastperiodicwait) / 1000);
+    lastperiodicwait = sim_nanoseconds();
+    return (ticks > 255 ? 255 : ticks);
+}
+
+void CLK_SysTickDelay(uint32_t us)
+{
+    sim_advance(us * 1000);
+}
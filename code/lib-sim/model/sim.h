@@ -0,0 +1,126 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Software-in-the-loop model of a Hubsan H107D.
+// The firmware sources are compiled unmodified for the host and linked against the HAL in lib-sim/hal.
+// Instead of a wall clock, the HAL charges simulated time for every bus transfer and register poll,
+// and the rigid body, sensor and radio models are stepped forward as that time passes.
+// This lets the sim run as fast as the host can go while the firmware still sees realistic timing.
+
+// Cost of each HAL operation on the real board, in nanoseconds of simulated time.
+// Bus costs come from the clock rates set up in lib-Mini51/hal, the rest are rough cycle counts at 22.1184 MHz.
+#define SIM_NS_I2C_BYTE         60000   // 9 bit clocks at ~151 kHz (lib_i2c.c)
+#define SIM_NS_I2C_CONDITION    10000   // start, repeated start or stop
+#define SIM_NS_SPI_BYTE         7000    // bit banged on cached pin addresses, about 155 cycles per byte
+#define SIM_NS_SPI_CS           1000
+#define SIM_NS_TIMER_READ       1000    // TIMER1 counter read and a multiply
+#define SIM_NS_GPIO             1000
+#define SIM_NS_PWM_WRITE        500
+#define SIM_NS_ADC_POLL         500
+#define SIM_NS_ADC_CONVERSION   137000  // see lib_adc_init()
+#define SIM_NS_FLASH_WORD       20000   // FMC word program, from the Mini51 datasheet
+#define SIM_NS_FLASH_PAGE_ERASE 20000000        // FMC page erase
+
+// Arithmetic isn't modelled instruction by instruction.  Instead a fixed amount of CPU time is charged
+// each time calculatetimesliver() resets its timer or waits for the control loop tick, once per pass through the main loop.
+#define SIM_DEFAULT_LOOP_CPU_US 400
+
+// firmware entry point, bradwii.c is compiled with -Dmain=bradwii_main
+int bradwii_main(void);
+
+// simulated time
+uint64_t sim_nanoseconds(void);
+void sim_advance(uint32_t nanoseconds);
+void sim_chargeloop(void);
+void sim_recordloop(unsigned long microseconds);
+
+// rigid body and motors (sim_quad.c)
+typedef struct {
+    double downvector[3];       // world down, in firmware body axes (X=roll side, Y=pitch side, Z=down)
+    double westvector[3];       // world west, in firmware body axes
+    double rate[3];             // body rates around the firmware roll, pitch and yaw axes in rad/s
+    double velocity[3];         // world velocity: north, west, down in m/s
+    double position[3];         // world position: north, west, down in m
+    double motor[4];            // motor outputs after spin up lag, 0 to 1
+    double motorcommand[4];     // motor commands from the PWM outputs, 0 to 1
+    double specificforce[3];    // what an ideal accelerometer sees, in g's, firmware body axes
+    double batteryvoltage;
+    bool airborne;
+} simquadstate;
+
+extern simquadstate simquad;
+
+void sim_quad_init(void);
+void sim_quad_step(double dt);
+void sim_quad_setmotor(int motor, double value);
+void sim_quad_eulerangles(double *euler);
+double sim_quad_hoverthrottle(void);
+
+// MPU6050 and MC3210 register models (sim_sensors.c)
+void sim_sensors_init(uint32_t seed);
+void sim_sensors_step(double dt);
+bool sim_i2c_write(uint8_t address, uint8_t reg, uint8_t value);
+bool sim_i2c_read(uint8_t address, uint8_t reg, uint8_t *data, int length);
+uint8_t sim_i2c_nextregister(uint8_t address, uint8_t reg);
+
+// A7105 transceiver and Hubsan handset (sim_a7105.c)
+typedef struct {
+    uint8_t throttle;           // raw stick bytes as the handset puts them in a 0x20 packet
+    uint8_t yaw;
+    uint8_t pitch;
+    uint8_t roll;
+    uint8_t flags;
+} simsticks;
+
+typedef struct {
+    unsigned long packetssent;
+    unsigned long packetsreceived;      // by the quad
+    unsigned long packetsmissed;        // quad wasn't listening on the right channel
+    unsigned long telemetryreceived;    // by the handset
+    unsigned long spibytes;             // between the quad and its A7105, from the moment the sim starts
+    unsigned long spiframes;            // chip selects
+    uint64_t bindcompletens;
+} simradiostats;
+
+extern simsticks simhandsetsticks;
+extern simradiostats simradio;
+
+// A captured frame, replayed in place of the handset model's own packets (lib-sim/bench/rx_replay.c).  The frame goes
+// out on whatever channel and id the quad is listening on.
+typedef struct {
+    uint64_t end;               // when the last bit is on the air, in the capture's time
+    uint8_t payload[16];
+    uint64_t sent;              // sim time it went on the air, 0 until then
+    uint64_t received;          // sim time it landed in the quad's FIFO, 0 if the quad wasn't listening
+    uint64_t read;              // sim time the quad had read all of it out of the FIFO, 0 if it never did
+} simreplayframe;
+
+void sim_a7105_init(void);
+void sim_a7105_replay(simreplayframe * frames, unsigned long count, bool afterbinding);
+bool sim_a7105_replaydone(void);
+void sim_a7105_update(uint64_t now);
+void sim_a7105_select(bool selected);
+void sim_a7105_write(uint8_t data);
+uint8_t sim_a7105_read(void);
+
+// other peripherals
+uint8_t sim_digitalio_getoutput(uint8_t portandpinnumber);
+double sim_adc_inputvoltage(uint8_t channel);
+uint32_t sim_blackbox(const uint8_t **flash);   // the blackbox pages and how much is programmed, 0 without BLACKBOX
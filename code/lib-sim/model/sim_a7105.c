@@ -0,0 +1,421 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "sim.h"
+
+// Model of the A7105 as seen over its 3-wire SPI bus, plus a Hubsan handset on the other end of the link.
+// Only what rx_x4.c relies on is modelled: the register file, ID, FIFO pointers, strobes, the TRER
+// bit in the MODE register, the RSSI of the last packet and the 2 ms air time of a 16 byte packet at the
+// configured data rate.
+// Timing of the handset follows the captures in reverse/A7105/rawdata.
+
+#define A7105_MODE              0x00
+#define A7105_FIFO_DATA         0x05
+#define A7105_ID_DATA           0x06
+#define A7105_FIFOI             0x03
+#define A7105_PLL_I             0x0F
+#define A7105_RSSI              0x1D
+#define A7105_NUMREGISTERS      0x33
+
+#define AIRTIME_NS              2060000ULL      // TX strobe to TRER clear in handset_start_decode.csv
+#define PREAMBLE_NS             200000ULL       // receiver has to be listening before this much of a packet has gone by
+#define HANDSET_STARTUP_NS      300000000ULL    // handset is switched on 0.3 s after the quad
+#define HANDSET_BIND_PERIOD_NS  14000000ULL     // bind packet spacing in handset_start_decode.csv
+#define HANDSET_PERIOD_NS       10000000ULL     // control packet spacing
+#define HANDSET_REPLY_NS        400000ULL       // turnaround before answering a bind packet
+#define HANDSET_BIND_DONE_NS    30000000ULL     // quiet time after the last 0x0A before control packets start
+
+#define HANDSET_CHANNEL         0x28
+#define HANDSET_DEFAULT_ID      0x55201041UL
+#define HANDSET_SESSION_ID      0xD00C99D8UL    // from handset_start_decode.csv
+#define HANDSET_VTX_FREQUENCY   5705
+#define HANDSET_RSSI            0x50            // a handset a few meters away
+
+enum { RADIO_STANDBY, RADIO_RX, RADIO_TX };
+enum { HANDSET_BIND, HANDSET_BIND_SESSION, HANDSET_FLYING };
+enum { SPI_COMMAND, SPI_DATA };
+
+typedef struct {
+    bool active;
+    uint64_t start;
+    uint64_t end;
+    uint8_t channel;
+    uint32_t id;
+    uint8_t payload[16];
+} transmission;
+
+simsticks simhandsetsticks = { 0x00, 0x80, 0x80, 0x80, 0x0E };
+simradiostats simradio;
+
+// transceiver on the quad
+static uint8_t registers[A7105_NUMREGISTERS];
+static uint8_t fifo[64];
+static uint8_t writepointer;
+static uint8_t readpointer;
+static uint8_t idbytes[4];
+static uint8_t idindex;
+static int radiomode;
+static uint64_t rxstart;
+static transmission quadtx;
+
+// SPI framing
+static bool selected;
+static int spistate;
+static uint8_t spiaddress;
+static bool spiread;
+
+// handset
+static int handsetstate;
+static uint32_t handsetid;
+static transmission handsettx;
+static uint64_t handsetnextperiodic;
+static bool handsetreplypending;
+static uint64_t handsetreplytime;
+static uint8_t handsetreply[16];
+
+// replayed capture
+static simreplayframe *replayframes;
+static unsigned long replaycount;
+static unsigned long replaynext;
+static bool replayafterbinding;
+static uint64_t replayoffset;
+static simreplayframe *replaysending;
+static simreplayframe *replayinfifo;
+
+static uint32_t quadid(void)
+{
+    return ((uint32_t) idbytes[0] << 24) | ((uint32_t) idbytes[1] << 16) | ((uint32_t) idbytes[2] << 8) | idbytes[3];
+}
+
+static uint8_t fifolength(void)
+{
+    return (registers[A7105_FIFOI] & 0x3F) + 1;
+}
+
+static void updatecrc(uint8_t *packet)
+{
+    int sum = 0;
+    for (int i = 0; i < 15; i++)
+        sum += packet[i];
+    packet[15] = (256 - (sum % 256)) & 0xff;
+}
+
+static void buildhandsetpacket(uint8_t *packet, uint8_t type)
+{
+    memset(packet, 0, 16);
+    packet[0] = type;
+    if (type == 0x20) {
+        packet[2] = simhandsetsticks.throttle;
+        packet[4] = simhandsetsticks.yaw;
+        packet[6] = simhandsetsticks.pitch;
+        packet[8] = simhandsetsticks.roll;
+        packet[9] = simhandsetsticks.flags;
+    } else {
+        packet[1] = HANDSET_CHANNEL;
+        packet[2] = (uint8_t) (HANDSET_SESSION_ID >> 24);
+        packet[3] = (uint8_t) (HANDSET_SESSION_ID >> 16);
+        packet[4] = (uint8_t) (HANDSET_SESSION_ID >> 8);
+        packet[5] = (uint8_t) HANDSET_SESSION_ID;
+        packet[7] = (uint8_t) HANDSET_VTX_FREQUENCY;
+        packet[8] = (uint8_t) (HANDSET_VTX_FREQUENCY >> 8);
+    }
+    // TX id, the same bytes bind() copies into txid[]
+    packet[11] = 0x41;
+    packet[12] = 0x10;
+    packet[13] = 0x20;
+    packet[14] = 0x55;
+    updatecrc(packet);
+}
+
+static void handsetreceive(const transmission * tx)
+{
+    if (handsettx.active || tx->channel != HANDSET_CHANNEL || tx->id != handsetid)
+        return;
+
+    uint8_t type = tx->payload[0];
+    if (type == 0xE0 || type == 0xE1) {
+        simradio.telemetryreceived++;
+        return;
+    }
+
+    uint8_t reply = 0;
+    if (type == 0x02)
+        reply = handsetstate == HANDSET_BIND ? 0x03 : 0x09;
+    else if (type == 0x04) {
+        // the quad switches to the session id right after sending this, and so do we
+        handsetid = HANDSET_SESSION_ID;
+        handsetstate = HANDSET_BIND_SESSION;
+    } else if (type == 0x0A) {
+        // keep answering until the quad stops asking, then start sending sticks
+        reply = 0x0A;
+        if (handsetstate != HANDSET_FLYING) {
+            handsetstate = HANDSET_FLYING;
+            simradio.bindcompletens = tx->end;
+        }
+        handsetnextperiodic = tx->end + HANDSET_BIND_DONE_NS;
+    }
+
+    if (reply) {
+        buildhandsetpacket(handsetreply, reply);
+        handsetreplypending = true;
+        handsetreplytime = tx->end + HANDSET_REPLY_NS;
+    }
+}
+
+static void quadreceive(const transmission * tx)
+{
+    bool flying = handsetstate == HANDSET_FLYING;
+
+    simreplayframe *replayed = replaysending;
+    replaysending = NULL;
+
+    if (radiomode == RADIO_RX && rxstart <= tx->start + PREAMBLE_NS && registers[A7105_PLL_I] == tx->channel && quadid() == tx->id) {
+        memcpy(fifo, tx->payload, 16);
+        replayinfifo = replayed;
+        if (replayed)
+            replayed->received = tx->end;
+        registers[A7105_RSSI] = HANDSET_RSSI;
+        radiomode = RADIO_STANDBY;
+        if (flying)
+            simradio.packetsreceived++;
+    } else if (flying)
+        simradio.packetsmissed++;
+}
+
+// The next captured frame, at its time in the capture.  Frames go out at their own times, not at the time of the
+// update, so one can be on the air and over between two updates.
+static bool replaytransmit(uint64_t now)
+{
+    if (replaynext == replaycount)
+        return false;
+    if (!replaynext) {
+        // the first frame goes out when the handset model would have sent its first packet
+        if (now < handsetnextperiodic)
+            return false;
+        replayoffset = handsetnextperiodic + AIRTIME_NS - replayframes[0].end;
+    }
+    simreplayframe *frame = &replayframes[replaynext];
+    uint64_t start = frame->end + replayoffset - AIRTIME_NS;
+    if (now < start)
+        return false;
+    // one frame at a time, a frame that overlaps the last one goes out after it
+    if (start < handsettx.end)
+        start = handsettx.end;
+
+    memcpy(handsettx.payload, frame->payload, 16);
+    handsettx.active = true;
+    handsettx.start = start;
+    handsettx.end = start + AIRTIME_NS;
+    handsettx.channel = registers[A7105_PLL_I];
+    handsettx.id = quadid();
+    replaysending = frame;
+    frame->sent = start;
+    replaynext++;
+    if (handsetstate == HANDSET_FLYING)
+        simradio.packetssent++;
+    return true;
+}
+
+static void handsettransmit(uint64_t now)
+{
+    // after binding, the capture takes over once the quad has stopped asking for 0x0A
+    if (replayframes && (!replayafterbinding || replaynext
+                         || (handsetstate == HANDSET_FLYING && !handsetreplypending && now >= handsetnextperiodic))) {
+        replaytransmit(now);
+        return;
+    }
+
+    if (handsetreplypending && now >= handsetreplytime) {
+        memcpy(handsettx.payload, handsetreply, 16);
+        handsetreplypending = false;
+    } else if (now >= handsetnextperiodic) {
+        if (handsetstate == HANDSET_FLYING) {
+            buildhandsetpacket(handsettx.payload, 0x20);
+            handsetnextperiodic += HANDSET_PERIOD_NS;
+            simradio.packetssent++;
+        } else {
+            buildhandsetpacket(handsettx.payload, 0x01);
+            handsetnextperiodic += HANDSET_BIND_PERIOD_NS;
+        }
+    } else
+        return;
+
+    handsettx.active = true;
+    handsettx.start = now;
+    handsettx.end = now + AIRTIME_NS;
+    handsettx.channel = HANDSET_CHANNEL;
+    handsettx.id = handsetid;
+}
+
+void sim_a7105_init(void)
+{
+    memset(registers, 0, sizeof(registers));
+    memset(fifo, 0, sizeof(fifo));
+    memset(idbytes, 0, sizeof(idbytes));
+    memset(&simradio, 0, sizeof(simradio));
+    writepointer = readpointer = 0;
+    radiomode = RADIO_STANDBY;
+    quadtx.active = false;
+    selected = false;
+
+    handsetstate = HANDSET_BIND;
+    handsetid = HANDSET_DEFAULT_ID;
+    handsettx.active = false;
+    handsetnextperiodic = HANDSET_STARTUP_NS;
+    handsetreplypending = false;
+
+    replayframes = NULL;
+    replaycount = replaynext = 0;
+    replaysending = replayinfifo = NULL;
+}
+
+// Replace the handset's packets with captured frames, after the handset model has bound with the quad or from the start
+void sim_a7105_replay(simreplayframe * frames, unsigned long count, bool afterbinding)
+{
+    replayframes = frames;
+    replaycount = count;
+    replaynext = 0;
+    replayafterbinding = afterbinding;
+    handsettx.end = 0;
+}
+
+bool sim_a7105_replaydone(void)
+{
+    return replaynext == replaycount && !handsettx.active;
+}
+
+void sim_a7105_update(uint64_t now)
+{
+    if (quadtx.active && now >= quadtx.end) {
+        quadtx.active = false;
+        radiomode = RADIO_STANDBY;
+        handsetreceive(&quadtx);
+    }
+    do {
+        if (handsettx.active && now >= handsettx.end) {
+            handsettx.active = false;
+            quadreceive(&handsettx);
+        }
+        if (!handsettx.active)
+            handsettransmit(now);
+    } while (handsettx.active && now >= handsettx.end);
+}
+
+static void strobe(uint8_t command)
+{
+    switch (command & 0xF0) {
+        case 0xC0:             // RX
+            radiomode = RADIO_RX;
+            rxstart = sim_nanoseconds();
+            quadtx.active = false;
+            break;
+        case 0xD0:             // TX, sends the FIFO from the start
+            radiomode = RADIO_TX;
+            quadtx.active = true;
+            quadtx.start = sim_nanoseconds();
+            quadtx.end = quadtx.start + AIRTIME_NS;
+            quadtx.channel = registers[A7105_PLL_I];
+            quadtx.id = quadid();
+            memcpy(quadtx.payload, fifo, 16);
+            break;
+        case 0xE0:             // RST_WRPTR
+            writepointer = 0;
+            break;
+        case 0xF0:             // RST_RDPTR
+            readpointer = 0;
+            break;
+        default:               // sleep, idle, standby, PLL
+            radiomode = RADIO_STANDBY;
+            quadtx.active = false;
+            break;
+    }
+}
+
+static void writeregister(uint8_t address, uint8_t value)
+{
+    if (address == A7105_MODE) {
+        // writing the mode register resets the chip
+        memset(registers, 0, sizeof(registers));
+        writepointer = readpointer = 0;
+        radiomode = RADIO_STANDBY;
+        quadtx.active = false;
+    } else if (address == A7105_FIFO_DATA) {
+        fifo[writepointer] = value;
+        replayinfifo = NULL;
+        writepointer = (writepointer + 1) % fifolength();
+    } else if (address == A7105_ID_DATA) {
+        idbytes[idindex++ & 3] = value;
+    } else if (address < A7105_NUMREGISTERS)
+        registers[address] = value;
+}
+
+static uint8_t readregister(uint8_t address)
+{
+    uint8_t value;
+    if (address == A7105_MODE) {
+        // TRER is set while a transmission or reception is in progress
+        return (radiomode == RADIO_STANDBY) ? 0x00 : 0x01;
+    } else if (address == A7105_FIFO_DATA) {
+        value = fifo[readpointer];
+        readpointer = (readpointer + 1) % fifolength();
+        if (replayinfifo && !readpointer) {
+            replayinfifo->read = sim_nanoseconds();
+            replayinfifo = NULL;
+        }
+        return value;
+    } else if (address == A7105_ID_DATA)
+        return idbytes[idindex++ & 3];
+    else if (address < A7105_NUMREGISTERS)
+        return registers[address] & (address == 0x02 ? 0x00 : 0xFF);   // calibration always finished
+    return 0;
+}
+
+void sim_a7105_select(bool select)
+{
+    if (select && !selected)
+        simradio.spiframes++;
+    selected = select;
+    spistate = SPI_COMMAND;
+}
+
+void sim_a7105_write(uint8_t data)
+{
+    if (!selected)
+        return;
+    simradio.spibytes++;
+    if (spistate == SPI_COMMAND) {
+        if (data & 0x80) {
+            // strobes are a single byte, another command may follow in the same frame
+            strobe(data);
+        } else {
+            spiaddress = data & 0x3F;
+            spiread = (data & 0x40) != 0;
+            idindex = 0;
+            spistate = SPI_DATA;
+        }
+    } else if (!spiread)
+        writeregister(spiaddress, data);
+}
+
+uint8_t sim_a7105_read(void)
+{
+    if (!selected)
+        return 0xFF;
+    simradio.spibytes++;
+    if (spistate != SPI_DATA || !spiread)
+        return 0xFF;
+    return readregister(spiaddress);
+}
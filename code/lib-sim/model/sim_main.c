@@ -0,0 +1,487 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lib_fp.h"
+#include "lib_adc.h"
+#include "bradwii.h"
+#include "imu.h"
+#include "profiler.h"
+#include "a7105.h"
+#include "sim.h"
+#include "blackbox.h"
+
+// Entry point of the software-in-the-loop build.  Runs the unmodified firmware against the models,
+// flies a fixed script with the handset and prints loop timing, attitude tracking and step response.
+
+// Script, in seconds after the firmware has armed.  Once bound, the handset holds throttle low and yaw
+// right until the main loop picks that up.  Arming starts a 4 second gyro and accelerometer calibration.
+#define TAKEOFF         5.0
+#define ROLLSTEP        8.0
+#define PITCHSTEP       12.0
+#define STEPLENGTH      2.0
+#define SCRIPTEND       16.0
+
+// -u rolls the quad over by force at UPSET, after the steps, to see how level mode gets back from a large tilt.  It
+// is turned at a steady rate for UPSETTIME, well under the gyro's 2000 deg/s for any angle up to 180 degrees, and
+// the script runs UPSETLENGTH longer.
+#define UPSET           16.0
+#define UPSETTIME       0.1
+#define UPSETLENGTH     3.0
+#define UPSETLEVELBAND  10.0    // degrees of tilt that count as back to level
+
+#define STEPCOUNTS      17      // stick counts from center, about 20 degrees in level mode
+#define CLIMBCOUNTS     8       // throttle counts over hover, about 6% more thrust
+#define SETTLINGBAND    0.1     // fraction of the step
+#define STEADYSTATETIME 0.5     // s at the end of a step used for the steady state error
+
+#define PHYSICS_NS      100000ULL       // 10 kHz rigid body and sensor update
+#define SAMPLE_NS       1000000ULL      // 1 kHz script, statistics and trace
+
+#define NSTOSECONDS(ns) ((double) (ns) * 1e-9)
+
+extern globalstruct global;
+
+typedef struct {
+    const char *name;
+    int axis;
+    double start;               // s of script time
+    double target;              // commanded angle in degrees
+    double peak;
+    double time10;
+    double time90;
+    double lastoutside;         // last time the response was outside the settling band
+    double steadysum;
+    unsigned long steadycount;
+} stepresponse;
+
+static uint64_t now;
+static uint64_t nextphysics;
+static uint64_t nextsample;
+static uint64_t endtime;
+static bool ended;              // the run is over, the firmware's time no longer moves the models
+static uint64_t armedtime;
+static uint32_t loopcpunanoseconds = SIM_DEFAULT_LOOP_CPU_US * 1000;
+static bool runscript;
+static FILE *tracefile;
+static FILE *blackboxfile;
+static struct timespec wallstart;
+
+static unsigned long loopcount;
+static unsigned long loopmin = 0xFFFFFFFF;
+static unsigned long loopmax;
+static double looptotal;
+
+static double trackingsquaredsum[2];
+static double trackingmax[2];
+static unsigned long trackingcount;
+
+static double upsetangle;       // degrees, 0 for no upset
+static double upsetpeak;        // largest tilt after the kick, degrees
+static double upsetpeaktime;    // s after the upset started
+static double upsetrecovered;   // when the tilt first came back inside UPSETLEVELBAND, s after the upset started
+
+static stepresponse steps[2] = {
+    {"roll", ROLLINDEX, ROLLSTEP},
+    {"pitch", PITCHINDEX, PITCHSTEP},
+};
+
+uint64_t sim_nanoseconds(void)
+{
+    return now;
+}
+
+static double scripttime(void)
+{
+    if (!armedtime)
+        return -1;
+    return NSTOSECONDS(now - armedtime);
+}
+
+static double scriptend(void)
+{
+    return upsetangle ? UPSET + UPSETLENGTH : SCRIPTEND;
+}
+
+static void measureupset(double t)
+{
+    if (!upsetangle || t < UPSET)
+        return;
+    if (t < UPSET + UPSETTIME)
+        simquad.rate[ROLLINDEX] = upsetangle / UPSETTIME * M_PI / 180.0;
+
+    // the tilt from level, whichever way it is
+    double down = simquad.downvector[2];
+    double tilt = acos(down > 1 ? 1 : down < -1 ? -1 : down) * 180.0 / M_PI;
+    if (tilt > upsetpeak) {
+        upsetpeak = tilt;
+        upsetpeaktime = t - UPSET;
+    }
+    if (!upsetrecovered && t >= UPSET + UPSETTIME && tilt < UPSETLEVELBAND)
+        upsetrecovered = t - UPSET;
+}
+
+static uint8_t stickbyte(double value)
+{
+    // inverse of the scaling in rx_x4.c decodepacket(): (byte-0x80)*513 is -1..1 in fixed point
+    long byte = 0x80 + lrint(value * FIXEDPOINTONE / 513);
+    if (byte < 0)
+        return 0;
+    if (byte > 0xFF)
+        return 0xFF;
+    return (uint8_t) byte;
+}
+
+static void updatesticks(void)
+{
+    simsticks *sticks = &simhandsetsticks;
+
+    sticks->throttle = 0x00;
+    sticks->yaw = 0x80;
+    sticks->roll = 0x80;
+    sticks->pitch = 0x80;
+
+    if (!armedtime) {
+        if (!global.armed) {
+            if (simradio.bindcompletens)
+                sticks->yaw = 0xFF;
+            return;
+        }
+        armedtime = now;
+    }
+    double t = scripttime();
+
+    if (t >= TAKEOFF) {
+        // enough over hover that the quad keeps climbing away from the ground while tilted during the steps
+        sticks->throttle = stickbyte(2 * (sim_quad_hoverthrottle() - 0.5)) + CLIMBCOUNTS;
+    }
+
+    // roll and pitch bytes are inverted in decodepacket()
+    if (t >= ROLLSTEP && t < ROLLSTEP + STEPLENGTH)
+        sticks->roll = 0x80 - STEPCOUNTS;
+    if (t >= PITCHSTEP && t < PITCHSTEP + STEPLENGTH)
+        sticks->pitch = 0x80 - STEPCOUNTS;
+}
+
+static void measurestep(stepresponse * step, double t, double angle)
+{
+    double elapsed = t - step->start;
+    if (elapsed < 0 || elapsed >= STEPLENGTH)
+        return;
+
+    double fraction = angle / step->target;
+    if (fraction > step->peak)
+        step->peak = fraction;
+    if (step->time10 < 0 && fraction >= 0.1)
+        step->time10 = elapsed;
+    if (step->time90 < 0 && fraction >= 0.9)
+        step->time90 = elapsed;
+    if (fabs(fraction - 1) > SETTLINGBAND)
+        step->lastoutside = elapsed;
+    if (elapsed >= STEPLENGTH - STEADYSTATETIME) {
+        step->steadysum += angle - step->target;
+        step->steadycount++;
+    }
+}
+
+static void sample(void)
+{
+    double trueangles[3];
+    double estimatedangles[3];
+
+    updatesticks();
+
+    sim_quad_eulerangles(trueangles);
+    imuupdateeulerattitude();
+    for (int i = 0; i < 3; ++i)
+        estimatedangles[i] = (double) global.currentestimatedeulerattitude[i] / FIXEDPOINTONE;
+
+    if (simquad.airborne && global.armed) {
+        for (int i = 0; i < 2; ++i) {
+            double error = estimatedangles[i] - trueangles[i];
+            trackingsquaredsum[i] += error * error;
+            if (fabs(error) > trackingmax[i])
+                trackingmax[i] = fabs(error);
+        }
+        trackingcount++;
+    }
+
+    double t = scripttime();
+    if (t >= 0) {
+        for (int i = 0; i < 2; ++i)
+            measurestep(&steps[i], t, trueangles[steps[i].axis]);
+        measureupset(t);
+    }
+
+    if (tracefile)
+        fprintf(tracefile, "%.3f,%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+                NSTOSECONDS(now), global.armed, global.started, simquad.airborne,
+                trueangles[0], trueangles[1], trueangles[2], estimatedangles[0], estimatedangles[1], estimatedangles[2],
+                simquad.motorcommand[0], simquad.motorcommand[1], simquad.motorcommand[2], simquad.motorcommand[3],
+                -simquad.position[2], simquad.batteryvoltage);
+
+    if (runscript && t >= scriptend())
+        exit(0);
+}
+
+void sim_advance(uint32_t nanoseconds)
+{
+    now += nanoseconds;
+    if (ended)
+        return;
+
+    while (nextphysics <= now) {
+        sim_quad_step(NSTOSECONDS(PHYSICS_NS));
+        sim_sensors_step(NSTOSECONDS(PHYSICS_NS));
+        nextphysics += PHYSICS_NS;
+    }
+    while (nextsample <= now) {
+        sample();
+        nextsample += SAMPLE_NS;
+    }
+    sim_a7105_update(now);
+
+    if (now >= endtime)
+        exit(0);
+}
+
+void sim_chargeloop(void)
+{
+    sim_advance(loopcpunanoseconds);
+}
+
+void sim_recordloop(unsigned long microseconds)
+{
+    if (!global.armed || !global.started)
+        return;
+#if (LOOP_PROFILER==YES)
+    // leave the boot and the calibration when arming out of the profile
+    if (!loopcount)
+        resetprofiler();
+#endif
+    loopcount++;
+    looptotal += microseconds;
+    if (microseconds < loopmin)
+        loopmin = microseconds;
+    if (microseconds > loopmax)
+        loopmax = microseconds;
+}
+
+double sim_adc_inputvoltage(uint8_t channel)
+{
+    if (channel == LIB_ADC_CHAN5)
+        return simquad.batteryvoltage / BATTERY_VOLTAGE_FACTOR;
+    if (channel == LIB_ADC_CHANREF)
+        return 1.20;            // bandgap
+    return 0;
+}
+
+static void reportstep(const stepresponse * step)
+{
+    if (scripttime() < step->start + STEPLENGTH) {
+        printf("%s step: not reached\n", step->name);
+        return;
+    }
+    printf("%s step: %.1f deg", step->name, step->target);
+    if (step->time10 >= 0 && step->time90 >= 0)
+        printf(", rise %.0f ms", (step->time90 - step->time10) * 1000);
+    else
+        printf(", rise n/a");
+    printf(", overshoot %.1f%%", (step->peak > 1 ? step->peak - 1 : 0) * 100);
+    printf(", settling %.0f ms", step->lastoutside * 1000);
+    if (step->steadycount)
+        printf(", steady state error %.2f deg", step->steadysum / step->steadycount);
+    printf("\n");
+}
+
+static void reportprofiler(void)
+{
+#if (LOOP_PROFILER==YES)
+    static const char *names[PROFILERNUMENTRIES] = {
+        "timesliver", "imu", "arming", "rx", "pid", "mixer", "checkboxes", "serial", "camera", "battery+leds",
+        "blackbox", "whole loop"
+    };
+
+    printf("loop profile (us, the sim's loop cpu time is charged to timesliver):\n");
+    printf("  %-12s %6s %6s %6s   <32 <64 <128 <256 <512 <1k <2k >=2k (%%)\n", "stage", "min", "avg", "max");
+    for (int x = 0; x < PROFILERNUMENTRIES; ++x) {
+        profilerentrystruct *entry = getprofilerentry(x);
+        unsigned long total = 0;
+        if (!entry->count)
+            continue;
+        for (int b = 0; b < PROFILERNUMBUCKETS; ++b)
+            total += entry->bucket[b];
+        printf("  %-12s %6u %6u %6u  ", names[x], entry->minmicroseconds, profileraveragemicroseconds(entry),
+               entry->maxmicroseconds);
+        for (int b = 0; b < PROFILERNUMBUCKETS; ++b)
+            printf(" %3.0f", total ? 100.0 * entry->bucket[b] / total : 0);
+        printf("\n");
+    }
+#endif
+}
+
+static void report(void)
+{
+    struct timespec wallend;
+    clock_gettime(CLOCK_MONOTONIC, &wallend);
+    double walltime = (wallend.tv_sec - wallstart.tv_sec) + (wallend.tv_nsec - wallstart.tv_nsec) * 1e-9;
+    double simtime = NSTOSECONDS(now);
+
+    if (tracefile)
+        fclose(tracefile);
+
+#if (BLACKBOX==YES)
+    // the flight ends with a disarm, which writes the blackbox window to the flash
+    ended = true;
+    global.armed = 0;
+    blackboxrecord();
+#endif
+    const uint8_t *blackbox;
+    uint32_t blackboxsize = sim_blackbox(&blackbox);
+    if (blackboxfile) {
+        fwrite(blackbox, 1, blackboxsize, blackboxfile);
+        fclose(blackboxfile);
+    }
+
+    printf("simulated %.2f s in %.2f s wall clock (%.1fx real time)\n", simtime, walltime, walltime > 0 ? simtime / walltime : 0);
+    if (simradio.bindcompletens)
+        printf("bound after %.3f s, %lu/%lu control packets received, %lu missed, %lu telemetry packets\n",
+               NSTOSECONDS(simradio.bindcompletens), simradio.packetsreceived, simradio.packetssent, simradio.packetsmissed,
+               simradio.telemetryreceived);
+    else
+        printf("not bound\n");
+    linkstatsstruct *link = getlinkstats(0);
+    printf("link, last second: %u valid, %u bad checksum, %u wrong tx id, %u timeouts, rssi %u\n", link->validpackets,
+           link->badchecksums, link->wrongtxid, link->timeouts, link->rssi);
+    printf("radio spi: %lu bytes in %lu frames, %lu bytes skipped by the register shadow\n", simradio.spibytes,
+           simradio.spiframes, (unsigned long) A7105_GetSavedBytes());
+    rxtimingstruct *timing = getrxtiming();
+    printf("rx timing: handset period %.1f us, %s, %u good intervals in a row\n",
+           (double) timing->period / (1 << RXTIMINGPERIODSHIFT), rxtiming_locked(timing) ? "locked" : "not locked",
+           timing->goodintervals);
+    if (global.startupreadytime)
+        printf("startup: calibrated after %.3f s, bound after %.3f s, main loop from %.3f s\n",
+               global.startupcalibratedtime / 1e6, global.startupboundtime / 1e6, global.startupreadytime / 1e6);
+    if (armedtime)
+        printf("armed after %.3f s\n", NSTOSECONDS(armedtime));
+    if (blackboxsize)
+        printf("blackbox: %lu bytes of data flash programmed\n", (unsigned long) blackboxsize);
+
+    if (loopcount)
+        printf("loop: %lu passes, min %lu us, avg %.0f us, max %lu us (%.0f Hz)\n",
+               loopcount, loopmin, looptotal / loopcount, loopmax, loopcount * 1e6 / looptotal);
+    else
+        printf("loop: never flew\n");
+    reportprofiler();
+
+    if (trackingcount)
+        printf("attitude estimate error: roll rms %.2f max %.2f deg, pitch rms %.2f max %.2f deg\n",
+               sqrt(trackingsquaredsum[0] / trackingcount), trackingmax[0],
+               sqrt(trackingsquaredsum[1] / trackingcount), trackingmax[1]);
+
+    for (int i = 0; i < 2; ++i)
+        reportstep(&steps[i]);
+
+    if (upsetangle) {
+        if (scripttime() < UPSET + UPSETLENGTH)
+            printf("upset: not reached\n");
+        else if (!upsetrecovered)
+            printf("upset: rolled %.0f deg in %.0f ms, peak tilt %.1f deg after %.0f ms, not back within %.0f deg of level\n",
+                   upsetangle, UPSETTIME * 1000, upsetpeak, upsetpeaktime * 1000, UPSETLEVELBAND);
+        else
+            printf("upset: rolled %.0f deg in %.0f ms, peak tilt %.1f deg after %.0f ms, back within %.0f deg of level after %.0f ms\n",
+                   upsetangle, UPSETTIME * 1000, upsetpeak, upsetpeaktime * 1000, UPSETLEVELBAND, upsetrecovered * 1000);
+    }
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-t seconds] [-c loop cpu us] [-s seed] [-o trace.csv] [-b blackbox.bin] [-u degrees]\n",
+            program);
+    fprintf(stderr, "  -t  simulated time to run, default is to the end of the flight script\n");
+    fprintf(stderr, "  -c  CPU time charged per main loop pass, default %d us\n", SIM_DEFAULT_LOOP_CPU_US);
+    fprintf(stderr, "  -s  seed for the sensor noise\n");
+    fprintf(stderr, "  -o  write a 1 kHz trace in CSV format\n");
+    fprintf(stderr, "  -b  write what the firmware put in the blackbox pages, when it is built with BLACKBOX=YES\n");
+    fprintf(stderr, "  -u  after the steps, roll the quad over this far and report how level mode recovers\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    double duration = 0;
+    uint32_t seed = 1;
+    int option;
+
+    while ((option = getopt(argc, argv, "t:c:s:o:b:u:h")) != -1) {
+        switch (option) {
+            case 't':
+                duration = atof(optarg);
+                break;
+            case 'c':
+                loopcpunanoseconds = (uint32_t) (atof(optarg) * 1000);
+                break;
+            case 's':
+                seed = (uint32_t) strtoul(optarg, NULL, 0);
+                break;
+            case 'o':
+                tracefile = fopen(optarg, "w");
+                if (!tracefile) {
+                    perror(optarg);
+                    return 1;
+                }
+                fprintf(tracefile, "time,armed,started,airborne,roll,pitch,yaw,estroll,estpitch,estyaw,motor0,motor1,motor2,motor3,altitude,battery\n");
+                break;
+            case 'b':
+                blackboxfile = fopen(optarg, "wb");
+                if (!blackboxfile) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 'u':
+                upsetangle = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        steps[i].target = STEPCOUNTS * 774.0 / FIXEDPOINTONE * LEVEL_MODE_MAX_TILT;
+        steps[i].time10 = steps[i].time90 = -1;
+    }
+
+    sim_quad_init();
+    sim_sensors_init(seed);
+    sim_a7105_init();
+
+    // the script is timed from arming, so without -t run until it ends.  Give up if the quad never arms.
+    runscript = duration <= 0;
+    endtime = (uint64_t) ((runscript ? scriptend() + 30.0 : duration) * 1e9);
+    nextphysics = PHYSICS_NS;
+    nextsample = SAMPLE_NS;
+
+    clock_gettime(CLOCK_MONOTONIC, &wallstart);
+    atexit(report);
+
+    return bradwii_main();
+}
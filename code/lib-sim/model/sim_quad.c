@@ -0,0 +1,204 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+#include "sim.h"
+
+// Rigid body model of an H107D.  Everything is kept in the firmware's own axes so that the gyro and
+// accelerometer models only have to undo GYRO_ORIENTATION and ACC_ORIENTATION from defs.h.
+// Firmware body axes: X is positive when the right side is down, Y when the nose is down, Z points down.
+
+#define GRAVITY             9.81
+#define MASS                0.045       // kg, H107D with camera and battery
+#define MAXMOTORTHRUST      0.22        // N per motor at full PWM
+#define ARMLENGTH           0.023       // m, lever arm of each motor around the roll and pitch axes
+#define YAWTORQUEPERTHRUST  0.006       // Nm of reaction torque per N of thrust
+#define MOTORTIMECONSTANT   0.020       // s, spin up lag of the brushed motors
+#define ROTATIONALDAMPING   0.00002     // Nm per rad/s
+#define LINEARDRAG          0.05        // N per m/s
+#define BATTERYFULL         4.05        // V
+#define BATTERYDRAIN        0.002       // V per second of flight
+#define BATTERYSAG          0.35        // V at full throttle on all motors
+
+static const double inertia[3] = { 0.000010, 0.000010, 0.000012 };      // kg m^2 around roll, pitch, yaw
+
+simquadstate simquad;
+static double flighttime;
+
+static void crossproduct(const double *a, const double *b, double *result)
+{
+    result[0] = a[1] * b[2] - a[2] * b[1];
+    result[1] = a[2] * b[0] - a[0] * b[2];
+    result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static double dotproduct(const double *a, const double *b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void normalize(double *v)
+{
+    double length = sqrt(dotproduct(v, v));
+    v[0] /= length;
+    v[1] /= length;
+    v[2] /= length;
+}
+
+// Rotates a world vector expressed in body axes by the body rates over dt.
+// This is the exact version of rotatevectorwithsmallangles(): d/dt v = omega x v with omega = (-pitch, roll, yaw).
+static void rotate(double *v, const double *rate, double dt)
+{
+    double axis[3] = { -rate[1], rate[0], rate[2] };
+    double angle = sqrt(dotproduct(axis, axis)) * dt;
+    if (angle < 1e-12)
+        return;
+    normalize(axis);
+
+    double cross[3];
+    crossproduct(axis, v, cross);
+    double dot = dotproduct(axis, v);
+    double c = cos(angle);
+    double s = sin(angle);
+    for (int i = 0; i < 3; ++i)
+        v[i] = v[i] * c + cross[i] * s + axis[i] * dot * (1.0 - c);
+}
+
+static void settle(void)
+{
+    // sitting on the ground: level, still, keep the heading
+    double heading = atan2(simquad.westvector[1], simquad.westvector[0]);
+    memset(simquad.rate, 0, sizeof(simquad.rate));
+    memset(simquad.velocity, 0, sizeof(simquad.velocity));
+    simquad.position[2] = 0;
+    simquad.downvector[0] = 0;
+    simquad.downvector[1] = 0;
+    simquad.downvector[2] = 1;
+    simquad.westvector[0] = cos(heading);
+    simquad.westvector[1] = sin(heading);
+    simquad.westvector[2] = 0;
+    simquad.airborne = false;
+}
+
+void sim_quad_init(void)
+{
+    memset(&simquad, 0, sizeof(simquad));
+    simquad.westvector[0] = 1;
+    settle();
+    simquad.batteryvoltage = BATTERYFULL;
+    flighttime = 0;
+}
+
+void sim_quad_setmotor(int motor, double value)
+{
+    if (motor < 0 || motor > 3)
+        return;
+    if (value < 0)
+        value = 0;
+    if (value > 1)
+        value = 1;
+    simquad.motorcommand[motor] = value;
+}
+
+double sim_quad_hoverthrottle(void)
+{
+    return MASS * GRAVITY / (4 * MAXMOTORTHRUST);
+}
+
+void sim_quad_eulerangles(double *euler)
+{
+    // same definitions as imucalculateestimatedattitude(), in degrees
+    double *down = simquad.downvector;
+    euler[0] = atan2(down[0], down[2]) * 180.0 / M_PI;
+    if (fabs(euler[0]) > 45 && fabs(euler[0]) < 135)
+        euler[1] = atan2(down[1], fabs(down[0])) * 180.0 / M_PI;
+    else
+        euler[1] = atan2(down[1], down[2]) * 180.0 / M_PI;
+    double xvalue = simquad.westvector[0];
+    if (down[2] < 0)
+        xvalue = -xvalue;
+    euler[2] = atan2(simquad.westvector[1], xvalue) * 180.0 / M_PI;
+}
+
+void sim_quad_step(double dt)
+{
+    double thrust[4];
+    double totalthrust = 0;
+    double totalmotor = 0;
+
+    for (int i = 0; i < 4; ++i) {
+        simquad.motor[i] += (simquad.motorcommand[i] - simquad.motor[i]) * dt / MOTORTIMECONSTANT;
+        thrust[i] = simquad.motor[i] * MAXMOTORTHRUST;
+        totalthrust += thrust[i];
+        totalmotor += simquad.motor[i];
+    }
+
+    // torques follow the mixer in bradwii.c: motor 0 back right, 1 front right, 2 back left, 3 front left
+    double torque[3];
+    torque[0] = ARMLENGTH * (thrust[2] + thrust[3] - thrust[0] - thrust[1]);
+    torque[1] = ARMLENGTH * (thrust[0] - thrust[1] + thrust[2] - thrust[3]);
+    torque[2] = YAWTORQUEPERTHRUST * (thrust[0] - thrust[1] - thrust[2] + thrust[3]);
+
+    // world basis expressed in body axes
+    double *down = simquad.downvector;
+    double *west = simquad.westvector;
+    double north[3];
+    crossproduct(down, west, north);
+
+    // forces in world axes (north, west, down). Thrust acts along body -Z.
+    double force[3];
+    force[0] = -totalthrust * north[2] - LINEARDRAG * simquad.velocity[0];
+    force[1] = -totalthrust * west[2] - LINEARDRAG * simquad.velocity[1];
+    force[2] = -totalthrust * down[2] - LINEARDRAG * simquad.velocity[2] + MASS * GRAVITY;
+
+    if (!simquad.airborne && force[2] < 0)
+        simquad.airborne = true;
+
+    if (simquad.airborne) {
+        for (int i = 0; i < 3; ++i) {
+            simquad.rate[i] += (torque[i] - ROTATIONALDAMPING * simquad.rate[i]) / inertia[i] * dt;
+            simquad.velocity[i] += force[i] / MASS * dt;
+            simquad.position[i] += simquad.velocity[i] * dt;
+        }
+        rotate(down, simquad.rate, dt);
+        rotate(west, simquad.rate, dt);
+
+        // keep the basis orthonormal
+        normalize(down);
+        crossproduct(north, down, west);
+        normalize(west);
+
+        if (simquad.position[2] > 0)
+            settle();
+
+        flighttime += dt;
+    }
+
+    // accelerometer: the reaction to thrust and drag, or the ground pushing back
+    if (simquad.airborne) {
+        double bodyvelocity[3];
+        for (int i = 0; i < 3; ++i)
+            bodyvelocity[i] = simquad.velocity[0] * north[i] + simquad.velocity[1] * west[i] + simquad.velocity[2] * down[i];
+        for (int i = 0; i < 3; ++i)
+            simquad.specificforce[i] = LINEARDRAG * bodyvelocity[i] / (MASS * GRAVITY);
+        simquad.specificforce[2] += totalthrust / (MASS * GRAVITY);
+    } else {
+        for (int i = 0; i < 3; ++i)
+            simquad.specificforce[i] = down[i];
+    }
+
+    simquad.batteryvoltage = BATTERYFULL - BATTERYDRAIN * flighttime - BATTERYSAG * totalmotor / 4;
+}
@@ -0,0 +1,282 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+#include "sim.h"
+
+// Register level models of the two I2C sensors on the H107D.  The firmware drives them through
+// lib_i2c exactly as it would on the board, so gyro.c and accelerometer.c run unmodified.
+// The MPU6050's auxiliary I2C master is modelled for slave 0 reads, with the MC3210 answering on
+// the auxiliary bus as well as the main one, for ACCELEROMETER_TYPE MC3210_VIA_MPU6050.
+// Its FIFO is modelled for the gyro and slave 0 data, for GYRO_FIFO.  Samples go into it every time they are
+// latched, at 1 kHz, which is the rate GYRO_FIFO sets up.  An overflow sets FIFO_OFLOW_INT in INT_STATUS when
+// INT_ENABLE lets it, and reading INT_STATUS clears it.
+
+#define MPU6050_ADDRESS 0x68
+#define MC3210_ADDRESS  0x4C
+
+#define MPU6050_SMPLRT_DIV      0x19
+#define MPU6050_CONFIG          0x1A
+#define MPU6050_GYRO_CONFIG     0x1B
+#define MPU6050_ACCEL_CONFIG    0x1C
+#define MPU6050_ACCEL_XOUT_H    0x3B
+#define MPU6050_FIFO_EN         0x23
+#define MPU6050_I2C_SLV0_ADDR   0x25
+#define MPU6050_I2C_SLV0_REG    0x26
+#define MPU6050_I2C_SLV0_CTRL   0x27
+#define MPU6050_I2C_SLV4_CTRL   0x34
+#define MPU6050_INT_ENABLE      0x38
+#define MPU6050_INT_STATUS      0x3A
+#define MPU6050_GYRO_XOUT_H     0x43
+#define MPU6050_EXT_SENS_DATA_00 0x49
+#define MPU6050_I2C_MST_DELAY_CTRL 0x67
+#define MPU6050_USER_CTRL       0x6A
+#define MPU6050_PWR_MGMT_1      0x6B
+#define MPU6050_FIFO_COUNTH     0x72
+#define MPU6050_FIFO_COUNTL     0x73
+#define MPU6050_FIFO_R_W        0x74
+#define MPU6050_WHO_AM_I        0x75
+
+#define MC3210_MODE             0x07
+#define MC3210_XOUT_EX_L        0x0D
+#define MC3210_OUTCFG           0x20
+
+#define SAMPLEPERIOD            0.001   // both sensors are read out at 1 kHz
+#define MC3210_BANDWIDTH        64.0    // Hz, as configured by initacc()
+
+#define GYRONOISE               0.07    // deg/s rms at rest
+#define GYROVIBRATION           1.5     // deg/s rms at full throttle
+#define ACCNOISE                0.004   // g rms at rest
+#define ACCVIBRATION            0.05    // g rms at full throttle
+
+// MPU6050 DLPF_CFG bandwidths for the gyro, in Hz
+static const double mpu6050bandwidth[8] = { 256, 188, 98, 42, 20, 10, 5, 256 };
+static const double gyrobias[3] = { 0.8, -0.5, 0.3 };   // deg/s, removed by the calibration at boot
+static const double accbias[3] = { 0.010, -0.008, 0.005 };      // g
+
+static uint8_t mpu6050registers[128];
+static uint8_t mc3210registers[64];
+
+static double filteredgyro[3];  // deg/s, firmware axes
+static double filteredacc[3];   // g, firmware axes
+static double sampletime;
+static int auxmasterdelay;      // samples left before the auxiliary master reads again
+
+#define FIFOSIZE 1024
+static uint8_t fifo[FIFOSIZE];
+static int fifohead;            // where the next byte goes
+static int fifocount;           // how many bytes are in it
+static uint32_t randomstate;
+
+static double randomuniform(void)
+{
+    // xorshift32, so that runs are repeatable for a given seed
+    randomstate ^= randomstate << 13;
+    randomstate ^= randomstate >> 17;
+    randomstate ^= randomstate << 5;
+    return (randomstate + 0.5) / 4294967296.0;
+}
+
+static double randomgaussian(void)
+{
+    return sqrt(-2.0 * log(randomuniform())) * cos(2.0 * M_PI * randomuniform());
+}
+
+static int16_t saturate(double value)
+{
+    if (value > 32767)
+        return 32767;
+    if (value < -32768)
+        return -32768;
+    return (int16_t) lrint(value);
+}
+
+static void putbigendian(uint8_t *registers, int16_t value)
+{
+    registers[0] = (uint8_t) (value >> 8);
+    registers[1] = (uint8_t) value;
+}
+
+static void putlittleendian(uint8_t *registers, int16_t value)
+{
+    registers[0] = (uint8_t) value;
+    registers[1] = (uint8_t) (value >> 8);
+}
+
+static void pushfifo(const uint8_t *data, int length)
+{
+    // when the fifo is full the oldest data is overwritten
+    while (length--) {
+        fifo[fifohead] = *data++;
+        fifohead = (fifohead + 1) % FIFOSIZE;
+        if (fifocount < FIFOSIZE)
+            ++fifocount;
+        else if (mpu6050registers[MPU6050_INT_ENABLE] & 0x10)
+            mpu6050registers[MPU6050_INT_STATUS] |= 0x10;       // FIFO_OFLOW_INT
+    }
+}
+
+static uint8_t popfifo(void)
+{
+    if (!fifocount)
+        return 0xFF;
+    return fifo[(fifohead - fifocount-- + FIFOSIZE) % FIFOSIZE];
+}
+
+static void latchsamples(void)
+{
+    double throttle = (simquad.motor[0] + simquad.motor[1] + simquad.motor[2] + simquad.motor[3]) / 4;
+    double gyro[3];
+    double acc[3];
+
+    for (int i = 0; i < 3; ++i) {
+        gyro[i] = filteredgyro[i] + gyrobias[i] + (GYRONOISE + GYROVIBRATION * throttle) * randomgaussian();
+        acc[i] = filteredacc[i] + accbias[i] + (ACCNOISE + ACCVIBRATION * throttle) * randomgaussian();
+    }
+
+    // MPU6050 gyro, undo GYRO_ORIENTATION: roll=-Y, pitch=X, yaw=-Z
+    if (!(mpu6050registers[MPU6050_PWR_MGMT_1] & 0x40)) {
+        static const double gyrolsbperdps[4] = { 131.0, 65.5, 32.8, 16.4 };
+        double scale = gyrolsbperdps[(mpu6050registers[MPU6050_GYRO_CONFIG] >> 3) & 3];
+        putbigendian(&mpu6050registers[MPU6050_GYRO_XOUT_H], saturate(gyro[1] * scale));
+        putbigendian(&mpu6050registers[MPU6050_GYRO_XOUT_H + 2], saturate(-gyro[0] * scale));
+        putbigendian(&mpu6050registers[MPU6050_GYRO_XOUT_H + 4], saturate(-gyro[2] * scale));
+
+        // the MPU6050's own accelerometer isn't used on the H107D, give it the same axes as the MC3210
+        double accscale = 16384 >> ((mpu6050registers[MPU6050_ACCEL_CONFIG] >> 3) & 3);
+        putbigendian(&mpu6050registers[MPU6050_ACCEL_XOUT_H], saturate(acc[1] * accscale));
+        putbigendian(&mpu6050registers[MPU6050_ACCEL_XOUT_H + 2], saturate(-acc[0] * accscale));
+        putbigendian(&mpu6050registers[MPU6050_ACCEL_XOUT_H + 4], saturate(acc[2] * accscale));
+    }
+
+    // MC3210 in wake mode, 14 bit +/- 8g: 1024 counts per g. Undo ACC_ORIENTATION: X=-Y, Y=X, Z=Z
+    if ((mc3210registers[MC3210_MODE] & 0x03) == 0x01) {
+        putlittleendian(&mc3210registers[MC3210_XOUT_EX_L], saturate(acc[1] * 1024));
+        putlittleendian(&mc3210registers[MC3210_XOUT_EX_L + 2], saturate(-acc[0] * 1024));
+        putlittleendian(&mc3210registers[MC3210_XOUT_EX_L + 4], saturate(acc[2] * 1024));
+    }
+
+    // MPU6050 auxiliary I2C master: when slave 0 is set up for reads, copy I2C_SLV0_LEN bytes from the slave into
+    // EXT_SENS_DATA every 1 + I2C_MST_DLY samples (every sample unless I2C_SLV0_DLY_EN is set)
+    if (!(mpu6050registers[MPU6050_PWR_MGMT_1] & 0x40) && (mpu6050registers[MPU6050_USER_CTRL] & 0x20)
+        && (mpu6050registers[MPU6050_I2C_SLV0_CTRL] & 0x80) && (mpu6050registers[MPU6050_I2C_SLV0_ADDR] & 0x80)) {
+        if (!(mpu6050registers[MPU6050_I2C_MST_DELAY_CTRL] & 0x01) || auxmasterdelay-- <= 0) {
+            auxmasterdelay = mpu6050registers[MPU6050_I2C_SLV4_CTRL] & 0x1F;
+            sim_i2c_read(mpu6050registers[MPU6050_I2C_SLV0_ADDR] & 0x7F, mpu6050registers[MPU6050_I2C_SLV0_REG],
+                         &mpu6050registers[MPU6050_EXT_SENS_DATA_00], mpu6050registers[MPU6050_I2C_SLV0_CTRL] & 0x0F);
+        }
+    }
+
+    // FIFO: the gyro, then slave 0's data, in register order
+    if (!(mpu6050registers[MPU6050_PWR_MGMT_1] & 0x40) && (mpu6050registers[MPU6050_USER_CTRL] & 0x40)) {
+        if ((mpu6050registers[MPU6050_FIFO_EN] & 0x70) == 0x70)
+            pushfifo(&mpu6050registers[MPU6050_GYRO_XOUT_H], 6);
+        if (mpu6050registers[MPU6050_FIFO_EN] & 0x01)
+            pushfifo(&mpu6050registers[MPU6050_EXT_SENS_DATA_00], mpu6050registers[MPU6050_I2C_SLV0_CTRL] & 0x0F);
+    }
+}
+
+void sim_sensors_init(uint32_t seed)
+{
+    memset(mpu6050registers, 0, sizeof(mpu6050registers));
+    memset(mc3210registers, 0, sizeof(mc3210registers));
+    mpu6050registers[MPU6050_PWR_MGMT_1] = 0x40;        // asleep after power up
+    mpu6050registers[MPU6050_WHO_AM_I] = MPU6050_ADDRESS;
+    mc3210registers[MC3210_MODE] = 0x03;        // standby
+
+    memset(filteredgyro, 0, sizeof(filteredgyro));
+    for (int i = 0; i < 3; ++i)
+        filteredacc[i] = simquad.specificforce[i];
+    sampletime = 0;
+    auxmasterdelay = 0;
+    fifohead = fifocount = 0;
+    randomstate = seed ? seed : 1;
+}
+
+void sim_sensors_step(double dt)
+{
+    double gyrobandwidth = mpu6050bandwidth[mpu6050registers[MPU6050_CONFIG] & 7];
+    double gyrofraction = 1.0 - exp(-2.0 * M_PI * gyrobandwidth * dt);
+    double accfraction = 1.0 - exp(-2.0 * M_PI * MC3210_BANDWIDTH * dt);
+
+    for (int i = 0; i < 3; ++i) {
+        filteredgyro[i] += (simquad.rate[i] * 180.0 / M_PI - filteredgyro[i]) * gyrofraction;
+        filteredacc[i] += (simquad.specificforce[i] - filteredacc[i]) * accfraction;
+    }
+
+    sampletime += dt;
+    while (sampletime >= SAMPLEPERIOD) {
+        sampletime -= SAMPLEPERIOD;
+        latchsamples();
+    }
+}
+
+bool sim_i2c_write(uint8_t address, uint8_t reg, uint8_t value)
+{
+    if (address == MPU6050_ADDRESS) {
+        if (reg == MPU6050_PWR_MGMT_1 && (value & 0x80))
+            sim_sensors_init(randomstate);
+        else if (reg == MPU6050_USER_CTRL) {
+            if (value & 0x04)   // FIFO_RESET, clears itself
+                fifocount = 0;
+            mpu6050registers[reg] = value & ~0x04;
+        } else
+            mpu6050registers[reg & 0x7F] = value;
+        return true;
+    }
+    if (address == MC3210_ADDRESS) {
+        mc3210registers[reg & 0x3F] = value;
+        return true;
+    }
+    return false;
+}
+
+uint8_t sim_i2c_nextregister(uint8_t address, uint8_t reg)
+{
+    // burst reads of the MPU6050's FIFO_R_W keep reading the fifo, everything else auto increments
+    if (address == MPU6050_ADDRESS && reg == MPU6050_FIFO_R_W)
+        return reg;
+    return reg + 1;
+}
+
+bool sim_i2c_read(uint8_t address, uint8_t reg, uint8_t *data, int length)
+{
+    // both parts auto increment the register address during burst reads, except the MPU6050 at FIFO_R_W
+    if (address == MPU6050_ADDRESS) {
+        while (length--) {
+            reg &= 0x7F;
+            if (reg == MPU6050_FIFO_R_W)
+                *data++ = popfifo();
+            else {
+                if (reg == MPU6050_FIFO_COUNTH) {       // the count is latched when its high byte is read
+                    mpu6050registers[MPU6050_FIFO_COUNTH] = (uint8_t) (fifocount >> 8);
+                    mpu6050registers[MPU6050_FIFO_COUNTL] = (uint8_t) fifocount;
+                }
+                *data++ = mpu6050registers[reg];
+                if (reg == MPU6050_INT_STATUS)  // clears when it's read
+                    mpu6050registers[MPU6050_INT_STATUS] = 0;
+            }
+            reg = sim_i2c_nextregister(address, reg);
+        }
+        return true;
+    }
+    if (address == MC3210_ADDRESS) {
+        while (length--)
+            *data++ = mc3210registers[reg++ & 0x3F];
+        return true;
+    }
+    return false;
+}
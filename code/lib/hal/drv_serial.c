@@ -218,6 +218,34 @@ void uartWrite(serialPort_t *s, uint8_t ch)
     }
 }
 
+uint32_t uartTxFree(serialPort_t *s)
+{
+    uint32_t tail = s->txBufferTail;
+    uint32_t used = (s->txBufferHead + s->txBufferSize - tail) % s->txBufferSize;
+
+    // uartStartTxDMA() moves the tail past the bytes it hands to the DMA, but they stay in the buffer, just before
+    // the tail, until the DMA has sent them.  Read the tail first: if the DMA interrupt starts the next transfer in
+    // between, its bytes are counted twice and used can come out larger than the buffer, so clamp it before the
+    // unsigned subtraction.
+    if (s->txDMAChannel)
+        used += s->txDMAChannel->CNDTR;
+    if (used >= s->txBufferSize - 1)
+        return 0;
+    return s->txBufferSize - 1 - used;
+}
+
+void uartTxCommit(serialPort_t *s, uint32_t head)
+{
+    s->txBufferHead = head;
+
+    if (s->txDMAChannel) {
+        if (!(s->txDMAChannel->CCR & 1))
+            uartStartTxDMA(s);
+    } else {
+        USART_ITConfig(s->USARTx, USART_IT_TXE, ENABLE);
+    }
+}
+
 
 
 
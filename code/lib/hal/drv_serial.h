@@ -3,7 +3,7 @@
 #define UART_BUFFER_SIZE    64
 
 #define UART1_RX_BUFFER_SIZE    256
-#define UART1_TX_BUFFER_SIZE    16
+#define UART1_TX_BUFFER_SIZE    64  // an MSP response in one piece, lib_serial_beginframe()
 #define UART2_RX_BUFFER_SIZE    64
 #define UART2_TX_BUFFER_SIZE    64
 #define UART3_RX_BUFFER_SIZE    64
@@ -48,3 +48,6 @@ serialPort_t *serialOpen(USART_TypeDef *USARTx, serialReceiveCallbackPtr callbac
 uint8_t uartAvailable(serialPort_t *s);
 uint8_t uartRead(serialPort_t *s);
 void uartWrite(serialPort_t *s, uint8_t ch);
+// Room in the TX buffer, and handing everything written up to head to DMA or the interrupt, for frames written in place
+uint32_t uartTxFree(serialPort_t *s);
+void uartTxCommit(serialPort_t *s, uint32_t head);
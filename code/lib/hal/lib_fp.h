@@ -15,6 +15,7 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#pragma once
 
 // a fixedpointnum is a real number that's stored in a long that's shifted left FIXEDPOINTSHIFT bits
 // FIXEDPOINTSHIFT is currently 16, so 16 bits are used for the integer part of the number and
@@ -57,12 +58,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // since time slivers can be very small, we shift them an extra 8 bits to maintain accuracy
 #define TIMESLIVEREXTRASHIFT 8
 
-void lib_fp_constrain(fixedpointnum *lf,fixedpointnum low,fixedpointnum high);
 void lib_fp_constrain180(fixedpointnum *lf);
-fixedpointnum lib_fp_multiply(fixedpointnum x,fixedpointnum y);
-
-void lib_fp_lowpassfilter(fixedpointnum *variable,fixedpointnum newvalue,fixedpointnum timesliver,fixedpointnum oneoverperiod,int timesliverextrashift);
-fixedpointnum lib_fp_abs(fixedpointnum fp);
 fixedpointnum lib_fp_sine(fixedpointnum angle);
 fixedpointnum lib_fp_cosine(fixedpointnum angle);
 fixedpointnum lib_fp_atan2(fixedpointnum y, fixedpointnum x);
@@ -70,3 +66,105 @@ fixedpointnum lib_fp_sqrt(fixedpointnum x);
 fixedpointnum lib_fp_stringtofixedpointnum(char *string);
 fixedpointnum lib_fp_invsqrt(fixedpointnum x);
 int32_t lib_fp_stringtolong(char *string);
+
+// The kernels that the hot path calls all the time are defined here so that the compiler can inline them.
+// FIXEDPOINTMULTIPLY64BIT picks how lib_fp_multiply() does its work.  Both give the same result to the bit.
+// The Cortex-M3 has a 32x32->64 bit multiply (SMULL), so the 64 bit version is faster.
+#ifndef FIXEDPOINTMULTIPLY64BIT
+#define FIXEDPOINTMULTIPLY64BIT 1
+#endif
+
+//             D1 C1 B1 A1 (x)
+//           x D2 C2 B2 A2 (y)
+// -----------------------
+// z0 y0 D0 C0 B0 A0 x0 w0
+
+
+// A2*A1 -> w0,x0 (skip)
+// A2*B1 -> x0,A0 (unsigned, unsigned) 
+// A2*C1 -> A0,B0 (unsigned, unsigned) // do first
+// A2*D1 -> B0,C0 (unsigned, signed)
+// B2*A1 -> x0,A0 (unsigned, unsigned)
+// B2*B1 -> A0,B0 (unsigned, unsigned)
+// B2*C1 -> B0,C0 (unsigned, unsigned) 
+// B2*D1 -> C0,D0 (unsigned, signed) 
+// C2*A1 -> A0,B0 (unsigned, unsigned)
+// C2*B1   -> B0,C0 (unsigned, unsigned)
+// C2*C1 -> C0,D0 (unsigned, unsigned) // do second
+// C2*D1 -> D0,y0 (unsigned, signed)
+// D2*A1 -> B0,C0 (signed, unsigned)
+// D2*B1 -> C0,D0 (signed, unsigned)
+// D2*C1 -> D0,y0 (signed, unsigned)
+// D2*D1 -> y0,z0 (skip)
+
+
+// A2*C1 -> A0,B0 (unsigned, unsigned) // do first
+// C2*C1 -> C0,D0 (unsigned, unsigned)  // do second
+// B2*C1 -> B0,C0 (unsigned, unsigned)
+// D2*C1 -> D0,y0 (signed, unsigned)
+// B2*A1 -> x0,A0 (unsigned, unsigned)
+// C2*A1 -> A0,B0 (unsigned, unsigned)
+// D2*A1 -> B0,C0 (signed, unsigned)
+// A2*B1 -> x0,A0 (unsigned, unsigned) 
+// B2*B1 -> A0,B0 (unsigned, unsigned)
+// C2*B1   -> B0,C0 (unsigned, unsigned)
+// D2*B1 -> C0,D0 (signed, unsigned)
+// A2*D1 -> B0,C0 (unsigned, signed)
+// B2*D1 -> C0,D0 (unsigned, signed) 
+// C2*D1 -> D0,y0 (unsigned, signed)
+
+static inline fixedpointnum lib_fp_multiply(fixedpointnum x, fixedpointnum y)
+{
+    // multiplies two fixed point numbers without overflowing and returns the result
+#if FIXEDPOINTMULTIPLY64BIT
+    // the low 32 bits of the 64 bit product shifted right are what the four partial products below add up to
+    return ((fixedpointnum) (((int64_t) x * y) >> FIXEDPOINTSHIFT));
+#else
+    int32_t xh = x >> FIXEDPOINTSHIFT;
+    uint32_t xl = x & 0xffff;
+    int32_t yh = y >> FIXEDPOINTSHIFT;
+    uint32_t yl = y & 0xffff;
+    return ((xh * yh) << FIXEDPOINTSHIFT) + xh * yl + yh * xl + ((xl * yl) >> FIXEDPOINTSHIFT);
+#endif
+}
+
+static inline void lib_fp_multiplyaccumulate(fixedpointnum *accumulator, fixedpointnum x, fixedpointnum y)
+{
+    // adds x*y to accumulator
+    *accumulator += lib_fp_multiply(x, y);
+}
+
+static inline void lib_fp_constrain(fixedpointnum *lf, fixedpointnum low, fixedpointnum high)
+{
+    if (*lf < low)
+        *lf = low;
+    else if (*lf > high)
+        *lf = high;
+}
+
+static inline fixedpointnum lib_fp_abs(fixedpointnum fp)
+{
+    if (fp < 0)
+        return (-fp);
+    else
+        return (fp);
+}
+
+static inline void lib_fp_lowpassfilter(fixedpointnum *variable, fixedpointnum newvalue, fixedpointnum timesliver, fixedpointnum oneoverperiod, int timesliverextrashift)
+{                               // updates a low pass filter variable.  It uses timesliver.  oneoverperiod is one over the time period 
+    // over which the filter is averaged.  We use oneoverperiod to avoid having to use division.
+    // this does the equivilent of:
+    //    float fraction=timesliver/period;
+    //    variable=fraction*newvalue+(1-fraction)*variable;
+    // except it does it using fixed point arithmatic
+    // If timesliver is very small, resolution can be gained by keeping timesliver shifted left by some extra bits.
+    // Make sure variable can be also shifted left this same number of bits or else the following will overflow! 
+    fixedpointnum fraction = lib_fp_multiply(timesliver, oneoverperiod);
+
+    *variable = (lib_fp_multiply(fraction, newvalue) + lib_fp_multiply((FIXEDPOINTONE << timesliverextrashift) - fraction, *variable)) >> timesliverextrashift;
+
+    // the adder combines adding .5 for rounding error and adding .5 in the direction the newvalue is trying to pull us
+    // So we can zero in on the desired value.
+    if (newvalue > *variable)
+        ++ * variable;
+}
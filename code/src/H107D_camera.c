@@ -25,6 +25,12 @@ extern globalstruct global;
 #define PIN_H107D_CAMERA_SCK  (DIGITALPORT4 | 6)
 #define PIN_H107D_CAMERA_SCS  (DIGITALPORT4 | 7)
 
+// resolved by H107D_camera_init()
+static digitalpin sdiopin, sckpin, scspin;
+
+// Frequency asked for by the handset, sent to the camera by H107D_camera_update()
+static uint16_t requestedfrequency = 0;
+
 /**
  * @brief      Init communication with H107D Camera
  * @param      None.
@@ -44,25 +50,28 @@ void H107D_camera_init(void)
 	lib_digitalio_initpin(PIN_H107D_CAMERA_SDIO, DIGITALOUTPUT);
 	lib_digitalio_initpin(PIN_H107D_CAMERA_SCK, DIGITALOUTPUT);
 	lib_digitalio_initpin(PIN_H107D_CAMERA_SCS, DIGITALOUTPUT);
-	lib_digitalio_setoutput(PIN_H107D_CAMERA_SCS, DIGITALON);
-	lib_digitalio_setoutput(PIN_H107D_CAMERA_SDIO, DIGITALOFF);
-	lib_digitalio_setoutput(PIN_H107D_CAMERA_SCK, DIGITALOFF);
+	sdiopin = lib_digitalio_getpin(PIN_H107D_CAMERA_SDIO);
+	sckpin = lib_digitalio_getpin(PIN_H107D_CAMERA_SCK);
+	scspin = lib_digitalio_getpin(PIN_H107D_CAMERA_SCS);
+	lib_digitalio_pinon(scspin);
+	lib_digitalio_pinoff(sdiopin);
+	lib_digitalio_pinoff(sckpin);
 
 	// Send initialisation frame
 
-	lib_digitalio_setoutput(PIN_H107D_CAMERA_SCS, DIGITALOFF);
+	lib_digitalio_pinoff(scspin);
 	while(n--) {
 		if(TSdata&0x80000000UL) // MSB first
-			lib_digitalio_setoutput(PIN_H107D_CAMERA_SDIO, DIGITALON);
+			lib_digitalio_pinon(sdiopin);
 		else 
-			lib_digitalio_setoutput(PIN_H107D_CAMERA_SDIO, DIGITALOFF);
-		lib_digitalio_setoutput(PIN_H107D_CAMERA_SCK, DIGITALON);
+			lib_digitalio_pinoff(sdiopin);
+		lib_digitalio_pinon(sckpin);
 		CLK_SysTickDelay(3);
-		lib_digitalio_setoutput(PIN_H107D_CAMERA_SCK, DIGITALOFF);
+		lib_digitalio_pinoff(sckpin);
 		CLK_SysTickDelay(2);
 		TSdata = TSdata << 1;
 	}
-	lib_digitalio_setoutput(PIN_H107D_CAMERA_SCS, DIGITALON);
+	lib_digitalio_pinon(scspin);
 
 }
 
@@ -129,18 +138,41 @@ void H107D_camera_update_frequency(uint16_t newfrequency)
 			}
 
 			// Init SDIO & CLK
-			lib_digitalio_setoutput(PIN_H107D_CAMERA_SCS, DIGITALOFF);
+			lib_digitalio_pinoff(scspin);
 			while(n--) {
 					if(TSdata&0x80000000UL) // MSB first
-							lib_digitalio_setoutput(PIN_H107D_CAMERA_SDIO, DIGITALON);
+							lib_digitalio_pinon(sdiopin);
 					else 
-							lib_digitalio_setoutput(PIN_H107D_CAMERA_SDIO, DIGITALOFF);
-					lib_digitalio_setoutput(PIN_H107D_CAMERA_SCK, DIGITALON);
+							lib_digitalio_pinoff(sdiopin);
+					lib_digitalio_pinon(sckpin);
 					CLK_SysTickDelay(3);
-					lib_digitalio_setoutput(PIN_H107D_CAMERA_SCK, DIGITALOFF);
+					lib_digitalio_pinoff(sckpin);
 					CLK_SysTickDelay(2);
 					TSdata = TSdata << 1;
 			}
-			lib_digitalio_setoutput(PIN_H107D_CAMERA_SCS, DIGITALON);
+			lib_digitalio_pinon(scspin);
 		}
 }
+
+/**
+ * @brief               Remember the frequency asked for by the handset
+ * @param[newfrequency] Frequency to apply.
+ * @return              None
+ * @note                Called from the rx code.  The camera is only updated by H107D_camera_update(),
+ *                      which runs in a slow task slot of the main loop.
+ */
+void H107D_camera_request_frequency(uint16_t newfrequency)
+{
+    requestedfrequency = newfrequency;
+}
+
+/**
+ * @brief      Send the last requested frequency to the camera, if it changed
+ * @param      None.
+ * @return     None
+ */
+void H107D_camera_update(void)
+{
+    if (requestedfrequency)
+        H107D_camera_update_frequency(requestedfrequency);
+}
@@ -17,3 +17,5 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 void H107D_camera_init(void);
 void H107D_camera_update_frequency(uint16_t newfrequency);
+void H107D_camera_request_frequency(uint16_t newfrequency);
+void H107D_camera_update(void);
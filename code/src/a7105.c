@@ -18,6 +18,30 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "a7105.h"
 #include "lib_soft_3_wire_spi.h"
 
+// Shadow of the control registers.  Apart from MODE, CALC and the FIFO and ID data ports, the A7105 keeps
+// whatever was last written to a register, so writing the same value again is skipped.  Writing MODE resets
+// the chip, which forgets the shadow too.  After a chip select, strobes may come first, then one address byte.
+// Every byte after that goes to that same address, which is how the FIFO and ID bursts below work, so a run of
+// control registers can't share a frame and the shadow is where the saving comes from.
+#define A7105_NUMREGISTERS 0x33
+
+static uint8_t shadowvalue[A7105_NUMREGISTERS];
+static uint8_t shadowvalid[(A7105_NUMREGISTERS + 7) / 8];
+static uint32_t savedbytes;
+
+static void A7105_ForgetShadow(void)
+{
+    uint8_t i;
+    for (i=0;i<sizeof(shadowvalid);i++)
+        shadowvalid[i] = 0;
+}
+
+static uint8_t A7105_IsShadowed(uint8_t address)
+{
+    return address != A7105_00_MODE && address != A7105_02_CALC && address != A7105_05_FIFO_DATA
+        && address != A7105_06_ID_DATA && address < A7105_NUMREGISTERS;
+}
+
 void A7105_WriteID(uint32_t ida) 
 {
     lib_soft_3_wire_spi_setCS(DIGITALOFF);
@@ -42,9 +66,17 @@ void A7105_ReadID(uint8_t *_aid)
 }
 
 void A7105_WritePayload(uint8_t *_packet, uint8_t len) 
+{
+    A7105_StrobeAndWritePayload(A7105_RST_WRPTR, _packet, len);
+}
+
+// a strobe can start the frame, so the mode change and the payload cost one chip select
+void A7105_StrobeAndWritePayload(uint8_t command, uint8_t *_packet, uint8_t len) 
 {
     uint8_t i;
     lib_soft_3_wire_spi_setCS(DIGITALOFF);
+    if (command != A7105_RST_WRPTR)
+        lib_soft_3_wire_spi_write(command);
     lib_soft_3_wire_spi_write(A7105_RST_WRPTR);
     lib_soft_3_wire_spi_write(0x05);
     for (i=0;i<len;i++) {
@@ -53,15 +85,30 @@ void A7105_WritePayload(uint8_t *_packet, uint8_t len)
     lib_soft_3_wire_spi_setCS(DIGITALON);
 }
 
-void A7105_ReadPayload(uint8_t *_packet, uint8_t len) 
+// always reads from the start of the FIFO, no separate RST_RDPTR strobe is needed.  Returns the sum of the
+// bytes read, so a checksum can be checked without going over the packet again.
+uint8_t A7105_ReadPayload(uint8_t *_packet, uint8_t len) 
 {
-    uint8_t i;
+    uint8_t i, sum=0;
     lib_soft_3_wire_spi_setCS(DIGITALOFF);
+    lib_soft_3_wire_spi_write(A7105_RST_RDPTR);
     lib_soft_3_wire_spi_write(0x45);
     for (i=0;i<len;i++) {
         _packet[i]=lib_soft_3_wire_spi_read();
+        sum += _packet[i];
     }
     lib_soft_3_wire_spi_setCS(DIGITALON);
+    return sum;
+}
+
+// returns 1 and reads the payload once the radio has left RX with a packet, 0 while it is still listening.
+// MODE and the FIFO are two addresses, so this is two frames once a packet is in and one while listening.
+uint8_t A7105_ReadPayloadIfReceived(uint8_t *_packet, uint8_t len)
+{
+    if (A7105_ReadRegister(A7105_00_MODE) & A7105_MODE_TRER_MASK)
+        return 0;
+    A7105_ReadPayload(_packet, len);
+    return 1;
 }
 
 void A7105_Reset(void) 
@@ -82,6 +129,17 @@ uint8_t A7105_ReadRegister(uint8_t address)
 
 void A7105_WriteRegister(uint8_t address, uint8_t data) 
 {
+    if (A7105_IsShadowed(address)) {
+        uint8_t bit = 1 << (address & 7);
+        if ((shadowvalid[address >> 3] & bit) && shadowvalue[address] == data) {
+            savedbytes += 2;
+            return;
+        }
+        shadowvalue[address] = data;
+        shadowvalid[address >> 3] |= bit;
+    } else if (address == A7105_00_MODE)
+        A7105_ForgetShadow();
+
     lib_soft_3_wire_spi_setCS(DIGITALOFF);
     lib_soft_3_wire_spi_write(address); 
     lib_soft_3_wire_spi_write(data);  
@@ -94,3 +152,9 @@ void A7105_Strobe(uint8_t command)
     lib_soft_3_wire_spi_write(command);
     lib_soft_3_wire_spi_setCS(DIGITALON);
 }
+
+// SPI bytes that the register shadow didn't have to send
+uint32_t A7105_GetSavedBytes(void)
+{
+    return savedbytes;
+}
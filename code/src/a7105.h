@@ -72,8 +72,11 @@
 void A7105_WriteID(uint32_t ida);
 void A7105_ReadID(uint8_t *_aid);
 void A7105_WritePayload(uint8_t *_packet, uint8_t len);
-void A7105_ReadPayload(uint8_t *_packet, uint8_t len);
+void A7105_StrobeAndWritePayload(uint8_t command, uint8_t *_packet, uint8_t len);
+uint8_t A7105_ReadPayload(uint8_t *_packet, uint8_t len);
+uint8_t A7105_ReadPayloadIfReceived(uint8_t *_packet, uint8_t len);
 void A7105_Reset(void);
 uint8_t A7105_ReadRegister(uint8_t address);
 void A7105_WriteRegister(uint8_t address, uint8_t data);
 void A7105_Strobe(uint8_t command);
+uint32_t A7105_GetSavedBytes(void);
@@ -29,15 +29,43 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 extern globalstruct global;
 
-#if (ACCELEROMETER_TYPE==MC3210)
+#if (ACCELEROMETER_TYPE==MC3210 || ACCELEROMETER_TYPE==MC3210_VIA_MPU6050)
 
 #if !defined(MC3210_ADDRESS)
 #define MC3210_ADDRESS	0x4C
 #endif
 
+#if (ACCELEROMETER_TYPE==MC3210_VIA_MPU6050)
+// The MC3210 is read by the MPU6050's auxiliary I2C master instead of by us, so that readgyro() gets both sensors
+// in one burst.  This needs the MC3210 on the MPU6050's auxiliary bus (or on a bus it can reach), and it uses
+// slave 0, so it can't be used with HMC5883_VIA_MPU6050.
+#if (GYRO_TYPE!=MPU6050)
+#error "MC3210_VIA_MPU6050 needs an MPU6050 gyro"
+#endif
+#if (COMPASS_TYPE==HMC5883_VIA_MPU6050)
+#error "MC3210_VIA_MPU6050 and HMC5883_VIA_MPU6050 both use the MPU6050's slave 0"
+#endif
+
+#define MPU6050_ADDRESS     0x68
+
+// The auxiliary master runs at the gyro's sample rate: 8 kHz with GYRO_LOW_PASS_FILTER 0, otherwise 1 kHz
+// (GYRO_FIFO always sets 1 kHz).  The MC3210 only needs 1 kHz.
+#if (GYRO_LOW_PASS_FILTER==0 && GYRO_FIFO!=YES)
+#define MC3210_VIA_MPU6050_DELAY 7
+#else
+#define MC3210_VIA_MPU6050_DELAY 0
+#endif
+
+extern unsigned char mpu6050sensordata[12];     // filled in by readgyro(): 6 bytes of gyro, then 6 bytes of MC3210
+#endif
+
 void initacc(void)
 {
     lib_timers_delaymilliseconds(10);
+#if (ACCELEROMETER_TYPE==MC3210_VIA_MPU6050)
+    // Put the gyro in i2c bypass mode so we can talk directly to the accelerometer to set it up
+    lib_i2c_writereg(MPU6050_ADDRESS, 0x37, 0x02);      //INT_PIN_CFG   -- I2C_BYPASS_EN=1
+#endif
     // Mode register: standby mode
     lib_i2c_writereg( MC3210_ADDRESS, 0x07, 0x03);
     // INTEN register: disable interrupts
@@ -49,12 +77,29 @@ void initacc(void)
     lib_i2c_writereg( MC3210_ADDRESS, 0x20, 0xBF);
     // Mode register: wake mode
     lib_i2c_writereg( MC3210_ADDRESS, 0x07, 0x01);
+#if (ACCELEROMETER_TYPE==MC3210_VIA_MPU6050)
+    // now configure the MPU6050 as an I2C master that copies the MC3210's six data bytes to EXT_SENS_DATA_00 every sample
+    unsigned char userctrl = lib_i2c_readreg(MPU6050_ADDRESS, 0x6A);   // keep FIFO_EN if initgyro() set it
+    lib_i2c_writereg(MPU6050_ADDRESS, 0x6A, userctrl | 0x20);   //USER_CTRL     -- I2C_MST_EN=1 (I2C master mode)
+    lib_i2c_writereg(MPU6050_ADDRESS, 0x37, 0x00);      //INT_PIN_CFG   -- I2C_BYPASS_EN=0
+    lib_i2c_writereg(MPU6050_ADDRESS, 0x24, 0x0D);      //I2C_MST_CTRL  -- MULT_MST_EN=0 ; WAIT_FOR_ES=0 ; SLV_3_FIFO_EN=0 ; I2C_MST_P_NSR=0 ; I2C_MST_CLK=13 (I2C slave speed bus = 400kHz)
+    lib_i2c_writereg(MPU6050_ADDRESS, 0x25, 0x80 | MC3210_ADDRESS);     //I2C_SLV0_ADDR -- I2C_SLV0_RW=1 (read operation) ; I2C_SLV0_ADDR=MC3210_ADDRESS
+    lib_i2c_writereg(MPU6050_ADDRESS, 0x26, 0x0D);      //I2C_SLV0_REG  -- starting at XOUT_EX_L
+    lib_i2c_writereg(MPU6050_ADDRESS, 0x27, 0x86);      //I2C_SLV0_CTRL -- I2C_SLV0_EN=1 ; I2C_SLV0_BYTE_SW=0 ; I2C_SLV0_REG_DIS=0 ; I2C_SLV0_GRP=0 ; I2C_SLV0_LEN=6
+    lib_i2c_writereg(MPU6050_ADDRESS, 0x34, MC3210_VIA_MPU6050_DELAY);  //I2C_SLV4_CTRL -- I2C_MST_DLY: read every 1+MC3210_VIA_MPU6050_DELAY samples
+    lib_i2c_writereg(MPU6050_ADDRESS, 0x67, 0x01);      //I2C_MST_DELAY_CTRL -- I2C_SLV0_DLY_EN=1
+#endif
 }
 
 void readacc(void)
 {
+#if (ACCELEROMETER_TYPE==MC3210_VIA_MPU6050)
+    // readgyro() has already read them
+    unsigned char *data = &mpu6050sensordata[6];
+#else
     unsigned char data[6];
     lib_i2c_readdata( MC3210_ADDRESS, 0x0D, (unsigned char *)&data, 6);
+#endif
     // convert readings to fixedpointnum (in g's)
     // Sensor output is 14 bit signed, sign extended to 16 bit, full scale +/- 8g
     // So we have 13 bit fractional part, need to shift that to FIXEDPOINTSHIFT and
@@ -42,6 +42,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "bradwii.h"
 #include "eeprom.h"
 #include "autotune.h"
+#include "imu.h"
 
 extern globalstruct global;
 extern usersettingsstruct usersettings;
@@ -66,6 +67,8 @@ char cyclecount = 1;
 
 void autotune(fixedpointnum * angleerror, unsigned char startingorstopping)
 {
+    imuupdateeulerattitude();
+
     if (!global.armed) {
         // we aren't armed.  Don't do anything, but if autotuning is started and we have collected
         // autotuning data, save our settings to eeprom
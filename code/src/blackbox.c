@@ -0,0 +1,250 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "hal.h"
+
+#include "bradwii.h"
+#include "blackbox.h"
+
+extern globalstruct global;
+
+#if (BLACKBOX==YES)
+
+#define BLACKBOXSTATEOFF 0      // not armed, the log of the last flight is in the flash
+#define BLACKBOXSTATEWINDOW 1   // armed, the newest frames are kept in RAM until something triggers the log
+#define BLACKBOXSTATERECORDING 2        // triggered, the window and the frames after it go to the flash
+#define BLACKBOXSTATEFULL 3     // armed, but there is no more room in the flash
+
+#define BLACKBOXMAXKEYFRAMES 8  // a frame is at least BLACKBOXNUMFIELDS + 1 bytes, the window holds fewer groups
+
+#if (BLACKBOX_WINDOW & (BLACKBOX_WINDOW - 1)) || BLACKBOX_WINDOW + BLACKBOXHEADERSIZE > BLACKBOXSIZE
+#error BLACKBOX_WINDOW has to be a power of 2 that fits in the blackbox pages with the header
+#endif
+
+typedef struct {
+    unsigned char buffer[BLACKBOX_WINDOW];      // the window before the trigger, then frames waiting for the flash
+    unsigned short head;
+    unsigned short tail;
+    unsigned short keyframe[BLACKBOXMAXKEYFRAMES];      // where the 'I' frames in the window start, oldest first
+    unsigned char keyframes;
+    unsigned char state;
+    unsigned char passes;       // since the last frame
+    unsigned char frames;       // since the last 'I' frame
+    unsigned short skippedframes;
+    unsigned long flashindex;   // where the next word goes
+    long previous[BLACKBOXNUMFIELDS];
+} blackboxstruct;
+
+blackboxstruct blackbox;
+
+static void blackboxput(unsigned char c)
+{
+    blackbox.buffer[blackbox.head] = c;
+    blackbox.head = (blackbox.head + 1) & (BLACKBOX_WINDOW - 1);
+}
+
+static unsigned short blackboxbuffered(void)
+{
+    return (blackbox.head - blackbox.tail) & (BLACKBOX_WINDOW - 1);
+}
+
+static unsigned short blackboxroom(void)
+{
+    return BLACKBOX_WINDOW - 1 - blackboxbuffered();
+}
+
+// before the trigger, the oldest frames make room for new ones.  They go from one 'I' frame to the next, so that the
+// window always starts with one.
+static bool blackboxdropoldest(void)
+{
+    if (blackbox.keyframes < 2)
+        return false;
+    blackbox.keyframes--;
+    for (int x = 0; x < blackbox.keyframes; ++x)
+        blackbox.keyframe[x] = blackbox.keyframe[x + 1];
+    blackbox.tail = blackbox.keyframe[0];
+    return true;
+}
+
+static unsigned char *blackboxputvarint(unsigned char *ptr, unsigned long value)
+{
+    while (value >= 0x80) {
+        *ptr++ = value | 0x80;
+        value >>= 7;
+    }
+    *ptr++ = value;
+    return ptr;
+}
+
+static void blackboxgetfields(long *field)
+{
+    for (int x = 0; x < 3; ++x)
+        *field++ = global.gyrorate[x] >> BLACKBOXGYROSHIFT;
+    for (int x = 0; x < 3; ++x)
+        *field++ = global.acc_g_vector[x] >> BLACKBOXACCSHIFT;
+    for (int x = 0; x < RXNUMCHANNELS; ++x)
+        *field++ = global.rxvalues[x] >> BLACKBOXRXSHIFT;
+    for (int x = 0; x < NUMMOTORS; ++x)
+        *field++ = global.motoroutputvalue[x];
+    *field++ = (global.timesliver * 15) >> 8;
+    *field++ = global.batteryvoltage >> BLACKBOXBATTERYSHIFT;
+}
+
+void blackboxarm(void)
+{
+    // called when the aircraft is armed, before the main loop runs with it armed.  Each page erase stops the cpu,
+    // so they are all done here, while the motors are still off, and the main loop only ever programs words.
+    const unsigned char header[BLACKBOXHEADERSIZE] = {
+        BLACKBOXMAGIC[0], BLACKBOXMAGIC[1], BLACKBOXMAGIC[2], BLACKBOXMAGIC[3],
+        BLACKBOX_DIVISOR, RXNUMCHANNELS, NUMMOTORS, BLACKBOXKEYFRAMEINTERVAL,
+        BLACKBOXGYROSHIFT, BLACKBOXACCSHIFT, BLACKBOXRXSHIFT, BLACKBOXBATTERYSHIFT,
+        CONTROL_LOOP_FREQUENCY & 0xFF, CONTROL_LOOP_FREQUENCY >> 8, 0, 0
+    };
+
+    memset(&blackbox, 0, sizeof(blackbox));
+    for (int x = 0; x < BLACKBOX_PAGES; ++x)
+        blackbox_erase_page(x);
+    for (int x = 0; x < BLACKBOXHEADERSIZE; x += 4) {
+        uint32_t word;
+        memcpy(&word, &header[x], 4);
+        blackbox_write_word(x, word);
+    }
+    blackbox.flashindex = BLACKBOXHEADERSIZE;
+    blackbox.state = BLACKBOXSTATEWINDOW;
+}
+
+static unsigned char blackboxencode(unsigned char *frame, long *field, bool keyframe)
+{
+    unsigned char *ptr = frame;
+    if (blackbox.skippedframes) {
+        *ptr++ = 'S';
+        ptr = blackboxputvarint(ptr, blackbox.skippedframes);
+    }
+    *ptr++ = keyframe ? 'I' : 'P';
+    for (int x = 0; x < BLACKBOXNUMFIELDS; ++x) {
+        long value = keyframe ? field[x] : field[x] - blackbox.previous[x];
+        ptr = blackboxputvarint(ptr, (value << 1) ^ (value >> 31));
+    }
+    return ptr - frame;
+}
+
+static void blackboxframe(void)
+{
+    // the largest frame, a tag and 5 bytes a field, is encoded on the stack and dropped if it doesn't fit
+    unsigned char frame[1 + 5 + BLACKBOXNUMFIELDS * 5];
+    long field[BLACKBOXNUMFIELDS];
+    bool keyframe = blackbox.frames == 0;
+
+    blackboxgetfields(field);
+    unsigned char size = blackboxencode(frame, field, keyframe);
+    if (blackbox.state == BLACKBOXSTATEWINDOW) {
+        if (keyframe && blackbox.keyframes == BLACKBOXMAXKEYFRAMES)
+            blackboxdropoldest();
+        while (size > blackboxroom() && blackboxdropoldest());
+        if (size > blackboxroom()) {
+            // the frames since the last 'I' frame fill the window, start again from this one
+            blackbox.tail = blackbox.head;
+            blackbox.keyframes = 0;
+            keyframe = true;
+            size = blackboxencode(frame, field, keyframe);
+        }
+        if (keyframe)
+            blackbox.keyframe[blackbox.keyframes++] = blackbox.head;
+    }
+    if (size > blackboxroom()) {
+        blackbox.skippedframes++;
+        return;
+    }
+    for (int x = 0; x < size; ++x)
+        blackboxput(frame[x]);
+    memcpy(blackbox.previous, field, sizeof(field));
+    blackbox.skippedframes = 0;
+    blackbox.frames = keyframe ? 1 : blackbox.frames + 1;
+    if (blackbox.frames == BLACKBOXKEYFRAMEINTERVAL)
+        blackbox.frames = 0;
+}
+
+// the window goes to the flash from here on, with a 'T' and the reason after it
+static void blackboxtrigger(unsigned char reason)
+{
+    while (blackboxroom() < 2 && blackboxdropoldest());
+    if (blackboxroom() < 2)
+        blackbox.tail = blackbox.head;
+    blackboxput('T');
+    blackboxput(reason);
+    blackbox.state = BLACKBOXSTATERECORDING;
+}
+
+// one word of the buffer to the flash per pass, padded with 0xFF at the end of the log
+static void blackboxflush(bool ending)
+{
+    unsigned short buffered = blackboxbuffered();
+    if (!buffered || (buffered < 4 && !ending) || blackbox.flashindex >= BLACKBOXSIZE)
+        return;
+
+    uint32_t word = 0xFFFFFFFF;
+    for (int x = 0; x < 4 && x < buffered; ++x) {
+        ((unsigned char *) &word)[x] = blackbox.buffer[blackbox.tail];
+        blackbox.tail = (blackbox.tail + 1) & (BLACKBOX_WINDOW - 1);
+    }
+    blackbox_write_word(blackbox.flashindex, word);
+    blackbox.flashindex += 4;
+    if (blackbox.flashindex >= BLACKBOXSIZE)
+        blackbox.state = BLACKBOXSTATEFULL;
+}
+
+void blackboxrecord(void)
+{
+    // called once per pass through the main loop
+    if (!global.armed && blackbox.state != BLACKBOXSTATEOFF) {
+        // let the rest of the buffer out, the pages are erased so this doesn't stop for long
+        if (blackbox.state == BLACKBOXSTATEWINDOW)
+            blackboxtrigger(BLACKBOXTRIGGERDISARM);
+        while (blackboxbuffered() && blackbox.flashindex < BLACKBOXSIZE)
+            blackboxflush(true);
+        blackbox.state = BLACKBOXSTATEOFF;
+        return;
+    }
+    if (blackbox.state == BLACKBOXSTATEOFF)
+        return;
+
+    if (blackbox.state != BLACKBOXSTATEFULL && ++blackbox.passes >= BLACKBOX_DIVISOR) {
+        blackbox.passes = 0;
+        blackboxframe();
+    }
+    if (blackbox.state == BLACKBOXSTATEWINDOW) {
+        // an impact.  Only one axis over the limit is enough, and it needs no multiplies.
+        for (int x = 0; x < 3; ++x) {
+            if (lib_fp_abs(global.acc_g_vector[x]) > FIXEDPOINTCONSTANT(BLACKBOX_TRIGGER_G)) {
+                blackboxtrigger(BLACKBOXTRIGGERIMPACT);
+                break;
+            }
+        }
+    } else
+        blackboxflush(false);
+}
+
+size_t blackboxread(void *dst, unsigned long index, size_t size)
+{
+    // returns the number of bytes read, less than size at the end of the blackbox pages
+    if (index >= BLACKBOXSIZE)
+        return 0;
+    if (size > BLACKBOXSIZE - index)
+        size = BLACKBOXSIZE - index;
+    return blackbox_read_block(dst, index, size);
+}
+
+#endif
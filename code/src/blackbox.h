@@ -0,0 +1,65 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "defs.h"
+
+// Flight recorder in the data flash.  While armed, every BLACKBOX_DIVISOR passes through the main loop a frame of
+// the loop's inputs and outputs is encoded into a BLACKBOX_WINDOW byte buffer in RAM.  Until something triggers the
+// log, the oldest frames make room for the new ones, so the buffer holds the last seconds of the flight.  An impact
+// (BLACKBOX_TRIGGER_G on any axis of the accelerometer) or disarming triggers it: from then on one word of the buffer
+// is programmed into the blackbox pages per pass, and the frames after the trigger follow the window until the pages
+// are full or the aircraft is disarmed.  A page erase stops the cpu for about 20 ms, so blackboxarm() erases all of
+// the pages when the aircraft is armed, next to the gyro calibration that already holds it up, and writes the header.
+// The log of a flight stays in the flash until the next arming.  Set BLACKBOX to YES in your config file to enable
+// it.  Read the log with MSP_BLACKBOX_READ.
+//
+// The log starts with a BLACKBOXHEADERSIZE byte header: BLACKBOXMAGIC, then a byte each of BLACKBOX_DIVISOR,
+// RXNUMCHANNELS, NUMMOTORS, BLACKBOXKEYFRAMEINTERVAL and the gyro, acc, rx and battery shifts, then
+// CONTROL_LOOP_FREQUENCY in two bytes, low byte first, and two zero bytes.  Frames follow until the first 0xFF byte:
+//   'I' and the fields as zigzag varints
+//   'P' and each field minus its value in the previous frame, as zigzag varints
+//   'S' and a varint count of frames that were skipped because the RAM buffer was full
+//   'T' and a byte of BLACKBOXTRIGGERIMPACT or BLACKBOXTRIGGERDISARM, once, between the window and the frames after it
+// The window starts with an 'I' frame.
+// A varint is 7 bits a byte, low bits first, with the top bit set on all but the last byte.  Zigzag puts the sign
+// in the low bit: 0, -1, 1, -2 are 0, 1, 2, 3.  The fields are, in order:
+//   gyrorate[3]                in degrees per second >> BLACKBOXGYROSHIFT
+//   acc_g_vector[3]            in g >> BLACKBOXACCSHIFT
+//   rxvalues[RXNUMCHANNELS]    -1.0 to 1.0 >> BLACKBOXRXSHIFT
+//   motoroutputvalue[NUMMOTORS]
+//   timesliver                 in microseconds, as MSP_STATUS sends it
+//   batteryvoltage             in volts >> BLACKBOXBATTERYSHIFT
+
+#define BLACKBOXMAGIC "BBX2"
+#define BLACKBOXHEADERSIZE 16
+#define BLACKBOXGYROSHIFT 12    // 1/16 degree per second, about what the gyro resolves
+#define BLACKBOXACCSHIFT 8      // 1/256 g
+#define BLACKBOXRXSHIFT 8       // -256 to 256
+#define BLACKBOXBATTERYSHIFT 8  // 1/256 V
+#define BLACKBOXKEYFRAMEINTERVAL 4      // every 4th frame is an 'I' frame, the window loses 4 frames at a time
+
+#define BLACKBOXTRIGGERIMPACT 1
+#define BLACKBOXTRIGGERDISARM 2
+
+#define BLACKBOXNUMFIELDS (3 + 3 + RXNUMCHANNELS + NUMMOTORS + 2)
+#define BLACKBOXSIZE (BLACKBOX_PAGES * BLACKBOX_FLASH_PAGE_SIZE)
+
+#if (BLACKBOX==YES)
+void blackboxarm(void);
+void blackboxrecord(void);
+size_t blackboxread(void *dst, unsigned long index, size_t size);
+#endif
@@ -87,17 +87,12 @@ m
 #include "navigation.h"
 #include "pilotcontrol.h"
 #include "autotune.h"
+#include "profiler.h"
+#include "blackbox.h"
 #if CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107D 
 #include "H107D_camera.h"
 #endif
 
-// Data type for stick movement detection to execute accelerometer calibration
-typedef enum stickstate_tag {
-    STICK_STATE_START,   // No stick movement detected yet
-    STICK_STATE_LOW,     // Stick was low recently
-    STICK_STATE_HIGH     // Stick was high recently
-} stickstate_t;
-
 globalstruct global;            // global variables
 usersettingsstruct usersettings;        // user editable variables
 
@@ -118,18 +113,26 @@ fixedpointnum filteredgyrorate[3];
 #define FP_BATTERY_UNDERVOLTAGE_LIMIT FIXEDPOINTCONSTANT(BATTERY_UNDERVOLTAGE_LIMIT)
 #endif
 
-// Stick is moved out of middle position towards low
-#define FP_RXMOVELOW FIXEDPOINTCONSTANT(-0.2)
-// Stick is moved out of middle position towards high
-#define FP_RXMOVEHIGH FIXEDPOINTCONSTANT(0.2)
-
 // timesliver is a very small slice of time (.002 seconds or so).  This small value doesn't take much advantage
 // of the resolution of fixedpointnum, so we shift timesliver an extra TIMESLIVEREXTRASHIFT bits.
 unsigned long timeslivertimer = 0;
 
-// Local functions
-static void detectstickcommand(void);
-
+#if (CONTROL_LOOP_FREQUENCY != 0)
+// the time of one tick of the control loop, as a timesliver
+#define CONTROLLOOPTIMESLIVER ((FIXEDPOINTONE << TIMESLIVEREXTRASHIFT) / CONTROL_LOOP_FREQUENCY)
+
+// The slow tasks take turns, one each pass through the control loop
+#define SLOWTASKSLOTS 4
+#define SLOWTASKCHECKBOXES 0
+#define SLOWTASKSERIAL 1
+#define SLOWTASKBATTERYANDLEDS 2
+#define SLOWTASKCAMERA 3
+#define ISSLOWTASKSLOT(task) (slowtaskslot == (task))
+#else
+// without a control loop timer, the slow tasks all run every pass
+#define SLOWTASKSLOTS 1
+#define ISSLOWTASKSLOT(task) 1
+#endif
 
 // It all starts here:
 int main(void)
@@ -151,6 +154,9 @@ int main(void)
 		global.started = 0;
 #endif
     static bool isfailsafeactive;     // true while we don't get new data from transmitter
+#if (CONTROL_LOOP_FREQUENCY != 0)
+    static unsigned char slowtaskslot;        // which slow task runs this pass
+#endif
 
     // initialize hardware
 	  lib_hal_init();
@@ -166,6 +172,10 @@ int main(void)
 
     //initialize the libraries that require initialization
     lib_timers_init();
+#if (CONTROL_LOOP_FREQUENCY != 0)
+    // start the control loop tick now, calculatetimesliver() waits for it from the calibration on
+    lib_timers_startperiodictick(CONTROL_LOOP_FREQUENCY);
+#endif
     lib_i2c_init();
 
 #if CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107L || CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107D 
@@ -199,6 +209,39 @@ int main(void)
     initacc();
     initimu();
 
+    // Calibrate the gyro and, with an RX that has to bind, pair with the handset at the same time.  Getting
+    // ready takes as long as the slower of the two.
+    bool calibrated = false;
+    global.startupboundtime = 0;
+    for (;;) {
+        if (!calibrated) {
+            calibrated = gyroandaccelerometercalibrationstep();
+            if (calibrated)
+                global.startupcalibratedtime = lib_timers_starttimer();
+        } else
+            calculatetimesliver();
+#if (RX_TYPE==RX_SOFT_3_WIRE_SPI_PROTOCOL)
+        if (!rxbound()) {
+            readrx();
+            if (rxbound())
+                global.startupboundtime = lib_timers_starttimer();
+            else if (calibrated) {
+                // still waiting for the handset
+                if( lib_timers_starttimer() % 500000 > 250000)
+                    x4_set_leds(X4_LED_FR | X4_LED_RL);
+                else
+                    x4_set_leds(X4_LED_FL | X4_LED_RR);
+            }
+        }
+        if (calibrated && rxbound())
+            break;
+#else
+        if (calibrated)
+            break;
+#endif
+    }
+    global.startupreadytime = lib_timers_starttimer();
+
 #if (CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107L || CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107D )
     x4_set_leds(X4_LED_ALL);
     // Measure internal bandgap voltage now.
@@ -228,19 +271,18 @@ int main(void)
     global.armed = 0;
     global.navigationmode = NAVIGATIONMODEOFF;
     global.failsafetimer = lib_timers_starttimer();
+#if (LOOP_PROFILER==YES)
+    initprofiler();
+#endif
     for (;;) {
 
-        // check to see what switches are activated
-        checkcheckboxitems();
-
-#if (MULTIWII_CONFIG_SERIAL_PORTS != NOSERIALPORT)
-        // check for config program activity
-        serialcheckforaction();
-#endif
+        // wait for the control loop tick, or measure the time of the last pass when there is no timer
         calculatetimesliver();
+        profilerendstage(PROFILERSTAGETIMESLIVER);
 
         // run the imu to estimate the current attitude of the aircraft
         imucalculateestimatedattitude();
+        profilerendstage(PROFILERSTAGEIMU);
 
 				if (!global.armed) {
 					
@@ -346,6 +388,9 @@ int main(void)
 						global.started = 0;
 						global.armed = 1;
 						calibrategyroandaccelerometer(true);
+#if (BLACKBOX==YES)
+						blackboxarm();
+#endif
 					}
 				} else {
 					if (global.rxvalues[THROTTLEINDEX] < FPSTICKLOW && global.rxvalues[YAWINDEX] < FPSTICKX4LOW) {
@@ -354,9 +399,11 @@ int main(void)
 						global.started = 1;
 					}
 				}
+        profilerendstage(PROFILERSTAGEARMING);
 
         // read the receiver
         readrx();
+        profilerendstage(PROFILERSTAGERX);
 
         // get the angle error.  Angle error is the difference between our current attitude and our desired attitude.
         // It can be set by navigation, or by the pilot, etc.
@@ -395,7 +442,7 @@ int main(void)
         fixedpointnum gainschedulingmultiplier = lib_fp_multiply(throttleoutput - FIXEDPOINTCONSTANT(.5), FIXEDPOINTCONSTANT(GAIN_SCHEDULING_FACTOR)) + FIXEDPOINTONE;
 
         for (int x = 0; x < 3; ++x) {
-            integratedangleerror[x] += lib_fp_multiply(angleerror[x], global.timesliver);
+            lib_fp_multiplyaccumulate(&integratedangleerror[x], angleerror[x], global.timesliver);
 						//filteredgyrorate[x] = (lib_fp_multiply(global.gyrorate[x], FIXEDPOINTCONSTANT(1)) + lib_fp_multiply(filteredgyrorate[x], FIXEDPOINTCONSTANT(1))) >> 1;
 						//lib_fp_lowpassfilter(&filteredgyrorate[x], global.gyrorate[x], global.timesliver, FIXEDPOINTONEOVERONESIXTYITH, TIMESLIVEREXTRASHIFT);
 
@@ -419,6 +466,7 @@ int main(void)
         pidoutput[YAWINDEX] = -pidoutput[YAWINDEX];
 
         lib_fp_constrain(&throttleoutput, 0, FIXEDPOINTONE);
+        profilerendstage(PROFILERSTAGEPID);
 
         // set the final motor outputs
         // if we aren't armed, or if we desire to have the motors stop, AfterFPSTICKLOW  && global.flymode == LEVELFLIGHTMODE
@@ -431,87 +479,131 @@ int main(void)
             setmotoroutput(2, 2, throttleoutput + pidoutput[ROLLINDEX] + pidoutput[PITCHINDEX] + pidoutput[YAWINDEX]);
             setmotoroutput(3, 3, throttleoutput + pidoutput[ROLLINDEX] - pidoutput[PITCHINDEX] - pidoutput[YAWINDEX]);
         }
+        profilerendstage(PROFILERSTAGEMIXER);
+
+#if (BLACKBOX==YES)
+        // record this pass, and program a word of the log into the data flash
+        blackboxrecord();
+        profilerendstage(PROFILERSTAGEBLACKBOX);
+#endif
+
+        // The rest doesn't need to run at the control loop rate
+#if (CONTROL_LOOP_FREQUENCY != 0)
+        slowtaskslot = (slowtaskslot + 1) & (SLOWTASKSLOTS - 1);
+#endif
+
+        if (ISSLOWTASKSLOT(SLOWTASKCHECKBOXES)) {
+            // check to see what switches are activated
+            checkcheckboxitems();
+            profilerendstage(PROFILERSTAGECHECKBOXES);
+        }
+
+        if (ISSLOWTASKSLOT(SLOWTASKSERIAL)) {
+#if (MULTIWII_CONFIG_SERIAL_PORTS != NOSERIALPORT)
+            // check for config program activity
+            serialcheckforaction();
+#endif
+            profilerendstage(PROFILERSTAGESERIAL);
+        }
+
+#if CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107D
+        if (ISSLOWTASKSLOT(SLOWTASKCAMERA)) {
+            // send the video channel the handset asked for to the camera
+            H107D_camera_update();
+            profilerendstage(PROFILERSTAGECAMERA);
+        }
+#endif
 
 #if (CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107L || CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107D )
-        // Measure battery voltage
-        if(!lib_adc_is_busy())
-        {
-            // What did we just measure?
-            // Always alternate between reference channel
-            // and battery voltage
-            if(isadcchannelref) {
-                bandgapvoltageraw = lib_adc_read_raw();
-                isadcchannelref = false;
-                lib_adc_select_channel(LIB_ADC_CHAN5);
-            } else {
-                batteryvoltageraw = lib_adc_read_raw();
-                isadcchannelref = true;
-                lib_adc_select_channel(LIB_ADC_CHANREF);
-
-                // Unfortunately we have to use fixed point division now
-                batteryvoltage = (batteryvoltageraw << 12) / (bandgapvoltageraw >> (FIXEDPOINTSHIFT-12));
-                // Now we have battery voltage relative to bandgap reference voltage.
-                // Multiply by initially measured bandgap voltage to get the voltage at the ADC pin.
-                batteryvoltage = lib_fp_multiply(batteryvoltage, initialbandgapvoltage);
-                // Now take the voltage divider into account to get battery voltage.
-                batteryvoltage = lib_fp_multiply(batteryvoltage, FP_BATTERY_VOLTAGE_FACTOR);
-
-                // Since we measure under load, the voltage is not stable.
-                // Apply 0.5 second lowpass filter.
-                // Use constant FIXEDPOINTONEOVERONEFOURTH instead of FIXEDPOINTONEOVERONEHALF
-                // Because we call this only every other iteration.
-                // (...alternatively multiply global.timesliver by two).
-                lib_fp_lowpassfilter(&(global.batteryvoltage), batteryvoltage, global.timesliver, FIXEDPOINTONEOVERONEFOURTH, TIMESLIVEREXTRASHIFT);
-                // Update state of isbatterylow flag.
-                if(global.batteryvoltage < FP_BATTERY_UNDERVOLTAGE_LIMIT)
-                    isbatterylow = true;
+        if (ISSLOWTASKSLOT(SLOWTASKBATTERYANDLEDS)) {
+            // Measure battery voltage
+            if(!lib_adc_is_busy())
+            {
+                // What did we just measure?
+                // Always alternate between reference channel
+                // and battery voltage
+                if(isadcchannelref) {
+                    bandgapvoltageraw = lib_adc_read_raw();
+                    isadcchannelref = false;
+                    lib_adc_select_channel(LIB_ADC_CHAN5);
+                } else {
+                    batteryvoltageraw = lib_adc_read_raw();
+                    isadcchannelref = true;
+                    lib_adc_select_channel(LIB_ADC_CHANREF);
+
+                    // Unfortunately we have to use fixed point division now
+                    batteryvoltage = (batteryvoltageraw << 12) / (bandgapvoltageraw >> (FIXEDPOINTSHIFT-12));
+                    // Now we have battery voltage relative to bandgap reference voltage.
+                    // Multiply by initially measured bandgap voltage to get the voltage at the ADC pin.
+                    batteryvoltage = lib_fp_multiply(batteryvoltage, initialbandgapvoltage);
+                    // Now take the voltage divider into account to get battery voltage.
+                    batteryvoltage = lib_fp_multiply(batteryvoltage, FP_BATTERY_VOLTAGE_FACTOR);
+
+                    // Since we measure under load, the voltage is not stable.
+                    // Apply 0.5 second lowpass filter.
+                    // Use constant FIXEDPOINTONEOVERONEFOURTH instead of FIXEDPOINTONEOVERONEHALF
+                    // Because we call this only every other iteration.
+                    // (...alternatively multiply global.timesliver by two).
+                    // The battery also only gets one pass in SLOWTASKSLOTS.
+                    lib_fp_lowpassfilter(&(global.batteryvoltage), batteryvoltage, global.timesliver * SLOWTASKSLOTS, FIXEDPOINTONEOVERONEFOURTH, TIMESLIVEREXTRASHIFT);
+                    // Update state of isbatterylow flag.
+                    if(global.batteryvoltage < FP_BATTERY_UNDERVOLTAGE_LIMIT)
+                        isbatterylow = true;
+                    else
+                        isbatterylow = false;
+                }
+                // Start next conversion
+                lib_adc_startconv();
+            } // IF ADC result available
+
+            // Decide what LEDs have to show
+            if(isbatterylow) {
+                // Highest priority: Battery voltage
+                // Blink all LEDs slow
+                if(lib_timers_gettimermicroseconds(0) % 500000 > 250000)
+                    x4_set_leds(X4_LED_ALL);
                 else
-                    isbatterylow = false;
+                    x4_set_leds(X4_LED_NONE);
             }
-            // Start next conversion
-            lib_adc_startconv();
-        } // IF ADC result available
-
-        // Decide what LEDs have to show
-        if(isbatterylow) {
-            // Highest priority: Battery voltage
-            // Blink all LEDs slow
-            if(lib_timers_gettimermicroseconds(0) % 500000 > 250000)
-                x4_set_leds(X4_LED_ALL);
-            else
-                x4_set_leds(X4_LED_NONE);
-        }
-        else if(isfailsafeactive) {
-            // Lost contact with TX
-            // Blink LEDs fast alternating
-            if(lib_timers_gettimermicroseconds(0) % 250000 > 120000)
-                x4_set_leds(X4_LED_FR | X4_LED_RL);
-            else
-                x4_set_leds(X4_LED_FL | X4_LED_RR);
-        }
-        else if(!global.armed) {
-            // Not armed
-            // Short blinks
-            if(lib_timers_gettimermicroseconds(0) % 500000 > 450000)
+            else if(isfailsafeactive) {
+                // Lost contact with TX
+                // Blink LEDs fast alternating
+                if(lib_timers_gettimermicroseconds(0) % 250000 > 120000)
+                    x4_set_leds(X4_LED_FR | X4_LED_RL);
+                else
+                    x4_set_leds(X4_LED_FL | X4_LED_RR);
+            }
+            else if(!global.armed) {
+                // Not armed
+                // Short blinks
+                if(lib_timers_gettimermicroseconds(0) % 500000 > 450000)
+                    x4_set_leds(X4_LED_ALL);
+                else
+                    x4_set_leds(X4_LED_NONE);
+            }
+            else {
+                // LEDs stay on
                 x4_set_leds(X4_LED_ALL);
-            else
-                x4_set_leds(X4_LED_NONE);
-        }
-        else {
-            // LEDs stay on
-            x4_set_leds(X4_LED_ALL);
-        }
+            }
 
+            profilerendstage(PROFILERSTAGEBATTERYANDLEDS);
+        }
 #endif
     } // Endless loop
 } // main()
 
 void calculatetimesliver(void)
 {
+#if (CONTROL_LOOP_FREQUENCY != 0)
+    // wait for the next control loop tick.  Ticks are all the same length, so there is nothing to measure.
+    // If the last pass ran over, more than one tick has gone by.
+    global.timesliver = lib_timers_waitforperiodictick() * CONTROLLOOPTIMESLIVER;
+#else
     // load global.timesliver with the amount of time that has passed since we last went through this loop
     // convert from microseconds to fixedpointnum seconds shifted by TIMESLIVEREXTRASHIFT
     // 4295L is (FIXEDPOINTONE<<FIXEDPOINTSHIFT)*.000001
     global.timesliver = (lib_timers_gettimermicrosecondsandreset(&timeslivertimer) * 4295L) >> (FIXEDPOINTSHIFT - TIMESLIVEREXTRASHIFT);
+#endif
 
     // don't allow big jumps in time because of something slowing the update loop down (should never happen anyway)
     if (global.timesliver > (FIXEDPOINTONEFIFTIETH << TIMESLIVEREXTRASHIFT))
@@ -569,64 +661,3 @@ void defaultusersettings(void)
     usersettings.fhsize = 0;
 #endif
 }
-
-// Executes command based on stick movements.
-// Call this only when not armed.
-// Currently implemented: accelerometer calibration
-static void detectstickcommand(void) {
-    // Timeout for stick movements for accelerometer calibration
-    static uint32_t stickcommandtimer;
-    // Keeps track of roll stick movements while not armed to execute accelerometer calibration.
-    static stickstate_t lastrollstickstate = STICK_STATE_START;
-    // Counts roll stick movements
-    static uint8_t rollmovecounter;
-
-    // Accelerometer calibration (3x back and forth movement of roll stick while
-    // throttle is in lowest position)
-    if (global.rxvalues[THROTTLEINDEX] < FPSTICKLOW) {
-        if (global.rxvalues[ROLLINDEX] < FP_RXMOVELOW) {
-            // Stick is now low. What has happened before?
-            if(lastrollstickstate == STICK_STATE_START) {
-                // We just come from start position, so this is our first movement
-                rollmovecounter=1;
-                lastrollstickstate = STICK_STATE_LOW;
-                // Detected stick movement, so restart timeout.
-                stickcommandtimer = lib_timers_starttimer();
-            } else if (lastrollstickstate == STICK_STATE_HIGH) {
-                // Stick had been high recently, so increment counter
-                rollmovecounter++;
-                lastrollstickstate = STICK_STATE_LOW;
-                // Detected stick movement, so restart timeout.
-                stickcommandtimer = lib_timers_starttimer();
-            } // else: nothing happened, nothing to do
-        } else if (global.rxvalues[ROLLINDEX] > FP_RXMOVEHIGH) {
-            // And now the same in opposite direction...
-            if(lastrollstickstate == STICK_STATE_START) {
-                // We just come from start position
-                rollmovecounter=1;
-                lastrollstickstate = STICK_STATE_HIGH;
-                // Detected stick movement, so restart timeout.
-                stickcommandtimer = lib_timers_starttimer();
-            } else if (lastrollstickstate == STICK_STATE_LOW) {
-                // Stick had been low recently, so increment counter
-                rollmovecounter++;
-                lastrollstickstate = STICK_STATE_HIGH;
-                // Detected stick movement, so restart timeout.
-                stickcommandtimer = lib_timers_starttimer();
-            } // else: nothing happened, nothing to do
-        }
-
-        if(lib_timers_gettimermicroseconds(stickcommandtimer) > 1000000L) {
-            // Timeout: last detected stick movement was more than 1 second ago.
-            lastrollstickstate = STICK_STATE_START;
-        }
-
-        if(rollmovecounter == 6) {
-            // Now we had enough movements. Execute calibration.
-            calibrategyroandaccelerometer(true);
-            // Save in EEPROM
-            writeusersettingstoeeprom();
-            lastrollstickstate = STICK_STATE_START;
-        }
-    } // if throttle low
-} // checkforstickcommand()
@@ -62,6 +62,7 @@ typedef struct {
     fixedpointnum debugvalue[4];        // for display in the multiwii config program. Use for debugging.
     fixedpointnum timesliver;   // The time in seconds (shifted TIMESLIVEREXTRASHIFT) since the last iteration of the main loop
     fixedpointnum gyrorate[3];  // Corrected gyro rates in degrees per second
+    fixedpointnum gyrotimesliver;       // The time (shifted TIMESLIVEREXTRASHIFT) that gyrorate covers, when GYRO_FIFO is YES
     fixedpointnum acc_g_vector[3];      // Corrected accelerometer vector, in G's
     fixedpointnum altitude;     // A filtered version of the baromemter's altitude
     fixedpointnum altitudevelocity;     // The rate of change of the altitude
@@ -90,6 +91,9 @@ typedef struct {
     uint32_t      failsafetimer;        // Timer for determining if we lose radio contact
     fixedpointnum batteryvoltage;       // Battery voltage, fixed point in Volt
     uint16_t      camera_frequency;
+    uint32_t      startupcalibratedtime;        // Microseconds from power on to the end of the gyro calibration
+    uint32_t      startupboundtime;     // Microseconds from power on until the handset was bound (when the RX binds)
+    uint32_t      startupreadytime;     // Microseconds from power on to the start of the main loop
 		unsigned char flymode;  // Set to 1 for accro , 2 for semiaccro , 3 for level
 		unsigned char started; // Set to 0 if waiting to start , 1 if started
 } globalstruct;
@@ -20,6 +20,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 extern usersettingsstruct usersettings;
 
+// resolved once by x4_init_leds(), x4_set_leds() runs every loop pass
+static digitalpin led1pin, led2pin, led5pin, led6pin;
+
 /* The Hubsan X4 does not have a serial port to connect it
    to a GUI such as MultiwiiConfig GUI, settings are configured
    from here until a better solution is found */
@@ -69,13 +72,17 @@ void x4_init_leds()
     lib_digitalio_initpin(LED2_OUTPUT, DIGITALOUTPUT);
     lib_digitalio_initpin(LED5_OUTPUT, DIGITALOUTPUT);
     lib_digitalio_initpin(LED6_OUTPUT, DIGITALOUTPUT);
+    led1pin = lib_digitalio_getpin(LED1_OUTPUT);
+    led2pin = lib_digitalio_getpin(LED2_OUTPUT);
+    led5pin = lib_digitalio_getpin(LED5_OUTPUT);
+    led6pin = lib_digitalio_getpin(LED6_OUTPUT);
 }
 
 void x4_set_leds(unsigned char state)
 {
-  lib_digitalio_setoutput( LED1_OUTPUT , (state & 0x01) ? LED1_ON : !LED1_ON);
-	lib_digitalio_setoutput( LED2_OUTPUT , (state & 0x02) ? LED2_ON : !LED2_ON);
-	lib_digitalio_setoutput( LED5_OUTPUT , (state & 0x04) ? LED5_ON : !LED5_ON);
- 	lib_digitalio_setoutput( LED6_OUTPUT , (state & 0x08) ? LED6_ON : !LED6_ON);
+    lib_digitalio_pinset(led1pin, (state & 0x01) ? LED1_ON : !LED1_ON);
+    lib_digitalio_pinset(led2pin, (state & 0x02) ? LED2_ON : !LED2_ON);
+    lib_digitalio_pinset(led5pin, (state & 0x04) ? LED5_ON : !LED5_ON);
+    lib_digitalio_pinset(led6pin, (state & 0x08) ? LED6_ON : !LED6_ON);
 }
 
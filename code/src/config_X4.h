@@ -130,6 +130,20 @@ void x4_set_leds(unsigned char state);
 #define STICK_RANGE_LOW 1150
 #define STICK_RANGE_HIGH 1850
 
+// un-comment to keep the attitude as a quaternion, with gyro bias correction, instead of separate down and west vectors.
+// It holds up better in hard acro flight, and with the accelerometer correction worked out at 50 Hz a pass takes
+// about as many multiplies as with the vectors (24.5 against 25.7 in the sim's flight).
+//#define ATTITUDE_ESTIMATOR ATTITUDE_ESTIMATOR_QUATERNION
+//#define GYRO_BIAS_TIME_PERIOD 20.0
+
+// un-comment to have the MPU6050's auxiliary I2C master read the MC3210, so that one burst reads both sensors.
+// Only for boards where the MC3210 is on the MPU6050's auxiliary bus.
+//#define ACCELEROMETER_TYPE MC3210_VIA_MPU6050
+
+// un-comment to read every gyro sample from the MPU6050's fifo (1 kHz) instead of one sample per pass.
+// Each pass then reads 2 or 3 samples, which the ~151 kHz I2C bus can't do at CONTROL_LOOP_FREQUENCY 400.
+//#define GYRO_FIFO YES
+
 // un-comment if you don't want to include code for a compass, otherwise it will default to what the control board has on it
 #define COMPASS_TYPE NO_COMPASS
 //#define COMPASS_TYPE HMC5883
@@ -183,6 +197,17 @@ void x4_set_leds(unsigned char state);
 // Range is 0 to 2.0
 //#define GAIN_SCHEDULING_FACTOR 1.0
 
+// Control loop rate in Hz.  A timer runs the gyro, attitude, rx, pid and motor outputs at exactly this rate,
+// so the time step doesn't jitter.  The battery, leds, camera and serial port take turns at a quarter of it.
+// A pass that sends telemetry can run over, the next pass then makes up for the missed time.
+// Comment out to run the loop as fast as possible instead.
+#define CONTROL_LOOP_FREQUENCY 400
+
+// Learn the period and phase of the handset's packets and only poll the A7105 while the next one is due.
+// Telemetry that wouldn't be off the air before the handset's next packet is held back.
+// Comment out to poll the radio on every pass.
+#define RX_PREDICTIVE_WINDOW YES
+
 // Uncomment if using DC motors
 #define DC_MOTORS
 
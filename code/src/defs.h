@@ -33,7 +33,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define GYRO_ORIENTATION(VALUES,X, Y, Z) {VALUES[ROLLINDEX] =  -Y; VALUES[PITCHINDEX] = X; VALUES[YAWINDEX] = -Z;}
 
+#ifndef ACCELEROMETER_TYPE
 #define ACCELEROMETER_TYPE MC3210      // accelerometer
+#endif
 // MC3210 in Hubsan X4:
 // Positive Z = level position
 // Positive Y = left side down
@@ -273,3 +275,57 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef GAIN_SCHEDULING_FACTOR
 #define GAIN_SCHEDULING_FACTOR 1.0
 #endif
+// control loop rate.  Zero runs the main loop as fast as it will go and measures the time of each pass.
+// Anything else paces the control path with a hardware timer (Mini51 only) at that many Hz, and the slow tasks
+// take turns, one per pass.
+#ifndef CONTROL_LOOP_FREQUENCY
+#define CONTROL_LOOP_FREQUENCY 0
+#endif
+// read the gyro once per pass unless the config asks for the MPU6050's fifo
+#ifndef GYRO_FIFO
+#define GYRO_FIFO NO
+#endif
+// the attitude is kept as a down and a west vector unless the config asks for the quaternion estimator
+#ifndef ATTITUDE_ESTIMATOR
+#define ATTITUDE_ESTIMATOR ATTITUDE_ESTIMATOR_VECTORS
+#endif
+// main loop profiler is off by default, it costs a timer read per stage
+#ifndef LOOP_PROFILER
+#define LOOP_PROFILER NO
+#endif
+// configurator tools can have MSP responses pushed to them with MSP_SET_TELEMETRY instead of polling.  At most
+// MSP_TELEMETRY_BYTES_PER_LOOP bytes of them are started per call of serialcheckforaction().
+#ifndef MSP_TELEMETRY
+#define MSP_TELEMETRY YES
+#endif
+#ifndef MSP_TELEMETRY_BYTES_PER_LOOP
+#define MSP_TELEMETRY_BYTES_PER_LOOP 32
+#endif
+// the blackbox flight recorder is off by default.  When it's on, it keeps a frame every BLACKBOX_DIVISOR passes
+// through the main loop in a BLACKBOX_WINDOW byte window in RAM, and an impact over BLACKBOX_TRIGGER_G or disarming
+// writes the window and then the frames after it into BLACKBOX_PAGES pages of 512 bytes below the EEPROM page, which
+// the firmware must leave free (the GCC link fails if it doesn't, a Keil build then leaves the data flash alone and
+// records nothing).  A frame is about 21 bytes and one word goes to the flash per pass, so the divisor should be 8 or
+// more.  The window holds BLACKBOX_WINDOW / 21 frames less up to 8, about 2 s before the trigger at the defaults (10
+// frames a second), and the pages another 7 s after it.  10 s before a crash would take 2 KB of RAM at that rate, all
+// that the Mini51 has.  A lower divisor trades the length of the window for a gyro spectrum that reaches higher, up to
+// CONTROL_LOOP_FREQUENCY / BLACKBOX_DIVISOR / 2.  More pages cost the same amount of program flash.
+#ifndef BLACKBOX
+#define BLACKBOX NO
+#endif
+#ifndef BLACKBOX_DIVISOR
+#define BLACKBOX_DIVISOR 40
+#endif
+#ifndef BLACKBOX_PAGES
+#define BLACKBOX_PAGES 4
+#endif
+#ifndef BLACKBOX_WINDOW
+#define BLACKBOX_WINDOW 512
+#endif
+#ifndef BLACKBOX_TRIGGER_G
+#define BLACKBOX_TRIGGER_G 3.0
+#endif
+// the A7105 is polled on every pass unless the config asks to poll only when the handset's next packet is due
+#ifndef RX_PREDICTIVE_WINDOW
+#define RX_PREDICTIVE_WINDOW NO
+#endif
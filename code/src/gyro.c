@@ -24,6 +24,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 extern globalstruct global;
 
+#if (GYRO_FIFO==YES && GYRO_TYPE!=MPU6050)
+#error "GYRO_FIFO needs an MPU6050 gyro"
+#endif
+
 // when adding gyros, the following functions need to be included:
 // initgyro() // initializes the gyro
 // readgyro() // loads global.gyrorate with gyro readings in fixedpointnum degrees per second
@@ -111,6 +115,40 @@ void readgyro(void)
 #define MPU6050_DLPF_CFG   6
 #endif
 
+#if (GYRO_FIFO==YES)
+// The MPU6050 puts its gyro samples in its FIFO at a steady 1 kHz and readgyro() empties it every pass.  Then no
+// sample is lost, and the time the samples cover (global.gyrotimesliver) doesn't depend on how long the loop took.
+// The gyro samples internally at 8 kHz with the low pass filter off, and at 1 kHz with it on.
+#if (MPU6050_DLPF_CFG==0)
+#define MPU6050_SMPLRT_DIV 7
+#else
+#define MPU6050_SMPLRT_DIV 0
+#endif
+#define GYROFIFOSAMPLETIMESLIVER ((FIXEDPOINTONE << TIMESLIVEREXTRASHIFT) / 1000)
+
+#if (ACCELEROMETER_TYPE==MC3210_VIA_MPU6050)
+#define MPU6050_FIFO_EN 0x71    // gyro x, y and z, then the MC3210 through slave 0
+#define MPU6050_USER_CTRL 0x60  // FIFO_EN=1 ; I2C_MST_EN=1
+#define GYROFIFORECORDSIZE 12
+#else
+#define MPU6050_FIFO_EN 0x70    // gyro x, y and z
+#define MPU6050_USER_CTRL 0x40  // FIFO_EN=1
+#define GYROFIFORECORDSIZE 6
+#endif
+
+// if there's more than this in the fifo, we haven't been reading it (calibration, binding...) and it's old news
+#define GYROFIFOMAXSAMPLES 6
+
+unsigned char gyrofifodata[GYROFIFOMAXSAMPLES * GYROFIFORECORDSIZE];
+
+// 3996 (see readgyroregisters()) divided by the number of samples, so that the sum of the samples comes out as
+// their average rate without a divide.  Only 5 samples doesn't divide evenly, and it comes out 0.025% low.
+#if (GYROFIFOMAXSAMPLES != 6)
+#error gyrofifoscale needs an entry for each number of samples up to GYROFIFOMAXSAMPLES
+#endif
+static const int gyrofifoscale[GYROFIFOMAXSAMPLES + 1] = { 0, 3996, 1998, 1332, 999, 799, 666 };
+#endif
+
 void initgyro(void)
 {
     // Resetting the MPU6050 does not work for some reason.
@@ -121,12 +159,29 @@ void initgyro(void)
     lib_i2c_writereg(MPU6050_ADDRESS, 0x6B, 0x03);      //PWR_MGMT_1    -- SLEEP 0; CYCLE 0; TEMP_DIS 0; CLKSEL 3 (PLL with Z Gyro reference)
     lib_i2c_writereg(MPU6050_ADDRESS, 0x1A, MPU6050_DLPF_CFG);  //CONFIG        -- EXT_SYNC_SET 0 (disable input pin for data sync) ; default DLPF_CFG = 0 => ACC bandwidth = 260Hz  GYRO bandwidth = 256Hz)
     lib_i2c_writereg(MPU6050_ADDRESS, 0x1B, 0x18);      //GYRO_CONFIG   -- FS_SEL = 3: Full scale set to 2000 deg/sec
+#if (GYRO_FIFO==YES)
+    lib_i2c_writereg(MPU6050_ADDRESS, 0x19, MPU6050_SMPLRT_DIV);        //SMPLRT_DIV    -- 1 kHz sample rate
+    lib_i2c_writereg(MPU6050_ADDRESS, 0x23, MPU6050_FIFO_EN);   //FIFO_EN       -- what goes in the fifo every sample
+    lib_i2c_writereg(MPU6050_ADDRESS, 0x38, 0x10);      //INT_ENABLE    -- FIFO_OFLOW_EN=1, so that INT_STATUS shows an overflow
+    lib_i2c_writereg(MPU6050_ADDRESS, 0x6A, MPU6050_USER_CTRL | 0x04);  //USER_CTRL     -- FIFO_RESET=1
+#endif
 }
 
-void readgyro(void)
+#if (ACCELEROMETER_TYPE==MC3210_VIA_MPU6050)
+// The MPU6050 reads the MC3210 for us (see accelerometer.c) and its EXT_SENS_DATA registers follow the
+// gyro's, so one burst gets both sensors, sampled at the same instant.  readacc() converts the last six bytes.
+unsigned char mpu6050sensordata[12];
+#endif
+
+static void readgyroregisters(void)
 {
+#if (ACCELEROMETER_TYPE==MC3210_VIA_MPU6050)
+    unsigned char *data = mpu6050sensordata;
+    lib_i2c_readdata(MPU6050_ADDRESS, 0x43, data, 12);
+#else
     unsigned char data[6];
     lib_i2c_readdata(MPU6050_ADDRESS, 0x43, (unsigned char *) &data, 6);
+#endif
     // convert to fixedpointnum, in degrees per second
     // the gyro puts out an int where each count equals 0.0609756097561 degrees/second
     // we want fixedpointnums, so we multiply by 3996 (0.0609756097561 * (1<<FIXEDPOINTSHIFT))
@@ -135,4 +190,70 @@ void readgyro(void)
         ((int16_t) ((data[2] << 8) | data[3])) * 3996L,
         ((int16_t) ((data[4] << 8) | data[5])) * 3996L);
 }
+
+#if (GYRO_FIFO==YES)
+// the rates of the last pass that got samples, before imu.c adds the calibration to them
+static fixedpointnum lastgyrorate[3];
+
+void readgyro(void)
+{
+    unsigned char countdata[2];
+    lib_i2c_readdata(MPU6050_ADDRESS, 0x72, countdata, 2);     // FIFO_COUNT_H, FIFO_COUNT_L
+    unsigned int count = (countdata[0] << 8) | countdata[1];
+    unsigned char samples = count / GYROFIFORECORDSIZE;
+
+    // a count that isn't a whole number of records is usually a record the MPU6050 is still writing.  Only the
+    // whole ones are read, and the rest is left for the next pass.  It's also what an overflow leaves behind, and
+    // then we've lost our place in the fifo, so INT_STATUS is only read to tell the two apart when that happens.
+    if (samples > GYROFIFOMAXSAMPLES || (samples * GYROFIFORECORDSIZE != count && (lib_i2c_readreg(MPU6050_ADDRESS, 0x3A) & 0x10))) {        // INT_STATUS -- FIFO_OFLOW_INT
+        // too old, or it overflowed.  Start it over and read the current values directly this time.  Reading
+        // INT_STATUS clears an overflow flag left from the time it wasn't being read.
+        lib_i2c_writereg(MPU6050_ADDRESS, 0x6A, MPU6050_USER_CTRL | 0x04);      //USER_CTRL     -- FIFO_RESET=1
+        lib_i2c_readreg(MPU6050_ADDRESS, 0x3A);
+        readgyroregisters();
+        global.gyrotimesliver = global.timesliver;
+        for (int x = 0; x < 3; ++x)
+            lastgyrorate[x] = global.gyrorate[x];
+        return;
+    }
+
+    // if nothing new has come in, keep the last rates.  They will cover no time.  global.gyrorate has had the
+    // calibration added since, so they come from lastgyrorate.
+    global.gyrotimesliver = samples * GYROFIFOSAMPLETIMESLIVER;
+    if (samples == 0) {
+        for (int x = 0; x < 3; ++x)
+            global.gyrorate[x] = lastgyrorate[x];
+        return;
+    }
+
+    lib_i2c_readdata(MPU6050_ADDRESS, 0x74, gyrofifodata, samples * GYROFIFORECORDSIZE);       // FIFO_R_W
+
+    // each sample covers the same time, so integrating them one at a time is the same as
+    // integrating their average over all of them.
+    long total[3] = { 0, 0, 0 };
+    unsigned char *data = gyrofifodata;
+    for (int x = 0; x < samples; ++x) {
+        total[0] += (int16_t) ((data[0] << 8) | data[1]);
+        total[1] += (int16_t) ((data[2] << 8) | data[3]);
+        total[2] += (int16_t) ((data[4] << 8) | data[5]);
+        data += GYROFIFORECORDSIZE;
+    }
+
+    int scale = gyrofifoscale[samples];
+    GYRO_ORIENTATION(global.gyrorate, total[0] * scale, total[1] * scale, total[2] * scale);
+    for (int x = 0; x < 3; ++x)
+        lastgyrorate[x] = global.gyrorate[x];
+
+#if (ACCELEROMETER_TYPE==MC3210_VIA_MPU6050)
+    // the accelerometer gets the newest sample
+    for (int x = 6; x < 12; ++x)
+        mpu6050sensordata[x] = data[x - GYROFIFORECORDSIZE];
+#endif
+}
+#else
+void readgyro(void)
+{
+    readgyroregisters();
+}
+#endif
 #endif
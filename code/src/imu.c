@@ -61,72 +61,133 @@ fixedpointnum estimated_compass_vector[3] = { FIXEDPOINTONE, 0, 0 };    // start
 
 #define ONE_OVER_ACC_COMPLIMENTARY_FILTER_TIME_PERIOD FIXEDPOINTCONSTANT(1.0/ACC_COMPLIMENTARY_FILTER_TIME_PERIOD)
 
+#if (ATTITUDE_ESTIMATOR == ATTITUDE_ESTIMATOR_QUATERNION)
+// The quaternion estimator keeps the attitude as one unit quaternion that rotates the aircraft's frame into the
+// earth's frame (west is x, down is z).  The down and west vectors are read out of it, so they can't drift apart
+// or change length.  The down vector is read out every pass, the west vector only when something needs it.  The
+// accelerometer steers it the same way it steers the down vector above: the angle between the measured and
+// estimated down vectors is fed back as a rotation rate (the same ACC_COMPLIMENTARY_FILTER_TIME_PERIOD sets how
+// fast), and that rate is also integrated into an estimate of the gyro bias, which takes GYRO_BIAS_TIME_PERIOD
+// times longer to settle.  Both are added to the gyro rates before they are turned into delta angles, so they
+// don't cost a multiply of their own, and they are worked out every ACCCORRECTIONPASSES passes from the average of
+// the stable accelerometer readings in between.
+
+#ifndef GYRO_BIAS_TIME_PERIOD
+#define GYRO_BIAS_TIME_PERIOD 20.0      // seconds
+#endif
+
+#define ONE_OVER_GYRO_BIAS_TIME_PERIOD FIXEDPOINTCONSTANT(1.0/GYRO_BIAS_TIME_PERIOD)
+
+// The correction changes slowly next to the loop, so working it out at 50 Hz instead of 400 Hz loses nothing.
+#define ACCCORRECTIONSHIFT 3
+#define ACCCORRECTIONPASSES (1 << ACCCORRECTIONSHIFT)
+
+#define ACCCORRECTIONGAIN FIXEDPOINTCONSTANT(180.0/3.14159/ACC_COMPLIMENTARY_FILTER_TIME_PERIOD)   // degrees per second per radian of error
+
+// the quaternion carries extra bits, like timesliver, so that the tiny rotation of one pass isn't rounded away.
+// A quaternion multiplied by a shifted delta angle has to be shifted back down.
+#define QUATERNIONEXTRASHIFT 8
+#define QUATERNIONONE (FIXEDPOINTONE << QUATERNIONEXTRASHIFT)
+
+#define MAXGYROBIAS (FIXEDPOINTCONSTANT(10.0) << TIMESLIVEREXTRASHIFT)  // 10 degrees per second
+
+// renormalizing the quaternion every pass isn't needed, it only creeps away from unit length by rounding
+#define QUATERNIONNORMALIZEPASSES 8
+
+fixedpointnum attitudequaternion[4];    // w, x, y, z
+fixedpointnum gyrobias[3];      // in degrees per second in the vector frame, shifted left by TIMESLIVEREXTRASHIFT
+fixedpointnum acccorrection[3]; // in degrees per second in the vector frame
+fixedpointnum accsum[3];        // the stable accelerometer readings since the correction was last worked out
+fixedpointnum acccorrectiontime;        // shifted left by TIMESLIVEREXTRASHIFT
+unsigned char acccorrectioncounter;
+unsigned char quaternionnormalizecounter;
+unsigned char westvectoroutofdate = 0;  // set when the quaternion turns, cleared when the west vector is read out of it
+#endif
+
 //fixedpointnum ; // convert from degrees to radians and include fudge factor
 fixedpointnum barotimeinterval = 0;     // accumulated time between barometer reads
 fixedpointnum compasstimeinterval = 0;  // accumulated time between barometer reads
 fixedpointnum lastbarorawaltitude;      // remember our last reading so we can calculate altitude velocity
+unsigned char eulerattitudeoutofdate = 0;       // set when the vectors change, cleared when the euler angles are calculated
+
+// calibration in progress, see startgyroandaccelerometercalibration()
+static bool calibratingacc;
+static fixedpointnum calibrationtime;
 
 // read the acc and gyro a bunch of times and get an average of how far off they are.
 // assumes the aircraft is sitting level and still.
 // If both==false, only gyro is calibrated and accelerometer calibration not touched.
 void calibrategyroandaccelerometer(bool both)
 {
-#ifdef X4_BUILD
-    uint8_t ledstatus;
-#endif
+    startgyroandaccelerometercalibration(both);
+    while (!gyroandaccelerometercalibrationstep());
+}
 
+// The calibration can also be run a pass at a time, so other things can go on between the passes.
+void startgyroandaccelerometercalibration(bool both)
+{
     for (int x = 0; x < 3; ++x) {
         usersettings.gyrocalibration[x] = 0;
         if(both)
             usersettings.acccalibration[x] = 0;
     }
 
-    fixedpointnum totaltime = 0;
+    calibratingacc = both;
+    calibrationtime = 0;
+}
 
-    // calibrate the gyro and acc
-    while (totaltime < (FIXEDPOINTCONSTANT(4) << TIMESLIVEREXTRASHIFT)) // 4 seconds
-    {
-        readgyro();
-        if(both) {
-            readacc();
-            global.acc_g_vector[ZINDEX] -= FIXEDPOINTONE; // vertical vector should be at 1g
-        }
+// one control loop pass worth of calibration, returns true once the 4 seconds are up
+bool gyroandaccelerometercalibrationstep(void)
+{
+#ifdef X4_BUILD
+    uint8_t ledstatus;
+#endif
+
+    if (calibrationtime >= (FIXEDPOINTCONSTANT(4) << TIMESLIVEREXTRASHIFT)) // 4 seconds
+        return true;
 
-        calculatetimesliver();
-        totaltime += global.timesliver;
+    readgyro();
+    if(calibratingacc) {
+        readacc();
+        global.acc_g_vector[ZINDEX] -= FIXEDPOINTONE; // vertical vector should be at 1g
+    }
+
+    calculatetimesliver();
+    calibrationtime += global.timesliver;
 #ifdef X4_BUILD
-        // Rotating LED pattern
-        ledstatus = (uint8_t)((totaltime >> (FIXEDPOINTSHIFT+TIMESLIVEREXTRASHIFT-3))& 0x3);
-        switch(ledstatus) {
-        case 0:
-            x4_set_leds(X4_LED_FL);
-            break;
-        case 1:
-            x4_set_leds(X4_LED_FR);
-            break;
-        case 2:
-            x4_set_leds(X4_LED_RR);
-            break;
-        case 3:
-            x4_set_leds(X4_LED_RL);
-            break;
-        }
+    // Rotating LED pattern
+    ledstatus = (uint8_t)((calibrationtime >> (FIXEDPOINTSHIFT+TIMESLIVEREXTRASHIFT-3))& 0x3);
+    switch(ledstatus) {
+    case 0:
+        x4_set_leds(X4_LED_FL);
+        break;
+    case 1:
+        x4_set_leds(X4_LED_FR);
+        break;
+    case 2:
+        x4_set_leds(X4_LED_RR);
+        break;
+    case 3:
+        x4_set_leds(X4_LED_RL);
+        break;
+    }
 #endif
-        for (int x = 0; x < 3; ++x) {
-            lib_fp_lowpassfilter(&usersettings.gyrocalibration[x], -global.gyrorate[x], global.timesliver, FIXEDPOINTONEOVERONE, TIMESLIVEREXTRASHIFT);
-            if(both)
-                lib_fp_lowpassfilter(&usersettings.acccalibration[x], -global.acc_g_vector[x], global.timesliver, FIXEDPOINTONEOVERONE, TIMESLIVEREXTRASHIFT);
-        }
+    for (int x = 0; x < 3; ++x) {
+        lib_fp_lowpassfilter(&usersettings.gyrocalibration[x], -global.gyrorate[x], global.timesliver, FIXEDPOINTONEOVERONE, TIMESLIVEREXTRASHIFT);
+        if(calibratingacc)
+            lib_fp_lowpassfilter(&usersettings.acccalibration[x], -global.acc_g_vector[x], global.timesliver, FIXEDPOINTONEOVERONE, TIMESLIVEREXTRASHIFT);
     }
+    return calibrationtime >= (FIXEDPOINTCONSTANT(4) << TIMESLIVEREXTRASHIFT);
 }
 
+// Starts the calibration, the caller runs gyroandaccelerometercalibrationstep() until it is done
 void initimu(void)
 {
     // calibrate both sensors if we didn't load any data from eeprom
     if (global.usersettingsfromeeprom == 0)
-        calibrategyroandaccelerometer(true);
+        startgyroandaccelerometercalibration(true);
     else // only gyro
-        calibrategyroandaccelerometer(false);
+        startgyroandaccelerometercalibration(false);
 
     global.estimateddownvector[XINDEX] = 0;
     global.estimateddownvector[YINDEX] = 0;
@@ -136,6 +197,22 @@ void initimu(void)
     global.estimatedwestvector[YINDEX] = 0;
     global.estimatedwestvector[ZINDEX] = 0;
 
+#if (ATTITUDE_ESTIMATOR == ATTITUDE_ESTIMATOR_QUATERNION)
+    attitudequaternion[0] = QUATERNIONONE;
+    for (int x = 0; x < 3; ++x) {
+        attitudequaternion[x + 1] = 0;
+        gyrobias[x] = 0;
+        acccorrection[x] = 0;
+        accsum[x] = 0;
+    }
+    acccorrectiontime = 0;
+    acccorrectioncounter = 0;
+    quaternionnormalizecounter = 0;
+    westvectoroutofdate = 0;
+#endif
+
+    eulerattitudeoutofdate = 1;
+
     lastbarorawaltitude = global.altitude = global.barorawaltitude;
 
     global.altitudevelocity = 0;
@@ -146,6 +223,76 @@ void initimu(void)
 //fixedpointnum timesincezerocrossing[3]={0};
 //char gyropositive[3]={0};
 
+#if (ATTITUDE_ESTIMATOR == ATTITUDE_ESTIMATOR_QUATERNION)
+// rotate the attitude quaternion by the delta angles, which are in radians in the vector frame and shifted left
+// by TIMESLIVEREXTRASHIFT, then read the down vector back out of it.
+static void rotatequaternion(fixedpointnum * deltaangle)
+{
+    fixedpointnum *q = attitudequaternion;
+    fixedpointnum q0 = q[0];
+    fixedpointnum q1 = q[1];
+    fixedpointnum q2 = q[2];
+    fixedpointnum q3 = q[3];
+
+    fixedpointnum dx = deltaangle[XINDEX];
+    fixedpointnum dy = deltaangle[YINDEX];
+    fixedpointnum dz = deltaangle[ZINDEX];
+
+    // the quaternion changes by half of itself times the rotation.  The halving and the delta angles' extra bits
+    // come out in one shift of each sum.
+    q[0] -= (lib_fp_multiply(q1, dx) + lib_fp_multiply(q2, dy) + lib_fp_multiply(q3, dz)) >> (TIMESLIVEREXTRASHIFT + 1);
+    q[1] += (lib_fp_multiply(q0, dx) + lib_fp_multiply(q2, dz) - lib_fp_multiply(q3, dy)) >> (TIMESLIVEREXTRASHIFT + 1);
+    q[2] += (lib_fp_multiply(q0, dy) - lib_fp_multiply(q1, dz) + lib_fp_multiply(q3, dx)) >> (TIMESLIVEREXTRASHIFT + 1);
+    q[3] += (lib_fp_multiply(q0, dz) + lib_fp_multiply(q1, dy) - lib_fp_multiply(q2, dx)) >> (TIMESLIVEREXTRASHIFT + 1);
+
+    // the vectors only need normal fixed point resolution
+    fixedpointnum w = q[0] >> QUATERNIONEXTRASHIFT;
+    fixedpointnum x = q[1] >> QUATERNIONEXTRASHIFT;
+    fixedpointnum y = q[2] >> QUATERNIONEXTRASHIFT;
+    fixedpointnum z = q[3] >> QUATERNIONEXTRASHIFT;
+
+    fixedpointnum xx = lib_fp_multiply(x, x);
+    fixedpointnum yy = lib_fp_multiply(y, y);
+
+    // down is the earth's z axis seen from the aircraft, the bottom row of the rotation matrix.  The quaternion is
+    // kept at unit length, so ww + zz is 1 - xx - yy and the diagonal element doesn't need them.
+    global.estimateddownvector[XINDEX] = (lib_fp_multiply(x, z) - lib_fp_multiply(w, y)) << 1;
+    global.estimateddownvector[YINDEX] = (lib_fp_multiply(y, z) + lib_fp_multiply(w, x)) << 1;
+    global.estimateddownvector[ZINDEX] = FIXEDPOINTONE - ((xx + yy) << 1);
+
+    westvectoroutofdate = 1;
+
+    // every few passes, pull the quaternion back to unit length.  It's always close, so one step of newton's
+    // method is enough and we don't need a square root: q = q * (3 - |q|^2) / 2
+    if (++quaternionnormalizecounter >= QUATERNIONNORMALIZEPASSES) {
+        quaternionnormalizecounter = 0;
+
+        fixedpointnum correction = (FIXEDPOINTONE - (lib_fp_multiply(w, w) + xx + yy + lib_fp_multiply(z, z))) >> 1;
+        for (int i = 0; i < 4; ++i)
+            q[i] += lib_fp_multiply(q[i], correction);
+    }
+}
+
+// read the west vector, the earth's x axis seen from the aircraft and the top row of the rotation matrix, out of the
+// quaternion if it has turned since the last time.  Level and acro flight only need the down vector, so this is done
+// at 10 Hz like the vector estimator's west vector fixup, and whenever the compass or the yaw angle needs it.
+static void quaternionupdatewestvector(void)
+{
+    if (!westvectoroutofdate)
+        return;
+    westvectoroutofdate = 0;
+
+    fixedpointnum w = attitudequaternion[0] >> QUATERNIONEXTRASHIFT;
+    fixedpointnum x = attitudequaternion[1] >> QUATERNIONEXTRASHIFT;
+    fixedpointnum y = attitudequaternion[2] >> QUATERNIONEXTRASHIFT;
+    fixedpointnum z = attitudequaternion[3] >> QUATERNIONEXTRASHIFT;
+
+    global.estimatedwestvector[XINDEX] = FIXEDPOINTONE - ((lib_fp_multiply(y, y) + lib_fp_multiply(z, z)) << 1);
+    global.estimatedwestvector[YINDEX] = (lib_fp_multiply(x, y) - lib_fp_multiply(w, z)) << 1;
+    global.estimatedwestvector[ZINDEX] = (lib_fp_multiply(x, z) + lib_fp_multiply(w, y)) << 1;
+}
+#endif
+
 void imucalculateestimatedattitude(void)
 {
     readgyro();
@@ -162,31 +309,111 @@ void imucalculateestimatedattitude(void)
     // good because they are generally very small angles;
 
     // create a multiplier that will include timesliver and a conversion from degrees to radians
-    // we need radians for small angle approximation
-    fixedpointnum multiplier = lib_fp_multiply(global.timesliver, FIXEDPOINTPIOVER180);
+    // we need radians for small angle approximation.  When the gyro is read from its fifo, the rates cover
+    // the time its samples did, not the time since the last pass.
+#if (GYRO_FIFO==YES)
+    fixedpointnum gyrotimesliver = global.gyrotimesliver;
+#else
+    fixedpointnum gyrotimesliver = global.timesliver;
+#endif
+    fixedpointnum multiplier = lib_fp_multiply(gyrotimesliver, FIXEDPOINTPIOVER180);
+
+    compasstimeinterval += global.timesliver;
+
+#if (ATTITUDE_ESTIMATOR == ATTITUDE_ESTIMATOR_QUATERNION)
+    // rotatevectorwithsmallangles() turns the vectors by (pitch, -roll, -yaw) in the vector frame
+    fixedpointnum deltaangle[3];
+    deltaangle[XINDEX] = lib_fp_multiply(global.gyrorate[PITCHINDEX] + (gyrobias[XINDEX] >> TIMESLIVEREXTRASHIFT) + acccorrection[XINDEX], multiplier);
+    deltaangle[YINDEX] = lib_fp_multiply(-global.gyrorate[ROLLINDEX] + (gyrobias[YINDEX] >> TIMESLIVEREXTRASHIFT) + acccorrection[YINDEX], multiplier);
+    deltaangle[ZINDEX] = lib_fp_multiply(-global.gyrorate[YAWINDEX] + (gyrobias[ZINDEX] >> TIMESLIVEREXTRASHIFT) + acccorrection[ZINDEX], multiplier);
+
+    // like the vector estimator below, only trust the accelerometer when it reads close to one G.  The check
+    // doesn't need the full fraction, so the readings are cut to 8 bits of it and a plain multiply does.
+    fixedpointnum accx = global.acc_g_vector[XINDEX] >> (FIXEDPOINTSHIFT / 2);
+    fixedpointnum accy = global.acc_g_vector[YINDEX] >> (FIXEDPOINTSHIFT / 2);
+    fixedpointnum accz = global.acc_g_vector[ZINDEX] >> (FIXEDPOINTSHIFT / 2);
+    fixedpointnum accmagnitudesquared = accx * accx + accy * accy + accz * accz;
+
+    global.stable = (accmagnitudesquared > MINACCMAGNITUDESQUARED && accmagnitudesquared < MAXACCMAGNITUDESQUARED);
+
+    if (global.stable) {
+        for (int x = 0; x < 3; ++x)
+            accsum[x] += global.acc_g_vector[x];
+    }
+    acccorrectiontime += global.timesliver;
+
+    if (++acccorrectioncounter >= ACCCORRECTIONPASSES) {
+        // the cross product is the axis we need to turn around to line the estimated down vector up with
+        // the measured one, and its length is the sine of the angle between them.  Readings that weren't stable
+        // are left out of the sum, which weakens the correction as if it had been skipped on those passes.
+        fixedpointnum accaverage[3];
+        for (int x = 0; x < 3; ++x) {
+            accaverage[x] = accsum[x] >> ACCCORRECTIONSHIFT;
+            accsum[x] = 0;
+        }
+
+        fixedpointnum error[3];
+        vectorcrossproduct(accaverage, global.estimateddownvector, error);
+
+        fixedpointnum integral = lib_fp_multiply(acccorrectiontime, ONE_OVER_GYRO_BIAS_TIME_PERIOD);
+        for (int x = 0; x < 3; ++x) {
+            acccorrection[x] = lib_fp_multiply(error[x], ACCCORRECTIONGAIN);
+            gyrobias[x] += lib_fp_multiply(acccorrection[x], integral);
+            lib_fp_constrain(&gyrobias[x], -MAXGYROBIAS, MAXGYROBIAS);
+        }
+        acccorrectiontime = 0;
+        acccorrectioncounter = 0;
+    }
+
+#if (COMPASS_TYPE != NO_COMPASS)
+    if (readcompass()) {
+        // the compass steers the west vector the same way.  See the vector estimator below for where the west vector comes from.
+        fixedpointnum westvector[3];
+        fixedpointnum error[3];
+
+        quaternionupdatewestvector();
+        vectorcrossproduct(global.compassvector, global.estimateddownvector, westvector);
+        vectorcrossproduct(westvector, global.estimatedwestvector, error);
+
+        fixedpointnum proportional = lib_fp_multiply(compasstimeinterval, ONE_OVER_ACC_COMPLIMENTARY_FILTER_TIME_PERIOD);
+        for (int x = 0; x < 3; ++x)
+            deltaangle[x] += lib_fp_multiply(error[x], proportional);
+        compasstimeinterval = 0;
+    }
+#endif
 
+    rotatequaternion(deltaangle);
+
+#if (COMPASS_TYPE == NO_COMPASS)
+    // without a compass, keep the west vector in global no more than a tenth of a second old for anything that
+    // reads it directly.  The compass reads it out above when there is one.
+    if (compasstimeinterval > (6553L << TIMESLIVEREXTRASHIFT)) {        // 10 hz
+        quaternionupdatewestvector();
+        compasstimeinterval = 0;
+    }
+#endif
+#else
     fixedpointnum rolldeltaangle = lib_fp_multiply(global.gyrorate[ROLLINDEX], multiplier);
     fixedpointnum pitchdeltaangle = lib_fp_multiply(global.gyrorate[PITCHINDEX], multiplier);
     fixedpointnum yawdeltaangle = lib_fp_multiply(global.gyrorate[YAWINDEX], multiplier);
 
-    rotatevectorwithsmallangles(global.estimateddownvector, rolldeltaangle, pitchdeltaangle, yawdeltaangle);
-    rotatevectorwithsmallangles(global.estimatedwestvector, rolldeltaangle, pitchdeltaangle, yawdeltaangle);
-
-    // if the accellerometer's gravity vector is close to one G, use a complimentary filter
-    // to gently adjust our estimated g vector so that it stays in line with the real one.
+    // if the accellerometer's gravity vector is close to one G, use it to gently adjust our estimated
+    // g vector so that it stays in line with the real one.
     // If the magnitude of the vector is not near one G, then it will be difficult to determine
     // which way is down, so we just skip it.
     fixedpointnum accmagnitudesquared = lib_fp_multiply(global.acc_g_vector[XINDEX], global.acc_g_vector[XINDEX]) + lib_fp_multiply(global.acc_g_vector[YINDEX], global.acc_g_vector[YINDEX]) + lib_fp_multiply(global.acc_g_vector[ZINDEX], global.acc_g_vector[ZINDEX]);
 
-    if (accmagnitudesquared > MINACCMAGNITUDESQUARED && accmagnitudesquared < MAXACCMAGNITUDESQUARED) {
-        global.stable = 1;
+    global.stable = (accmagnitudesquared > MINACCMAGNITUDESQUARED && accmagnitudesquared < MAXACCMAGNITUDESQUARED);
+
+    rotatevectorwithsmallangles(global.estimateddownvector, rolldeltaangle, pitchdeltaangle, yawdeltaangle);
+    rotatevectorwithsmallangles(global.estimatedwestvector, rolldeltaangle, pitchdeltaangle, yawdeltaangle);
+
+    // use a complimentary filter to pull the estimated down vector towards the accelerometer's
+    if (global.stable) {
         for (int x = 0; x < 3; ++x) {
             lib_fp_lowpassfilter(&global.estimateddownvector[x], global.acc_g_vector[x], global.timesliver, ONE_OVER_ACC_COMPLIMENTARY_FILTER_TIME_PERIOD, TIMESLIVEREXTRASHIFT);
         }
-    } else
-        global.stable = 0;
-
-    compasstimeinterval += global.timesliver;
+    }
 
 #if (COMPASS_TYPE != NO_COMPASS)
     int gotnewcompassreading = readcompass();
@@ -221,6 +448,7 @@ void imucalculateestimatedattitude(void)
         compasstimeinterval = 0;
     }
 #endif
+#endif
 
 #if (BAROMETER_TYPE != NO_BAROMETER)
     barotimeinterval += global.timesliver;
@@ -256,7 +484,23 @@ void imucalculateestimatedattitude(void)
     }
 #endif
 
-    // convert our vectors to euler angles
+    // the euler angles are now out of date.  They are only worked out when someone asks for them.
+    eulerattitudeoutofdate = 1;
+}
+
+// convert our vectors to euler angles, if the vectors have changed since the last time.  Call this before reading
+// global.currentestimatedeulerattitude.  The three atan2's are the most expensive thing in the imu, and
+// the control loop doesn't need them in acro mode.
+void imuupdateeulerattitude(void)
+{
+    if (!eulerattitudeoutofdate)
+        return;
+    eulerattitudeoutofdate = 0;
+
+#if (ATTITUDE_ESTIMATOR == ATTITUDE_ESTIMATOR_QUATERNION)
+    quaternionupdatewestvector();
+#endif
+
     global.currentestimatedeulerattitude[ROLLINDEX] = lib_fp_atan2(global.estimateddownvector[XINDEX], global.estimateddownvector[ZINDEX]);
     if (lib_fp_abs(global.currentestimatedeulerattitude[ROLLINDEX]) > FIXEDPOINT45 && lib_fp_abs(global.currentestimatedeulerattitude[ROLLINDEX]) < FIXEDPOINT135) {
         global.currentestimatedeulerattitude[PITCHINDEX] = lib_fp_atan2(global.estimateddownvector[YINDEX], lib_fp_abs(global.estimateddownvector[XINDEX]));
@@ -15,9 +15,13 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdbool.h>
 #include "lib_fp.h"
 
 
 void initimu(void);
 void imucalculateestimatedattitude(void);
+void imuupdateeulerattitude(void);
 void calibrategyroandaccelerometer(bool both);
+void startgyroandaccelerometercalibration(bool both);
+bool gyroandaccelerometercalibrationstep(void);
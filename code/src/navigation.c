@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "gps.h"
 #include "lib_fp.h"
 #include "bradwii.h"
+#include "imu.h"
 
 #if (GPS_TYPE!=NO_GPS)
 
@@ -88,6 +89,8 @@ void navigation_sethometocurrentlocation()
 
 void navigation_set_destination(fixedpointnum latitude, fixedpointnum longitude)
 {                               // sets a new destination to navigate towards.  Assumes we are navigating from our current location.
+    imuupdateeulerattitude();
+
     target_latitude = latitude;
     target_longitude = longitude;
     navigation_last_crosstrack_distance = 0;
@@ -115,6 +118,7 @@ void navigation_setangleerror(unsigned char gotnewgpsreading, fixedpointnum * an
 {                               // calculate the angle errors between our current attitude and the one we wish to have
     // and adjust the angle errors that were passed to us.  They have already been set by pilot input.
     // For now, we just override any pilot input.
+    imuupdateeulerattitude();
 
     // keep track of the time between good gps readings.
     navigation_time_sliver += global.timesliver;
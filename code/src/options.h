@@ -69,6 +69,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define BMA180 1
 #define MPU6050 2
 #define MC3210 3
+#define MC3210_VIA_MPU6050 4
 
 // GPS_TYPE's
 #define NO_GPS 0
@@ -87,6 +88,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define BMP085 1
 #define MS5611 2
 
+// ATTITUDE_ESTIMATOR's
+#define ATTITUDE_ESTIMATOR_VECTORS 0
+#define ATTITUDE_ESTIMATOR_QUATERNION 1
+
 // MULTIWII_CONFIG_SERIAL_PORTS
 // These can be added (or or'ed together) to choose muliple ports
 #define NOSERIALPORT 0
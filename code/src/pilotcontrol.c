@@ -18,6 +18,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "pilotcontrol.h"
 #include "bradwii.h"
 #include "vectors.h"
+#include "imu.h"
 #include "lib_timers.h"
 
 extern globalstruct global;
@@ -29,6 +30,9 @@ extern usersettingsstruct usersettings;
 // convert high rate multiplier into fixed point
 #define FP_HIGH_RATES_MULTILIER FIXEDPOINTCONSTANT(HIGH_RATES_MULTILIER)
 
+// for converting the level mode error from radians to degrees
+#define FIXEDPOINT180OVERPI FIXEDPOINTCONSTANT(57.29578)
+
 // When the yaw stick is centered, allow compass hold.  This defines what centered is:
 #define YAWCOMPASSRXDEADBAND FIXEDPOINTCONSTANT(.125)   // 1/8 of the range
 
@@ -40,6 +44,7 @@ static fixedpointnum accumulatedyawerror = 0;
 void resetpilotcontrol(void)
 {                               // called when switching from navigation control to pilot control or when idling on the ground.
     // keeps us from accumulating yaw error that we can't correct.
+    imuupdateeulerattitude();
     desiredcompassheading = global.currentestimatedeulerattitude[YAWINDEX];
     // Same for yaw hold mode
     accumulatedyawerror = 0;
@@ -49,23 +54,50 @@ void resetpilotcontrol(void)
     highpitchandrollrate = lib_fp_multiply(usersettings.maxpitchandrollrate, FP_HIGH_RATES_MULTILIER);
 }
 
-void getangleerrorfrompilotinput(fixedpointnum * angleerror)
+// asin for 0 to sin(45 degrees), in degrees.  A polynomial fitted over that range is good to 0.02 degrees.
+static fixedpointnum levelmodeasin(fixedpointnum x)
 {
-    // sets the ange errors for roll, pitch, and yaw based on where the pilot has the tx sticks.
+    fixedpointnum xx = lib_fp_multiply(x, x);
+    fixedpointnum polynomial = FIXEDPOINTONE + lib_fp_multiply(xx, FIXEDPOINTCONSTANT(0.1545) + lib_fp_multiply(xx, FIXEDPOINTCONSTANT(0.1329)));
+    return lib_fp_multiply(lib_fp_multiply(x, FIXEDPOINT180OVERPI), polynomial);
+}
 
-    // first, calculate level mode values
-    // how far is our estimated current attitude from our desired attitude?
-    // desired angle is rxvalue (-1 to 1) times LEVEL_MODE_MAX_TILT
-    // First, figure out which max angle we are using depending on aux switch settings.
-    fixedpointnum levelmodemaxangle;
-    if (global.activecheckboxitems & CHECKBOXMASKHIGHANGLE)
-        levelmodemaxangle = FP_LEVEL_MODE_MAX_TILT_HIGH_ANGLE;
+// Returns the level mode angle error, in degrees, about one axis straight from the down vector, so that we don't
+// need the euler angles.  sideways and down are the down vector's components in the plane we are tilting in.
+// Crossing them with the sine and cosine of the desired angle gives the sine of the angle error, and the dot
+// product gives its cosine, both times the length of the down vector in that plane (less than one when we are also
+// tipped on the other axis).  Dividing that length out and taking the asin of whichever of the two is smaller is
+// atan2 without the CORDIC, and it keeps the error growing all the way to 180 degrees instead of falling back off
+// with the sine.
+static fixedpointnum levelmodeangleerror(fixedpointnum desiredangle, fixedpointnum sideways, fixedpointnum down)
+{
+    fixedpointnum sine = lib_fp_sine(desiredangle);
+    fixedpointnum cosine = lib_fp_cosine(desiredangle);
+
+    fixedpointnum errorsine = lib_fp_multiply(sine, down) - lib_fp_multiply(cosine, sideways);
+    fixedpointnum errorcosine = lib_fp_multiply(cosine, down) + lib_fp_multiply(sine, sideways);
+
+    fixedpointnum lengthsquared = lib_fp_multiply(errorsine, errorsine) + lib_fp_multiply(errorcosine, errorcosine);
+    if (lengthsquared == 0)
+        return 0;
+    fixedpointnum oneoverlength = lib_fp_invsqrt(lengthsquared);
+    fixedpointnum abssine = lib_fp_abs(lib_fp_multiply(errorsine, oneoverlength));
+    fixedpointnum abscosine = lib_fp_abs(lib_fp_multiply(errorcosine, oneoverlength));
+
+    fixedpointnum error;
+    if (abssine < abscosine)
+        error = levelmodeasin(abssine);
     else
-        levelmodemaxangle = FP_LEVEL_MODE_MAX_TILT;
+        error = FIXEDPOINT90 - levelmodeasin(abscosine);
+    if (errorcosine < 0)
+        error = FIXEDPOINT180 - error;
 
-    // the angle error is how much our current angles differ from our desired angles.
-    fixedpointnum levelmoderollangleerror  = lib_fp_multiply(global.rxvalues[ROLLINDEX], levelmodemaxangle)  - global.currentestimatedeulerattitude[ROLLINDEX];
-    fixedpointnum levelmodepitchangleerror = lib_fp_multiply(global.rxvalues[PITCHINDEX], levelmodemaxangle) - global.currentestimatedeulerattitude[PITCHINDEX];
+    return errorsine < 0 ? -error : error;
+}
+
+void getangleerrorfrompilotinput(fixedpointnum * angleerror)
+{
+    // sets the ange errors for roll, pitch, and yaw based on where the pilot has the tx sticks.
 
     // In acro mode, we want the rotation rate to be proportional to the pilot's stick movement.  The desired rotation rate is
     // the stick movement * a multiplier.
@@ -128,6 +160,31 @@ void getangleerrorfrompilotinput(fixedpointnum * angleerror)
         }
     }
 
+    // in full acro mode we are done, and we never need to know our level mode angles.
+    if (levelmodefraction == 0)
+        return;
+
+    // now calculate level mode values
+    // how far is our estimated current attitude from our desired attitude?
+    // desired angle is rxvalue (-1 to 1) times LEVEL_MODE_MAX_TILT
+    // First, figure out which max angle we are using depending on aux switch settings.
+    fixedpointnum levelmodemaxangle;
+    if (global.activecheckboxitems & CHECKBOXMASKHIGHANGLE)
+        levelmodemaxangle = FP_LEVEL_MODE_MAX_TILT_HIGH_ANGLE;
+    else
+        levelmodemaxangle = FP_LEVEL_MODE_MAX_TILT;
+
+    // the angle error is how much our current angles differ from our desired angles. Roll is measured in the plane
+    // of the down vector's x and z, pitch in the plane of its y and z, except that, like the euler angles, pitch
+    // uses x in place of z when we are rolled more than 45 degrees.
+    fixedpointnum absdownx = lib_fp_abs(global.estimateddownvector[XINDEX]);
+    fixedpointnum pitchdown = global.estimateddownvector[ZINDEX];
+    if (absdownx > lib_fp_abs(pitchdown))
+        pitchdown = absdownx;
+
+    fixedpointnum levelmoderollangleerror  = levelmodeangleerror(lib_fp_multiply(global.rxvalues[ROLLINDEX], levelmodemaxangle), global.estimateddownvector[XINDEX], global.estimateddownvector[ZINDEX]);
+    fixedpointnum levelmodepitchangleerror = levelmodeangleerror(lib_fp_multiply(global.rxvalues[PITCHINDEX], levelmodemaxangle), global.estimateddownvector[YINDEX], pitchdown);
+
     // combine level and acro modes
     angleerror[ROLLINDEX] = lib_fp_multiply(angleerror[ROLLINDEX], acromodefraction) + lib_fp_multiply(levelmoderollangleerror, levelmodefraction);
     angleerror[PITCHINDEX] = lib_fp_multiply(angleerror[PITCHINDEX], acromodefraction) + lib_fp_multiply(levelmodepitchangleerror, levelmodefraction);
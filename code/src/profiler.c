@@ -0,0 +1,111 @@
+/*
+Copyright 2013 Brad Quick
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "lib_timers.h"
+
+#include "bradwii.h"
+#include "profiler.h"
+
+#if (LOOP_PROFILER==YES)
+
+profilerentrystruct profilerentry[PROFILERNUMENTRIES];
+
+unsigned long profilertimer;
+unsigned long profilerloopmicroseconds;       // the stages so far this pass through the loop
+bool profilerpartialloop;       // set after a reset, the pass it happened in is only partly timed
+
+static void profilerrecord(profilerentrystruct * entry, unsigned long microseconds)
+{
+    if (microseconds > 0xFFFF)
+        microseconds = 0xFFFF;
+
+    if (microseconds < entry->minmicroseconds)
+        entry->minmicroseconds = microseconds;
+    if (microseconds > entry->maxmicroseconds)
+        entry->maxmicroseconds = microseconds;
+
+    // keep the total from overflowing by halving it along with the count.  The average stays the same.
+    if (entry->totalmicroseconds & 0x80000000L) {
+        entry->totalmicroseconds >>= 1;
+        entry->count >>= 1;
+    }
+    entry->totalmicroseconds += microseconds;
+    ++entry->count;
+
+    // find the bucket with shifts instead of a division
+    unsigned char bucket = 0;
+    microseconds >>= PROFILERFIRSTBUCKETSHIFT;
+    while (microseconds && bucket < PROFILERNUMBUCKETS - 1) {
+        microseconds >>= 1;
+        ++bucket;
+    }
+
+    // when a bucket is about to overflow, halve them all so that the shape of the histogram is kept
+    if (entry->bucket[bucket] == 0xFFFF) {
+        for (int x = 0; x < PROFILERNUMBUCKETS; ++x)
+            entry->bucket[x] >>= 1;
+    }
+    ++entry->bucket[bucket];
+}
+
+void resetprofiler(void)
+{
+    memset(profilerentry, 0, sizeof(profilerentry));
+    for (int x = 0; x < PROFILERNUMENTRIES; ++x)
+        profilerentry[x].minmicroseconds = 0xFFFF;
+    profilerloopmicroseconds = 0;
+    profilerpartialloop = true;
+    profilertimer = lib_timers_starttimer();
+}
+
+void initprofiler(void)
+{
+    resetprofiler();
+}
+
+void profilerendstage(unsigned char stage)
+{
+    // charge everything since the last call to this stage
+    unsigned long microseconds = lib_timers_gettimermicrosecondsandreset(&profilertimer);
+    profilerrecord(&profilerentry[stage], microseconds);
+
+    profilerloopmicroseconds += microseconds;
+    if (stage == PROFILERSTAGETIMESLIVER) {
+        if (!profilerpartialloop)
+            profilerrecord(&profilerentry[PROFILERLOOP], profilerloopmicroseconds);
+        profilerloopmicroseconds = 0;
+        profilerpartialloop = false;
+    }
+}
+
+profilerentrystruct *getprofilerentry(unsigned char entry)
+{
+    if (entry >= PROFILERNUMENTRIES)
+        entry = PROFILERLOOP;
+    return &profilerentry[entry];
+}
+
+unsigned short profileraveragemicroseconds(profilerentrystruct * entry)
+{
+    // only called when the results are read out, so the division doesn't slow down the loop
+    if (!entry->count)
+        return 0;
+    return entry->totalmicroseconds / entry->count;
+}
+
+#endif
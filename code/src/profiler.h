@@ -0,0 +1,63 @@
+/*
+Copyright 2013 Brad Quick
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "defs.h"
+
+// Main loop profiler.  The loop calls profilerendstage() after each of its stages.  The time since the
+// previous call is charged to that stage, so the stages add up to the whole loop with nothing left out.
+// The slow tasks don't run every pass when the control loop is paced by a timer, only the passes they
+// run in are counted for them.  A pass through the loop ends when calculatetimesliver() does.
+// Set LOOP_PROFILER to YES in your config file to enable it.  Read the results with MSP_LOOP_PROFILE.
+
+#define PROFILERSTAGETIMESLIVER 0       // calculatetimesliver(), includes the wait for the control loop tick
+#define PROFILERSTAGEIMU 1              // imucalculateestimatedattitude()
+#define PROFILERSTAGEARMING 2           // arming and disarming, includes the calibration when arming
+#define PROFILERSTAGERX 3               // readrx(), includes sending telemetry
+#define PROFILERSTAGEPID 4              // pilot input and the pid loops
+#define PROFILERSTAGEMIXER 5            // motor mixing and output
+#define PROFILERSTAGECHECKBOXES 6       // checkcheckboxitems()
+#define PROFILERSTAGESERIAL 7           // serialcheckforaction()
+#define PROFILERSTAGECAMERA 8           // H107D_camera_update()
+#define PROFILERSTAGEBATTERYANDLEDS 9   // adc battery measurement and leds
+#define PROFILERSTAGEBLACKBOX 10        // blackboxrecord(), includes programming the data flash
+#define PROFILERNUMSTAGES 11
+
+#define PROFILERLOOP PROFILERNUMSTAGES  // the whole pass through the loop is kept as an extra entry
+#define PROFILERNUMENTRIES (PROFILERNUMSTAGES+1)
+
+// Histogram buckets double in width.  Bucket 0 counts times under 32 microseconds, bucket 1 under 64, and so on.
+// The last bucket counts everything from 2048 microseconds up.
+#define PROFILERNUMBUCKETS 8
+#define PROFILERFIRSTBUCKETSHIFT 5
+
+typedef struct {
+    unsigned short minmicroseconds;     // saturates at 65535
+    unsigned short maxmicroseconds;
+    unsigned long totalmicroseconds;
+    unsigned long count;
+    unsigned short bucket[PROFILERNUMBUCKETS];
+} profilerentrystruct;
+
+#if (LOOP_PROFILER==YES)
+void initprofiler(void);
+void resetprofiler(void);
+void profilerendstage(unsigned char stage);
+profilerentrystruct *getprofilerentry(unsigned char entry);
+unsigned short profileraveragemicroseconds(profilerentrystruct * entry);
+#else
+#define profilerendstage(stage)
+#endif
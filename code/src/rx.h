@@ -17,10 +17,29 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#pragma once
+
 #include "lib_fp.h"
+#include "rxtiming.h"
 
 void initrx(void);
 void readrx(void);
+unsigned char rxbound(void);    // rx_x4.c only, readrx() binds with the handset until this is true
+
+// Radio link statistics, kept by rx_x4.c for each of the last LINKSTATSSECONDS seconds.  Entry 0 is the
+// last complete second.  The A7105 RSSI reading goes down as the signal gets stronger.
+#define LINKSTATSSECONDS 8
+
+typedef struct {
+    unsigned char validpackets;
+    unsigned char badchecksums;
+    unsigned char wrongtxid;        // good checksum, but from another handset
+    unsigned char timeouts;         // 14 ms without a valid packet
+    unsigned char rssi;             // average over the valid packets, 0 if there were none
+} linkstatsstruct;
+
+linkstatsstruct *getlinkstats(unsigned char secondsago);
+rxtimingstruct *getrxtiming(void);     // rx_x4.c only, the handset's packet period as learned so far
 
 #define THROTTLE_RX_TIMER FIRSTRXTIMER
 #define ROLL_RX_TIMER FIRSTRXTIMER+1
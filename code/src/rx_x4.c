@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "lib_soft_3_wire_spi.h"
 #include "lib_timers.h"
 #include "a7105.h"
+#include "rxtiming.h"
 #include "config_X4.h"
 #include "H107D_camera.h"
 
@@ -38,8 +39,39 @@ static const uint8_t allowed_ch[] = {0x14, 0x1E, 0x28, 0x32, 0x3C, 0x46, 0x50, 0
 static uint8_t packet[16], channel, counter, telemetry_last_tram_send;
 static uint8_t txid[4];
 static unsigned long timeout_timer;
+
+// The radio is stepped once per call to readrx() so that the control loop never waits on the air time
+enum {
+    RADIO_RX_ARMED = 0,         // listening, waiting for TRER to clear
+    RADIO_TX_QUEUED             // telemetry strobed out, waiting for TRER to clear before listening again
+};
+static uint8_t radiostate;
+
+// Binding is stepped by readrx() too, so that the gyro calibration can run while the handset pairs
+enum {
+    BIND_SCAN = 0,              // listening on one channel after the other for the handset's 0x01
+    BIND_HANDSHAKE1,            // sending 0x02 until the handset answers 0x03
+    BIND_SESSION,               // 0x04 sent, waiting for a 0x01 on the session id
+    BIND_HANDSHAKE2,            // sending 0x02 until the handset answers 0x09
+    BIND_HANDSHAKE3,            // nine 0x0A
+    BIND_DONE
+};
+static uint8_t bindphase;
+static uint8_t bindchannelindex;
+static unsigned long bindtimer;
+
+// link statistics, the second being counted and a ring of the last complete ones
+static linkstatsstruct linkstats[LINKSTATSSECONDS];
+static unsigned char linkstatsnewest;
+static linkstatsstruct currentlinkstats;
+static const linkstatsstruct nolinkstats = { 0 };
+static unsigned int currentrssisum;
+static unsigned long linkstatstimer;
+
+// period and phase of the handset's packets, learned from when they come
+static rxtimingstruct rxtiming;
+
 void init_a7105(void);
-bool hubsan_check_integrity(void);
 void update_crc(void);
 
 extern globalstruct global;
@@ -52,14 +84,6 @@ void update_crc(void)
     packet[15] = (256 - (sum % 256)) & 0xff;
 }
 
-bool hubsan_check_integrity(void) 
-{
-    int sum = 0;
-    for(int i = 0; i < 15; i++)
-        sum += packet[i];
-    return packet[15] == ((256 - (sum % 256)) & 0xff);
-}
-
 void hubsan_build_bind_packet(uint8_t bindstate)
 {
     packet[0] = bindstate;
@@ -92,7 +116,8 @@ void init_a7105(void)
     A7105_WriteRegister(A7105_18_RX, 0x62);
     A7105_WriteRegister(A7105_19_RX_GAIN_I, 0x80);
     A7105_WriteRegister(A7105_1C_RX_GAIN_IV, 0x0A);
-    // A ajouter : A7105_WriteRegister(A7105_1E_ADC, 0xC3);
+    // RSSI measured on every packet, as the handset sets it, for the link statistics
+    A7105_WriteRegister(A7105_1E_ADC, 0xC3);
     A7105_WriteRegister(A7105_1F_CODE_I, 0x07);
     A7105_WriteRegister(A7105_20_CODE_II, 0x17);
     // A ajouter : A7105_WriteRegister(A7105_27_BATTERY_DET, 0x00);
@@ -139,111 +164,33 @@ void waitTRXCompletion(void)
         ;
 }
 
-void strobeTXRX(void)
+// Sends a bind packet and listens for the answer.  The handset answers within half a millisecond of the end
+// of our packet, sooner than the next call to readrx(), so the air time of our packet is waited for here.
+static void sendbindpacket(uint8_t bindstate)
 {
+    hubsan_build_bind_packet(bindstate);
+    A7105_StrobeAndWritePayload(A7105_STANDBY, (uint8_t*)&packet, sizeof(packet));
     A7105_WriteRegister(A7105_0F_PLL_I, channel);
     A7105_Strobe(A7105_TX);
     waitTRXCompletion();
+    if (bindstate == 4) {
+        // the handset moves to the session id it sent us as soon as it has our 0x04
+        A7105_WriteID(((uint32_t)packet[2] << 24) | ((uint32_t)packet[3] << 16) | ((uint32_t)packet[4] << 8) | packet[5]);
+    }
     A7105_Strobe(A7105_RX);
-    waitTRXCompletion();
-    A7105_Strobe(A7105_RST_RDPTR);
 }
 
-void bind() 
+static void listenforbinding(void)
 {
-    uint8_t chan=0;
-	
-    while(1){
-        if( lib_timers_gettimermicroseconds(0) % 500000 > 250000)
-            x4_set_leds(X4_LED_FR | X4_LED_RL);
-        else
-            x4_set_leds(X4_LED_FL | X4_LED_RR);
-
-        A7105_Strobe(A7105_STANDBY);
-        channel=allowed_ch[chan];
-        if(chan==11)
-            chan=0;
-        A7105_WriteRegister(A7105_0F_PLL_I, channel);
-        A7105_Strobe(A7105_RX);
-        unsigned long timer=lib_timers_starttimer();
-        while(1){
-            if(lib_timers_gettimermicroseconds(timer) > 8000) {
-                chan++;
-                break;
-            }
-            if(A7105_ReadRegister(A7105_00_MODE) & A7105_MODE_TRER_MASK){
-                continue;
-            }else{
-                A7105_ReadPayload((uint8_t*)&packet, sizeof(packet)); 
-                A7105_Strobe(A7105_RST_RDPTR);
-                if (packet[0]==1){
-                    break;
-                }	
-            }
-        }	
-        if (packet[0]==1){
-            break;
-        }
-    }
-    channel = packet[1];
-	
-    // Handshake 1
-    while(1) {
-        hubsan_build_bind_packet(2);
-        A7105_Strobe(A7105_STANDBY);
-        A7105_WritePayload((uint8_t*)&packet, sizeof(packet));
-        strobeTXRX();
-        A7105_ReadPayload((uint8_t*)&packet, sizeof(packet));
-        if (packet[0]==3){
-            break;
-        }
-    }
-	
-    hubsan_build_bind_packet(4);
     A7105_Strobe(A7105_STANDBY);
-    A7105_WritePayload((uint8_t*)&packet, sizeof(packet));
-    // Always done
+    channel = allowed_ch[bindchannelindex];
     A7105_WriteRegister(A7105_0F_PLL_I, channel);
-    A7105_Strobe(A7105_TX);
-    waitTRXCompletion();
+    A7105_Strobe(A7105_RX);
+    bindtimer = lib_timers_starttimer();
+}
 
-    A7105_WriteID(((uint32_t)packet[2] << 24) | ((uint32_t)packet[3] << 16) | ((uint32_t)packet[4] << 8) | packet[5]);
-	
-    while(1) { // useless block ?
-        A7105_Strobe(A7105_RX);
-        waitTRXCompletion();
-        A7105_Strobe(A7105_RST_RDPTR);
-        A7105_ReadPayload((uint8_t*)&packet, sizeof(packet));
-        if (packet[0]==1){
-            break;
-        }
-    }
-	
-    while(1){
-        hubsan_build_bind_packet(2);
-        A7105_Strobe(A7105_STANDBY);
-        A7105_WritePayload((uint8_t*)&packet, sizeof(packet));
-        strobeTXRX();
-        A7105_ReadPayload((uint8_t*)&packet, sizeof(packet));
-        if (packet[0]==9){
-            break;
-        }
-    }
-	
-    while(1){
-        counter++;
-        if(counter==10)
-        counter=0;
-        hubsan_build_bind_packet(0x0A);
-        A7105_Strobe(A7105_STANDBY);
-        A7105_WritePayload((uint8_t*)&packet, sizeof(packet));
-        strobeTXRX();
-        A7105_ReadPayload((uint8_t*)&packet, sizeof(packet));
-        if (counter==9){
-            break;
-        }
-    }
-    
+static void finishbinding(void)
+{
 #if CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107D
     uint16_t frequency;
     // Update camera frequency 
@@ -263,6 +210,80 @@ void bind()
         txid[i]=packet[i+11];
     }
 
+    bindphase = BIND_DONE;
+    linkstatstimer = timeout_timer = lib_timers_starttimer();
+    rxtiming_init(&rxtiming);
+    radiostate = RADIO_RX_ARMED;
+    A7105_Strobe(A7105_RX);
+}
+
+/**
+ * @brief      Advance the binding with the handset by one step
+ * @param      None.
+ * @return     None
+ * @details    Scan the channels for the handset's 0x01, then 0x02 until 0x03, 0x04 and a 0x01
+ *             on the session id, 0x02 until 0x09 and nine 0x0A.  Only the air time of our
+ *             own bind packets is waited for.
+ */
+static void bindstep(void)
+{
+    if (bindphase == BIND_SCAN) {
+        if (A7105_ReadPayloadIfReceived((uint8_t*)&packet, sizeof(packet))) {
+            if (packet[0]==1) {
+                channel = packet[1];
+                bindphase = BIND_HANDSHAKE1;
+                sendbindpacket(2);
+            } else
+                A7105_Strobe(A7105_RX);
+        } else if (lib_timers_gettimermicroseconds(bindtimer) > 8000) {
+            // nothing on this channel, try the next one
+            bindchannelindex = (bindchannelindex + 1) % sizeof(allowed_ch);
+            listenforbinding();
+        }
+        return;
+    }
+    
+    // the other phases wait for the handset's answer
+    if (!A7105_ReadPayloadIfReceived((uint8_t*)&packet, sizeof(packet)))
+        return;
+    
+    switch (bindphase) {
+    case BIND_HANDSHAKE1:
+        if (packet[0]==3) {
+            bindphase = BIND_SESSION;
+            sendbindpacket(4);
+        } else
+            sendbindpacket(2);
+        break;
+    case BIND_SESSION:
+        if (packet[0]==1) {
+            bindphase = BIND_HANDSHAKE2;
+            sendbindpacket(2);
+        } else
+            A7105_Strobe(A7105_RX);
+        break;
+    case BIND_HANDSHAKE2:
+        if (packet[0]==9) {
+            bindphase = BIND_HANDSHAKE3;
+            counter = 1;
+            sendbindpacket(0x0A);
+        } else
+            sendbindpacket(2);
+        break;
+    case BIND_HANDSHAKE3:
+        if (counter==9)
+            finishbinding();
+        else {
+            counter++;
+            sendbindpacket(0x0A);
+        }
+        break;
+    }
+}
+
+unsigned char rxbound(void)
+{
+    return bindphase == BIND_DONE;
 }
 
 void initrx(void)
@@ -270,8 +291,10 @@ void initrx(void)
     lib_soft_3_wire_spi_init(A7105_SDIO, A7105_SCK, A7105_SCS);
     lib_timers_delaymilliseconds(10);
     init_a7105();
-    bind();
-    A7105_Strobe(A7105_RX);
+    // readrx() carries on with the binding from here
+    bindphase = BIND_SCAN;
+    bindchannelindex = 0;
+    listenforbinding();
 }
 
 void decodepacket()
@@ -295,8 +318,8 @@ void decodepacket()
         // Compute frequency from packet
         frequency = packet[1] * 256 + packet[2];
         
-        // Send (if needed) the new frequency to camera
-        H107D_camera_update_frequency(frequency);
+        // The main loop sends (if needed) the new frequency to camera
+        H107D_camera_request_frequency(frequency);
     }
 #endif
 
@@ -319,6 +342,8 @@ void sendtelemetry(void)
     packet[7] = 0x00;
     //packet[8] = 0xff;
     packet[14] = 0x00;
+    // zero in the handset's control packet that is still in the array, carries the valid packets of the last second
+    packet[10] = getlinkstats(0)->validpackets;
     
     if (telemetry_last_tram_send == 0xe0) {
         packet[0] = 0xe1;
@@ -346,45 +371,119 @@ void sendtelemetry(void)
 
     update_crc();
     
-    A7105_Strobe(A7105_STANDBY);
-    A7105_Strobe(A7105_RST_WRPTR);
-    A7105_WritePayload((uint8_t*)&packet, sizeof(packet));
+    A7105_StrobeAndWritePayload(A7105_STANDBY, (uint8_t*)&packet, sizeof(packet));
     A7105_WriteRegister(A7105_0F_PLL_I, channel);
     A7105_Strobe(A7105_TX);
-    waitTRXCompletion();
+    // readrx() puts the radio back in RX once TRER clears, we don't wait for it here
 }
 
-void readrx(void) // todo : telemetry
+linkstatsstruct *getlinkstats(unsigned char secondsago)
 {
+    return &linkstats[(linkstatsnewest + LINKSTATSSECONDS - secondsago) % LINKSTATSSECONDS];
+}
+
+rxtimingstruct *getrxtiming(void)
+{
+    return &rxtiming;
+}
+
+static void updatelinkstats(void)
+{
+    if (lib_timers_gettimermicroseconds(linkstatstimer) < 1000000L)
+        return;
+    linkstatstimer += 1000000L;
+    if (currentlinkstats.validpackets)
+        currentlinkstats.rssi = currentrssisum / currentlinkstats.validpackets;
+    linkstatsnewest = (linkstatsnewest + 1) % LINKSTATSSECONDS;
+    linkstats[linkstatsnewest] = currentlinkstats;
+    currentlinkstats = nolinkstats;
+    currentrssisum = 0;
+}
+
+/**
+ * @brief      Advance the radio by one step
+ * @param      None.
+ * @return     None
+ * @details    RX armed -> packet ready -> decode -> TX queued -> TX done -> RX armed.
+ *             Each call polls TRER once and never waits for the radio, so the
+ *             telemetry air time overlaps the following loop passes.  Until the
+ *             handset is bound, each call is a step of the binding instead.
+ *             With RX_PREDICTIVE_WINDOW, TRER is only polled while the handset's
+ *             next packet is due.
+ */
+void readrx(void)
+{
+    if (bindphase != BIND_DONE) {
+        bindstep();
+        return;
+    }
+    
+    updatelinkstats();
+    
     if( lib_timers_gettimermicroseconds(timeout_timer) > 14000) {
+        // nothing heard for a while (or a TX that never finished), listen again
         timeout_timer = lib_timers_starttimer();
+        radiostate = RADIO_RX_ARMED;
         A7105_Strobe(A7105_RX);
+        if (currentlinkstats.timeouts < 255)
+            currentlinkstats.timeouts++;
     }
     
-    // Check if something received
+    if (radiostate == RADIO_TX_QUEUED) {
+        // TRER stays set until the telemetry is out, then listen for the next packet
+        if(!(A7105_ReadRegister(A7105_00_MODE) & A7105_MODE_TRER_MASK)) {
+            radiostate = RADIO_RX_ARMED;
+            A7105_Strobe(A7105_RX);
+        }
+        return;
+    }
+    
+#if (RX_PREDICTIVE_WINDOW==YES)
+    // nothing is due between the handset's packets.  One that comes early waits in the FIFO, the radio
+    // stops listening once it has a packet.
+    if (!rxtiming_expectingpacket(&rxtiming, lib_timers_starttimer()))
+        return;
+#endif
+    
+    // TRER stays set while the radio is still receiving
     if(A7105_ReadRegister(A7105_00_MODE) & A7105_MODE_TRER_MASK) {
-        // nothing received
         return; 
     }
-        
-    A7105_ReadPayload((uint8_t*)&packet, sizeof(packet)); 
-    if(!((packet[11]==txid[0])&&(packet[12]==txid[1])&&(packet[13]==txid[2])&&(packet[14]==txid[3]))&&0)
-        return; // not our TX !
-    if(!hubsan_check_integrity()&&0)
-        return; // bad checksum
+    
+    // the checksum byte makes the sum of all 16 bytes a multiple of 256
+    if(A7105_ReadPayload((uint8_t*)&packet, sizeof(packet)) != 0) {
+        // bad checksum, listen again
+        if (currentlinkstats.badchecksums < 255)
+            currentlinkstats.badchecksums++;
+        A7105_Strobe(A7105_RX);
+        return;
+    }
+    if(!((packet[11]==txid[0])&&(packet[12]==txid[1])&&(packet[13]==txid[2])&&(packet[14]==txid[3]))) {
+        // not our TX !
+        if (currentlinkstats.wrongtxid < 255)
+            currentlinkstats.wrongtxid++;
+        A7105_Strobe(A7105_RX);
+        return;
+    }
     timeout_timer = lib_timers_starttimer();
-    A7105_Strobe(A7105_RST_RDPTR);
+    rxtiming_packet(&rxtiming, timeout_timer);
+    if (currentlinkstats.validpackets < 255)
+        currentlinkstats.validpackets++;
+    currentrssisum += A7105_ReadRegister(A7105_1D_RSSI_THOLD);
     
     // Decode packet before send telemetry info : same array is used
     decodepacket();
 
+    // reset the failsafe timer
+    global.failsafetimer = lib_timers_starttimer();
+
 #if CONTROL_BOARD_TYPE == CONTROL_BOARD_HUBSAN_H107D
-		// Send info from quad
-		sendtelemetry();
+    // Send info from quad, the next calls to readrx() wait for it to go out.  Its slot is right after the
+    // handset's packet: about 2.5 ms with the SPI, and the next packet is a whole period (at least
+    // RXTIMINGMINPERIOD) away, so it is always back in RX in time.
+    sendtelemetry();
+    radiostate = RADIO_TX_QUEUED;
+    return;
 #endif
-
     A7105_Strobe(A7105_RX);
-
-    // reset the failsafe timer
-    global.failsafetimer = lib_timers_starttimer();
 }
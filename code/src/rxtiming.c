@@ -0,0 +1,99 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "rxtiming.h"
+
+// an interval counts as one period if it is within a quarter of a period of it
+#define RXTIMINGTOLERANCESHIFT 2
+// the period moves an eighth of the way to each new interval
+#define RXTIMINGFILTERSHIFT 3
+
+void rxtiming_init(rxtimingstruct *timing)
+{
+    timing->lastpacket = 0;
+    timing->lastseen = 0;
+    timing->period = 0;
+    timing->goodintervals = 0;
+    timing->missedpackets = 0;
+}
+
+/**
+ * @brief      Tell the timing that a packet was seen
+ * @param      timing, now  the time it was seen
+ * @return     None
+ * @details    An interval close to the period filters into the period and half of
+ *             the phase error is taken out.  Anything else starts the learning
+ *             again from the time since the last packet.  Until the period is
+ *             locked, a packet after missed ones starts again too, or a period
+ *             that is a fraction of the real one would look good.
+ */
+void rxtiming_packet(rxtimingstruct *timing, unsigned long now)
+{
+    long interval = (long) (now - timing->lastpacket);
+    long period = (long) (timing->period >> RXTIMINGPERIODSHIFT);
+    long error = interval - period;
+
+    if (period && (!timing->missedpackets || rxtiming_locked(timing))
+        && error < (period >> RXTIMINGTOLERANCESHIFT) && -error < (period >> RXTIMINGTOLERANCESHIFT)) {
+        timing->period += ((interval << RXTIMINGPERIODSHIFT) - (long) timing->period) >> RXTIMINGFILTERSHIFT;
+        if (!timing->missedpackets && timing->goodintervals < 255)
+            timing->goodintervals++;
+        // half way between when it was due and when it came
+        timing->lastpacket = now - (error >> 1);
+    } else {
+        interval = (long) (now - timing->lastseen);
+        if (interval >= RXTIMINGMINPERIOD && interval <= RXTIMINGMAXPERIOD)
+            timing->period = (unsigned long) interval << RXTIMINGPERIODSHIFT;
+        else
+            timing->period = 0;
+        timing->goodintervals = 0;
+        timing->lastpacket = now;
+    }
+    timing->lastseen = now;
+    timing->missedpackets = 0;
+}
+
+unsigned char rxtiming_locked(rxtimingstruct *timing)
+{
+    return timing->goodintervals >= RXTIMINGLOCKINTERVALS;
+}
+
+/**
+ * @brief      Is a packet due?
+ * @param      timing, now
+ * @return     1 from RXTIMINGEARLYMICROSECONDS before the next packet is due until
+ *             half a period after, and always while the period isn't locked.
+ * @details    When half a period goes by without the packet it is counted as
+ *             missed and the next one is expected a period later.  Too many in a
+ *             row and the period has to be learned again.
+ */
+unsigned char rxtiming_expectingpacket(rxtimingstruct *timing, unsigned long now)
+{
+    unsigned long period = timing->period >> RXTIMINGPERIODSHIFT;
+    unsigned long sincepacket = now - timing->lastpacket;
+
+    if (period && sincepacket >= period + (period >> 1)) {
+        timing->lastpacket += period;
+        sincepacket -= period;
+        if (timing->missedpackets < 255)
+            timing->missedpackets++;
+        if (timing->missedpackets > RXTIMINGMAXMISSED)
+            timing->goodintervals = 0;
+    }
+
+    if (!rxtiming_locked(timing))
+        return 1;
+    return sincepacket + RXTIMINGEARLYMICROSECONDS >= period;
+}
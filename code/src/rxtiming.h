@@ -0,0 +1,41 @@
+/*
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Learns the period and phase of a transmitter that sends on a fixed schedule (the Hubsan handset) from the
+// times its packets are seen, so that the receiver knows when the next one is due.  Times are microseconds
+// from lib_timers_starttimer().  No hardware is touched, lib-sim/bench/rxtiming_check.c runs the same code
+// against the handset captures in reverse/A7105/rawdata.
+
+#define RXTIMINGPERIODSHIFT 4           // the period is kept in 1/16 microseconds
+#define RXTIMINGMINPERIOD 4000L         // intervals outside of this aren't a packet period
+#define RXTIMINGMAXPERIOD 50000L
+#define RXTIMINGLOCKINTERVALS 4         // intervals in a row that have to agree with the period before it is used
+#define RXTIMINGMAXMISSED 4             // packets in a row that can be missed before the period is learned again
+#define RXTIMINGEARLYMICROSECONDS 3000L // start looking this long before the packet is due, more than a loop pass
+
+typedef struct {
+    unsigned long lastpacket;       // when the last packet came, or should have come
+    unsigned long lastseen;         // when the last packet came
+    unsigned long period;           // microseconds << RXTIMINGPERIODSHIFT, 0 until there has been an interval
+    unsigned char goodintervals;    // intervals in a row that agreed with the period
+    unsigned char missedpackets;    // periods in a row without a packet
+} rxtimingstruct;
+
+void rxtiming_init(rxtimingstruct *timing);
+void rxtiming_packet(rxtimingstruct *timing, unsigned long now);
+unsigned char rxtiming_locked(rxtimingstruct *timing);
+unsigned char rxtiming_expectingpacket(rxtimingstruct *timing, unsigned long now);
@@ -33,6 +33,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "eeprom.h"
 #include "imu.h"
 #include "gps.h"
+#include "profiler.h"
+#include "blackbox.h"
 
 #define MSP_VERSION 0
 #define  VERSION  112           // version 1.12
@@ -86,17 +88,41 @@ unsigned char serialreceivestate[5] = { 0 };
 unsigned char serialcommand[5];
 unsigned char serialdatasize[5];
 unsigned char serialchecksum[5];
+// the response being written, straight into the send buffer of its port.  There is one at a time.
+serialframestruct serialframe;
+unsigned char serialresponsesize;      // of the last response, with its header and checksum
+bool serialbatching;            // the response is one of those in an MSP_MULTIPLE response
+
+#if (MSP_TELEMETRY==YES)
+// responses sent without a request, set up with MSP_SET_TELEMETRY.  A slot with a period of 0 is free.
+#define MSPTELEMETRYSLOTS 4
+
+typedef struct {
+    unsigned long periodmicroseconds;
+    unsigned long lastsent;     // when it was due last, from lib_timers_starttimer()
+    unsigned char command;
+    unsigned char portnumber;
+} msptelemetrystruct;
+
+msptelemetrystruct msptelemetry[MSPTELEMETRYSLOTS];
+unsigned char msptelemetrynextslot;     // the slot the budget runs out on goes first next time
+#endif
 
 void sendandchecksumcharacter(char portnumber, unsigned char c)
 {
-    lib_serial_sendchar(portnumber, c);
+    lib_serial_framechar(&serialframe, c);
     serialchecksum[portnumber] ^= c;
 }
 
 void sendandchecksumdata(char portnumber, unsigned char *data, char length)
 {
-    for (int x = 0; x < length; ++x)
-        sendandchecksumcharacter(portnumber, data[x]);
+    serialframestruct *frame = &serialframe;
+    unsigned char checksum = serialchecksum[portnumber];
+    for (int x = 0; x < length; ++x) {
+        lib_serial_framechar(frame, data[x]);
+        checksum ^= data[x];
+    }
+    serialchecksum[portnumber] = checksum;
 }
 
 void sendandchecksumint(char portnumber, unsigned int value)
@@ -109,203 +135,634 @@ void sendandchecksumlong(char portnumber, unsigned long value)
     sendandchecksumdata(portnumber, (unsigned char *) &value, 4);
 }
 
+// $M> or $M!, the size and the command go in front of the data, the checksum after it
+#define MSPFRAMEOVERHEAD 6
+
+// we don't start a response until it fits in the output buffer, or this much does for the ones that are longer.
+// Those go out in pieces as the buffer empties, which can hold up the main loop.  It is as much as the 64 byte send
+// buffers can hold.
+#define MSPMAXRESPONSESPACE 63
+
+// MSP_BLACKBOX_READ sends this much of the log at a time
+#define MSPBLACKBOXCHUNK 32
+
+// an MSP_MULTIPLE response is never longer than the send buffer, so it goes out without holding up the main loop
+#define MSPMULTIPLEMAXSIZE (MSPMAXRESPONSESPACE - MSPFRAMEOVERHEAD)
+
 void sendgoodheader(char portnumber, unsigned char size)
 {
-    lib_serial_sendchar(portnumber, '$');
-    lib_serial_sendchar(portnumber, 'M');
-    lib_serial_sendchar(portnumber, '>');
-    lib_serial_sendchar(portnumber, size);
-    serialchecksum[portnumber] = size;
-    sendandchecksumcharacter(portnumber, serialcommand[portnumber]);
+    serialframestruct *frame = &serialframe;
+    if (serialbatching) {       // inside the MSP_MULTIPLE frame only the size goes in front of the data
+        sendandchecksumcharacter(portnumber, size);
+        return;
+    }
+    lib_serial_beginframe(portnumber, frame, size + MSPFRAMEOVERHEAD);
+    serialresponsesize = size + MSPFRAMEOVERHEAD;
+    lib_serial_framechar(frame, '$');
+    lib_serial_framechar(frame, 'M');
+    lib_serial_framechar(frame, '>');
+    lib_serial_framechar(frame, size);
+    lib_serial_framechar(frame, serialcommand[portnumber]);
+    serialchecksum[portnumber] = size ^ serialcommand[portnumber];
 }
 
 void senderrorheader(char portnumber)
 {
-    lib_serial_sendchar(portnumber, '$');
-    lib_serial_sendchar(portnumber, 'M');
-    lib_serial_sendchar(portnumber, '!');
-    lib_serial_sendchar(portnumber, 0);
-    serialchecksum[portnumber] = 0;
-    sendandchecksumcharacter(portnumber, serialcommand[portnumber]);
+    serialframestruct *frame = &serialframe;
+    lib_serial_beginframe(portnumber, frame, MSPFRAMEOVERHEAD);
+    serialresponsesize = MSPFRAMEOVERHEAD;
+    lib_serial_framechar(frame, '$');
+    lib_serial_framechar(frame, 'M');
+    lib_serial_framechar(frame, '!');
+    lib_serial_framechar(frame, 0);
+    lib_serial_framechar(frame, serialcommand[portnumber]);
+    serialchecksum[portnumber] = serialcommand[portnumber];
 }
 
-void evaluatecommand(char portnumber, unsigned char *data)
+// the commands we answer.  Each one has a function that writes its response and an entry in mspcommands.
+static bool mspanswerswithoutrequest(unsigned char command);
+
+static void mspident(char portnumber, unsigned char *data)
 {
-    unsigned char command = serialcommand[portnumber];
-    if (command == MSP_IDENT) { // send rx data
-        sendgoodheader(portnumber, 7);
-        sendandchecksumcharacter(portnumber, VERSION);
-        sendandchecksumcharacter(portnumber, AIRCRAFT_CONFIGURATION);
-        sendandchecksumcharacter(portnumber, MSP_VERSION);
-        for (int x = 0; x < 4; ++x)
-            sendandchecksumcharacter(portnumber, 0);    // 32 bit "capability"
-    } else if (command == MSP_RC) {     // send rx data
-        sendgoodheader(portnumber, 16);
-        for (int x = 0; x < 8; ++x) {
-            int value = 0;
-            if (x < RXNUMCHANNELS)
-                value = ((global.rxvalues[x] * 500L) >>FIXEDPOINTSHIFT) + 1500;
-
-            sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
-        }
-    } else if (command == MSP_ATTITUDE) {       // send attitude data
-        sendgoodheader(portnumber, 6);
-        // convert our estimated gravity vector into roll and pitch angles
-        int value;
-        value = (global.currentestimatedeulerattitude[0] * 10) >>FIXEDPOINTSHIFT;
+    sendgoodheader(portnumber, 7);
+    sendandchecksumcharacter(portnumber, VERSION);
+    sendandchecksumcharacter(portnumber, AIRCRAFT_CONFIGURATION);
+    sendandchecksumcharacter(portnumber, MSP_VERSION);
+    for (int x = 0; x < 4; ++x)
+        sendandchecksumcharacter(portnumber, 0);        // 32 bit "capability"
+}
+
+static void msprc(char portnumber, unsigned char *data)
+{
+    sendgoodheader(portnumber, 16);
+    for (int x = 0; x < 8; ++x) {
+        int value = 0;
+        if (x < RXNUMCHANNELS)
+            value = ((global.rxvalues[x] * 500L) >>FIXEDPOINTSHIFT) + 1500;
+
+        sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
+    }
+}
+
+static void mspattitude(char portnumber, unsigned char *data)
+{
+    sendgoodheader(portnumber, 6);
+    // convert our estimated gravity vector into roll and pitch angles
+    imuupdateeulerattitude();
+    int value;
+    value = (global.currentestimatedeulerattitude[0] * 10) >>FIXEDPOINTSHIFT;
+    sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
+    value = (global.currentestimatedeulerattitude[1] * 10) >>FIXEDPOINTSHIFT;
+    sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
+    value = (global.currentestimatedeulerattitude[2]) >>FIXEDPOINTSHIFT;
+    sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
+}
+
+static void mspaltitude(char portnumber, unsigned char *data)
+{
+    sendgoodheader(portnumber, 4);
+    fixedpointnum fp = (global.altitude * 25) >>(FIXEDPOINTSHIFT - 2);
+    sendandchecksumdata(portnumber, (unsigned char *) &fp, 4);
+}
+
+static void mspmagcalibration(char portnumber, unsigned char *data)
+{
+    if (!global.armed)
+        calibratecompass();
+    sendgoodheader(portnumber, 0);
+}
+
+static void mspacccalibration(char portnumber, unsigned char *data)
+{
+    if (!global.armed)
+        calibrategyroandaccelerometer(true);
+    sendgoodheader(portnumber, 0);
+}
+
+static void msprawimu(char portnumber, unsigned char *data)
+{
+    sendgoodheader(portnumber, 18);
+    for (int x = 0; x < 3; ++x) {       // convert from g's to what multiwii uses
+        int value = global.acc_g_vector[x] >> 8;
         sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
-        value = (global.currentestimatedeulerattitude[1] * 10) >>FIXEDPOINTSHIFT;
+    }
+    for (int x = 0; x < 3; ++x) {       // convert from degrees per second to /8000
+        int value = (global.gyrorate[x]) >>14;  // this is aproximate
         sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
-        value = (global.currentestimatedeulerattitude[2]) >>FIXEDPOINTSHIFT;
+    }
+    for (int x = 0; x < 3; ++x) {       // convert from
+        int value = (global.compassvector[x]) >>8;
         sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
-    } else if (command == MSP_ALTITUDE) {       // send attitude data
-        sendgoodheader(portnumber, 4);
-        fixedpointnum fp = (global.altitude * 25) >>(FIXEDPOINTSHIFT - 2);
-        sendandchecksumdata(portnumber, (unsigned char *) &fp, 4);
-    } else if (command == MSP_MAG_CALIBRATION) {        // send attitude data
-        if (!global.armed)
-            calibratecompass();
-        sendgoodheader(portnumber, 0);
-    } else if (command == MSP_ACC_CALIBRATION) {        // send attitude data
-        if (!global.armed)
-            calibrategyroandaccelerometer(true);
-        sendgoodheader(portnumber, 0);
     }
+}
 
-    else if (command == MSP_RAW_IMU) {  // send attitude data
-        sendgoodheader(portnumber, 18);
-        for (int x = 0; x < 3; ++x) {   // convert from g's to what multiwii uses
-            int value = global.acc_g_vector[x] >> 8;
-            sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
-        }
-        for (int x = 0; x < 3; ++x) {   // convert from degrees per second to /8000
-            int value = (global.gyrorate[x]) >>14;      // this is aproximate
-            sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
-        }
-        for (int x = 0; x < 3; ++x) {   // convert from
-            int value = (global.compassvector[x]) >>8;
-            sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
-        }
-    } else if (command == MSP_STATUS) { // send attitude data
-        sendgoodheader(portnumber, 10);
-        sendandchecksumint(portnumber, (global.timesliver * 15) >>8);   // convert from fixedpointnum to microseconds
-        sendandchecksumint(portnumber, lib_i2c_error_count);    // i2c error count
-        sendandchecksumint(portnumber, CAPABILITES);    // baro mag, gps, sonar
-        sendandchecksumdata(portnumber, (unsigned char *) &global.activecheckboxitems, 4);      // options1
-    } else if (command == MSP_MOTOR) {  // send motor output data
-        sendgoodheader(portnumber, 16);
-        for (int x = 0; x < 8; ++x) {
-            if (x < NUMMOTORS)
-                sendandchecksumint(portnumber, global.motoroutputvalue[x]);     // current motor value
-            else
-                sendandchecksumint(portnumber, 0);
-        }
-    } else if (command == MSP_PID) {    // send pid data
-        sendgoodheader(portnumber, 3 * NUMPIDITEMS);
-        for (int x = 0; x < NUMPIDITEMS; ++x) {
-            if (x == ALTITUDEINDEX)
-                sendandchecksumcharacter(portnumber, usersettings.pid_pgain[x] >> 7);
-            else if (x == NAVIGATIONINDEX)
-                sendandchecksumcharacter(portnumber, usersettings.pid_pgain[x] >> 11);
-            else
-                sendandchecksumcharacter(portnumber, usersettings.pid_pgain[x] >> 3);
-            sendandchecksumcharacter(portnumber, usersettings.pid_igain[x]);
-            if (x == NAVIGATIONINDEX)
-                sendandchecksumcharacter(portnumber, usersettings.pid_dgain[x] >> 8);
-            else if (x == ALTITUDEINDEX)
-                sendandchecksumcharacter(portnumber, usersettings.pid_dgain[x] >> 9);
-            else
-                sendandchecksumcharacter(portnumber, usersettings.pid_dgain[x] >> 2);
-        }
-    } else if (command == MSP_SET_PID) {
-        for (int x = 0; x < NUMPIDITEMS; ++x) {
-            if (x == ALTITUDEINDEX)
-                usersettings.pid_pgain[x] = ((fixedpointnum) (*data++)) << 7;
-            else if (x == NAVIGATIONINDEX)
-                usersettings.pid_pgain[x] = ((fixedpointnum) (*data++)) << 11;
-            else
-                usersettings.pid_pgain[x] = ((fixedpointnum) (*data++)) << 3;
-            usersettings.pid_igain[x] = ((fixedpointnum) (*data++));
-            if (x == NAVIGATIONINDEX)
-                usersettings.pid_dgain[x] = ((fixedpointnum) (*data++)) << 8;
-            else if (x == ALTITUDEINDEX)
-                usersettings.pid_dgain[x] = ((fixedpointnum) (*data++)) << 9;
-            else
-                usersettings.pid_dgain[x] = ((fixedpointnum) (*data++)) << 2;
+static void mspstatus(char portnumber, unsigned char *data)
+{
+    sendgoodheader(portnumber, 10);
+    sendandchecksumint(portnumber, (global.timesliver * 15) >>8);       // convert from fixedpointnum to microseconds
+    sendandchecksumint(portnumber, lib_i2c_error_count);        // i2c error count
+    sendandchecksumint(portnumber, CAPABILITES);        // baro mag, gps, sonar
+    sendandchecksumdata(portnumber, (unsigned char *) &global.activecheckboxitems, 4);  // options1
+}
 
-        }
+static void mspmotor(char portnumber, unsigned char *data)
+{
+    sendgoodheader(portnumber, 16);
+    for (int x = 0; x < 8; ++x) {
+        if (x < NUMMOTORS)
+            sendandchecksumint(portnumber, global.motoroutputvalue[x]); // current motor value
+        else
+            sendandchecksumint(portnumber, 0);
+    }
+}
+
+static void msppid(char portnumber, unsigned char *data)
+{
+    sendgoodheader(portnumber, 3 * NUMPIDITEMS);
+    for (int x = 0; x < NUMPIDITEMS; ++x) {
+        if (x == ALTITUDEINDEX)
+            sendandchecksumcharacter(portnumber, usersettings.pid_pgain[x] >> 7);
+        else if (x == NAVIGATIONINDEX)
+            sendandchecksumcharacter(portnumber, usersettings.pid_pgain[x] >> 11);
+        else
+            sendandchecksumcharacter(portnumber, usersettings.pid_pgain[x] >> 3);
+        sendandchecksumcharacter(portnumber, usersettings.pid_igain[x]);
+        if (x == NAVIGATIONINDEX)
+            sendandchecksumcharacter(portnumber, usersettings.pid_dgain[x] >> 8);
+        else if (x == ALTITUDEINDEX)
+            sendandchecksumcharacter(portnumber, usersettings.pid_dgain[x] >> 9);
+        else
+            sendandchecksumcharacter(portnumber, usersettings.pid_dgain[x] >> 2);
+    }
+}
+
+static void mspsetpid(char portnumber, unsigned char *data)
+{
+    for (int x = 0; x < NUMPIDITEMS; ++x) {
+        if (x == ALTITUDEINDEX)
+            usersettings.pid_pgain[x] = ((fixedpointnum) (*data++)) << 7;
+        else if (x == NAVIGATIONINDEX)
+            usersettings.pid_pgain[x] = ((fixedpointnum) (*data++)) << 11;
+        else
+            usersettings.pid_pgain[x] = ((fixedpointnum) (*data++)) << 3;
+        usersettings.pid_igain[x] = ((fixedpointnum) (*data++));
+        if (x == NAVIGATIONINDEX)
+            usersettings.pid_dgain[x] = ((fixedpointnum) (*data++)) << 8;
+        else if (x == ALTITUDEINDEX)
+            usersettings.pid_dgain[x] = ((fixedpointnum) (*data++)) << 9;
+        else
+            usersettings.pid_dgain[x] = ((fixedpointnum) (*data++)) << 2;
+
+    }
 // while testing, make roll pid equal to pitch pid so I only have to change one thing.
 //usersettings.pid_pgain[ROLLINDEX]=usersettings.pid_pgain[PITCHINDEX];
 //usersettings.pid_igain[ROLLINDEX]=usersettings.pid_igain[PITCHINDEX];
 //usersettings.pid_dgain[ROLLINDEX]=usersettings.pid_dgain[PITCHINDEX];
+    sendgoodheader(portnumber, 0);
+}
+
+static void mspdebug(char portnumber, unsigned char *data)
+{
+    sendgoodheader(portnumber, 8);
+    for (int x = 0; x < 4; ++x) {
+        int value = global.debugvalue[x];
+        sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
+    }
+}
+
+static void mspbat(char portnumber, unsigned char *data)
+{
+    sendgoodheader(portnumber, 3);
+    sendandchecksumcharacter(portnumber, (global.batteryvoltage * 10) >> FIXEDPOINTSHIFT);      // vbat in 0.1 V
+    sendandchecksumint(portnumber, 0);  // powermetersum
+}
+
+static void mspboxnames(char portnumber, unsigned char *data)
+{
+    char length = strlen(checkboxnames);
+    sendgoodheader(portnumber, length);
+    sendandchecksumdata(portnumber, (unsigned char *) checkboxnames, length);
+}
+
+static void mspsetbox(char portnumber, unsigned char *data)
+{
+    unsigned char *ptr = (unsigned char *) usersettings.checkboxconfiguration;
+    for (int x = 0; x < NUMCHECKBOXES * 2; ++x) {
+        *ptr++ = *data++;
+    }
+    sendgoodheader(portnumber, 0);
+}
+
+static void mspbox(char portnumber, unsigned char *data)
+{
+    sendgoodheader(portnumber, NUMCHECKBOXES * 2);
+    sendandchecksumdata(portnumber, (unsigned char *) usersettings.checkboxconfiguration, NUMCHECKBOXES * 2);
+}
+
+static void mspresetconf(char portnumber, unsigned char *data)
+{
+    sendgoodheader(portnumber, 0);
+    defaultusersettings();
+}
+
+static void mspeepromwrite(char portnumber, unsigned char *data)
+{
+    sendgoodheader(portnumber, 0);
+    if (!global.armed)
+        writeusersettingstoeeprom();
+}
+
+static void msprawgps(char portnumber, unsigned char *data)
+{
+    sendgoodheader(portnumber, 14);
+    sendandchecksumcharacter(portnumber, 0);    // gps fix
+    sendandchecksumcharacter(portnumber, global.gps_num_satelites);
+    sendandchecksumlong(portnumber, lib_fp_multiply(global.gps_current_latitude, 156250L));     //156250L is 10,000,000L>>LATLONGEXTRASHIFT); 
+    sendandchecksumlong(portnumber, lib_fp_multiply(global.gps_current_longitude, 156250L));
+    sendandchecksumint(portnumber, global.gps_current_altitude >> FIXEDPOINTSHIFT);     // gps altitude
+    sendandchecksumint(portnumber, (global.gps_current_speed * 100) >>FIXEDPOINTSHIFT); // gps speed
+}
+
+static void mspcompgps(char portnumber, unsigned char *data)
+{
+    sendgoodheader(portnumber, 5);
+    sendandchecksumint(portnumber, (global.navigation_distance) >>FIXEDPOINTSHIFT);
+    sendandchecksumint(portnumber, (global.navigation_bearing) >>FIXEDPOINTSHIFT);
+    sendandchecksumcharacter(portnumber, 0);    // gps update
+}
+
+static void msprctuning(char portnumber, unsigned char *data)
+{
+    sendgoodheader(portnumber, 7);
+    sendandchecksumcharacter(portnumber, 0);    // rcRate
+    sendandchecksumcharacter(portnumber, 0);    // rcExpo
+    sendandchecksumcharacter(portnumber, usersettings.maxpitchandrollrate >> (FIXEDPOINTSHIFT + 3));    // rollPitchRate
+    sendandchecksumcharacter(portnumber, usersettings.maxyawrate >> (FIXEDPOINTSHIFT + 2));     // yawRate
+    sendandchecksumcharacter(portnumber, 0);    // dynThrPID
+    sendandchecksumcharacter(portnumber, 0);    // thrMid8
+    sendandchecksumcharacter(portnumber, 0);    // thrExpo8
+}
+
+static void mspsetrctuning(char portnumber, unsigned char *data)
+{
+    data++;                     //rcRate
+    data++;                     //rcExpo
+    usersettings.maxpitchandrollrate = ((fixedpointnum) (*data++)) << (FIXEDPOINTSHIFT + 3);    // rollPitchRate
+    usersettings.maxyawrate = ((fixedpointnum) (*data++)) << (FIXEDPOINTSHIFT + 2);     // yawRate
+    data++;                     // dynThrPID
+    data++;                     // thrMid8
+    data++;                     // thrExpo8
+    sendgoodheader(portnumber, 0);
+}
+
+#if (LOOP_PROFILER==YES)
+static void msploopprofile(char portnumber, unsigned char *data)
+{
+    // send the timing of one main loop stage, or of the whole loop
+    unsigned char entrynumber = PROFILERLOOP;
+    if (serialdatasize[portnumber] && data[0] < PROFILERNUMENTRIES)
+        entrynumber = data[0];
+    profilerentrystruct *entry = getprofilerentry(entrynumber);
+    sendgoodheader(portnumber, 2 + 4 + 3 * 2 + PROFILERNUMBUCKETS * 2);
+    sendandchecksumcharacter(portnumber, entrynumber);
+    sendandchecksumcharacter(portnumber, PROFILERNUMENTRIES);
+    sendandchecksumlong(portnumber, entry->count);
+    sendandchecksumint(portnumber, entry->count ? entry->minmicroseconds : 0);
+    sendandchecksumint(portnumber, profileraveragemicroseconds(entry));
+    sendandchecksumint(portnumber, entry->maxmicroseconds);
+    for (int x = 0; x < PROFILERNUMBUCKETS; ++x)
+        sendandchecksumint(portnumber, entry->bucket[x]);
+}
+
+static void mspresetloopprofile(char portnumber, unsigned char *data)
+{
+    resetprofiler();
+    sendgoodheader(portnumber, 0);
+}
+#endif
+
+#if (MSP_TELEMETRY==YES)
+static void mspsettelemetry(char portnumber, unsigned char *data)
+{
+    // replace the responses pushed to this port
+    unsigned char pairs = serialdatasize[portnumber] / 2;
+    bool good = pairs <= MSPTELEMETRYSLOTS;
+    for (int x = 0; x < pairs && good; ++x)
+        good = mspanswerswithoutrequest(data[x * 2]);
+    for (int x = 0; x < MSPTELEMETRYSLOTS && good; ++x) {
+        if (msptelemetry[x].portnumber == portnumber)
+            msptelemetry[x].periodmicroseconds = 0;
+    }
+    for (int x = 0, slot = 0; x < pairs && good; ++x) {
+        if (!data[x * 2 + 1])
+            continue;
+        while (msptelemetry[slot].periodmicroseconds && slot < MSPTELEMETRYSLOTS - 1)
+            ++slot;
+        if (msptelemetry[slot].periodmicroseconds)
+            break;              // another port has the rest of the slots
+        msptelemetry[slot].command = data[x * 2];
+        msptelemetry[slot].portnumber = portnumber;
+        msptelemetry[slot].periodmicroseconds = 1000000L / data[x * 2 + 1];
+        msptelemetry[slot].lastsent = lib_timers_starttimer();
+    }
+    if (good)
         sendgoodheader(portnumber, 0);
-    } else if (command == MSP_DEBUG) {  // send debug data
-        sendgoodheader(portnumber, 8);
-        for (int x = 0; x < 4; ++x) {
-            int value = global.debugvalue[x];
-            sendandchecksumdata(portnumber, (unsigned char *) &value, 2);
-        }
-    } else if (command == MSP_BOXNAMES) {       // send names of checkboxes
-        char length = strlen(checkboxnames);
-        sendgoodheader(portnumber, length);
-        sendandchecksumdata(portnumber, (unsigned char *) checkboxnames, length);
-    } else if (command == MSP_SET_BOX) {        // receive check box settings
-        unsigned char *ptr = (unsigned char *) usersettings.checkboxconfiguration;
-        for (int x = 0; x < NUMCHECKBOXES * 2; ++x) {
-            *ptr++ = *data++;
+    else
+        senderrorheader(portnumber);
+}
+#endif
+
+static void mspstartuptimes(char portnumber, unsigned char *data)
+{
+    sendgoodheader(portnumber, 12);
+    sendandchecksumlong(portnumber, global.startupcalibratedtime);
+    sendandchecksumlong(portnumber, global.startupboundtime);
+    sendandchecksumlong(portnumber, global.startupreadytime);
+}
+
+#if (BLACKBOX==YES)
+static void mspblackboxread(char portnumber, unsigned char *data)
+{
+    // send a piece of the flight log
+    unsigned long offset = 0;
+    unsigned char chunk[MSPBLACKBOXCHUNK];
+    if (serialdatasize[portnumber] >= 4)
+        memcpy(&offset, data, 4);
+    unsigned char size = blackboxread(chunk, offset, MSPBLACKBOXCHUNK);
+    sendgoodheader(portnumber, 8 + size);
+    sendandchecksumlong(portnumber, offset);
+    sendandchecksumlong(portnumber, BLACKBOXSIZE);
+    sendandchecksumdata(portnumber, chunk, size);
+}
+#endif
+
+#if (RX_TYPE==RX_SOFT_3_WIRE_SPI_PROTOCOL)
+static void msplinkstats(char portnumber, unsigned char *data)
+{
+    // send the radio link statistics of one of the last seconds
+    unsigned char secondsago = 0;
+    if (serialdatasize[portnumber] && data[0] < LINKSTATSSECONDS)
+        secondsago = data[0];
+    linkstatsstruct *stats = getlinkstats(secondsago);
+    sendgoodheader(portnumber, 7);
+    sendandchecksumcharacter(portnumber, secondsago);
+    sendandchecksumcharacter(portnumber, LINKSTATSSECONDS);
+    sendandchecksumcharacter(portnumber, stats->validpackets);
+    sendandchecksumcharacter(portnumber, stats->badchecksums);
+    sendandchecksumcharacter(portnumber, stats->wrongtxid);
+    sendandchecksumcharacter(portnumber, stats->timeouts);
+    sendandchecksumcharacter(portnumber, stats->rssi);
+}
+#endif
+
+static void mspmultiple(char portnumber, unsigned char *data);
+
+typedef struct {
+    void (*handler) (char portnumber, unsigned char *data);
+    unsigned char payloadsize;  // the least the request has to bring, shorter ones get an error
+    unsigned char responsesize; // the most the handler sends, without the frame.  MSP_MULTIPLE relies on it being
+                                // exact for the out messages that don't need a payload
+    bool variablesize;          // the response can be shorter, so it can't be part of an MSP_MULTIPLE or be pushed
+} mspcommandstruct;
+
+// the box names are longer than the send buffer, they go out in pieces
+#define MSPBOXNAMESSIZE 255
+
+// where each command is in mspcommands.  Entry 0 is for the commands we don't know.
+enum {
+    MSPUNKNOWNENTRY,
+    MSPIDENTENTRY,
+    MSPRCENTRY,
+    MSPATTITUDEENTRY,
+    MSPALTITUDEENTRY,
+    MSPMAGCALIBRATIONENTRY,
+    MSPACCCALIBRATIONENTRY,
+    MSPRAWIMUENTRY,
+    MSPSTATUSENTRY,
+    MSPMOTORENTRY,
+    MSPPIDENTRY,
+    MSPSETPIDENTRY,
+    MSPDEBUGENTRY,
+    MSPBATENTRY,
+    MSPBOXNAMESENTRY,
+    MSPSETBOXENTRY,
+    MSPBOXENTRY,
+    MSPRESETCONFENTRY,
+    MSPEEPROMWRITEENTRY,
+    MSPRAWGPSENTRY,
+    MSPCOMPGPSENTRY,
+    MSPRCTUNINGENTRY,
+    MSPSETRCTUNINGENTRY,
+#if (LOOP_PROFILER==YES)
+    MSPLOOPPROFILEENTRY,
+    MSPRESETLOOPPROFILEENTRY,
+#endif
+#if (MSP_TELEMETRY==YES)
+    MSPSETTELEMETRYENTRY,
+#endif
+    MSPSTARTUPTIMESENTRY,
+#if (BLACKBOX==YES)
+    MSPBLACKBOXREADENTRY,
+#endif
+#if (RX_TYPE==RX_SOFT_3_WIRE_SPI_PROTOCOL)
+    MSPLINKSTATSENTRY,
+#endif
+    MSPMULTIPLEENTRY,
+    MSPNUMENTRIES
+};
+
+const mspcommandstruct mspcommands[MSPNUMENTRIES] = {
+    [MSPUNKNOWNENTRY] = {NULL, 0, 0},
+    [MSPIDENTENTRY] = {mspident, 0, 7},
+    [MSPRCENTRY] = {msprc, 0, 16},
+    [MSPATTITUDEENTRY] = {mspattitude, 0, 6},
+    [MSPALTITUDEENTRY] = {mspaltitude, 0, 4},
+    [MSPMAGCALIBRATIONENTRY] = {mspmagcalibration, 0, 0},
+    [MSPACCCALIBRATIONENTRY] = {mspacccalibration, 0, 0},
+    [MSPRAWIMUENTRY] = {msprawimu, 0, 18},
+    [MSPSTATUSENTRY] = {mspstatus, 0, 10},
+    [MSPMOTORENTRY] = {mspmotor, 0, 16},
+    [MSPPIDENTRY] = {msppid, 0, 3 * NUMPIDITEMS},
+    [MSPSETPIDENTRY] = {mspsetpid, 3 * NUMPIDITEMS, 0},
+    [MSPDEBUGENTRY] = {mspdebug, 0, 8},
+    [MSPBATENTRY] = {mspbat, 0, 3},
+    [MSPBOXNAMESENTRY] = {mspboxnames, 0, MSPBOXNAMESSIZE},
+    [MSPSETBOXENTRY] = {mspsetbox, NUMCHECKBOXES * 2, 0},
+    [MSPBOXENTRY] = {mspbox, 0, NUMCHECKBOXES * 2},
+    [MSPRESETCONFENTRY] = {mspresetconf, 0, 0},
+    [MSPEEPROMWRITEENTRY] = {mspeepromwrite, 0, 0},
+    [MSPRAWGPSENTRY] = {msprawgps, 0, 14},
+    [MSPCOMPGPSENTRY] = {mspcompgps, 0, 5},
+    [MSPRCTUNINGENTRY] = {msprctuning, 0, 7},
+    [MSPSETRCTUNINGENTRY] = {mspsetrctuning, 7, 0},
+#if (LOOP_PROFILER==YES)
+    [MSPLOOPPROFILEENTRY] = {msploopprofile, 0, 2 + 4 + 3 * 2 + PROFILERNUMBUCKETS * 2},
+    [MSPRESETLOOPPROFILEENTRY] = {mspresetloopprofile, 0, 0},
+#endif
+#if (MSP_TELEMETRY==YES)
+    [MSPSETTELEMETRYENTRY] = {mspsettelemetry, 0, 0},
+#endif
+    [MSPSTARTUPTIMESENTRY] = {mspstartuptimes, 0, 12},
+#if (BLACKBOX==YES)
+    [MSPBLACKBOXREADENTRY] = {mspblackboxread, 0, 8 + MSPBLACKBOXCHUNK, true},
+#endif
+#if (RX_TYPE==RX_SOFT_3_WIRE_SPI_PROTOCOL)
+    [MSPLINKSTATSENTRY] = {msplinkstats, 0, 7},
+#endif
+    [MSPMULTIPLEENTRY] = {mspmultiple, 1, MSPMULTIPLEMAXSIZE},
+};
+
+// the entry of each command number from MSP_IDENT up, a byte each so that the table fits in flash.  Anything not
+// listed is 0, MSPUNKNOWNENTRY.
+#define MSPFIRSTCOMMAND MSP_IDENT
+
+const unsigned char mspcommandindex[256 - MSPFIRSTCOMMAND] = {
+    [MSP_IDENT - MSPFIRSTCOMMAND] = MSPIDENTENTRY,
+    [MSP_RC - MSPFIRSTCOMMAND] = MSPRCENTRY,
+    [MSP_ATTITUDE - MSPFIRSTCOMMAND] = MSPATTITUDEENTRY,
+    [MSP_ALTITUDE - MSPFIRSTCOMMAND] = MSPALTITUDEENTRY,
+    [MSP_MAG_CALIBRATION - MSPFIRSTCOMMAND] = MSPMAGCALIBRATIONENTRY,
+    [MSP_ACC_CALIBRATION - MSPFIRSTCOMMAND] = MSPACCCALIBRATIONENTRY,
+    [MSP_RAW_IMU - MSPFIRSTCOMMAND] = MSPRAWIMUENTRY,
+    [MSP_STATUS - MSPFIRSTCOMMAND] = MSPSTATUSENTRY,
+    [MSP_MOTOR - MSPFIRSTCOMMAND] = MSPMOTORENTRY,
+    [MSP_PID - MSPFIRSTCOMMAND] = MSPPIDENTRY,
+    [MSP_SET_PID - MSPFIRSTCOMMAND] = MSPSETPIDENTRY,
+    [MSP_DEBUG - MSPFIRSTCOMMAND] = MSPDEBUGENTRY,
+    [MSP_BAT - MSPFIRSTCOMMAND] = MSPBATENTRY,
+    [MSP_BOXNAMES - MSPFIRSTCOMMAND] = MSPBOXNAMESENTRY,
+    [MSP_SET_BOX - MSPFIRSTCOMMAND] = MSPSETBOXENTRY,
+    [MSP_BOX - MSPFIRSTCOMMAND] = MSPBOXENTRY,
+    [MSP_RESET_CONF - MSPFIRSTCOMMAND] = MSPRESETCONFENTRY,
+    [MSP_EEPROM_WRITE - MSPFIRSTCOMMAND] = MSPEEPROMWRITEENTRY,
+    [MSP_RAW_GPS - MSPFIRSTCOMMAND] = MSPRAWGPSENTRY,
+    [MSP_COMP_GPS - MSPFIRSTCOMMAND] = MSPCOMPGPSENTRY,
+    [MSP_RC_TUNING - MSPFIRSTCOMMAND] = MSPRCTUNINGENTRY,
+    [MSP_SET_RC_TUNING - MSPFIRSTCOMMAND] = MSPSETRCTUNINGENTRY,
+#if (LOOP_PROFILER==YES)
+    [MSP_LOOP_PROFILE - MSPFIRSTCOMMAND] = MSPLOOPPROFILEENTRY,
+    [MSP_RESET_LOOP_PROFILE - MSPFIRSTCOMMAND] = MSPRESETLOOPPROFILEENTRY,
+#endif
+#if (MSP_TELEMETRY==YES)
+    [MSP_SET_TELEMETRY - MSPFIRSTCOMMAND] = MSPSETTELEMETRYENTRY,
+#endif
+    [MSP_STARTUP_TIMES - MSPFIRSTCOMMAND] = MSPSTARTUPTIMESENTRY,
+#if (BLACKBOX==YES)
+    [MSP_BLACKBOX_READ - MSPFIRSTCOMMAND] = MSPBLACKBOXREADENTRY,
+#endif
+#if (RX_TYPE==RX_SOFT_3_WIRE_SPI_PROTOCOL)
+    [MSP_LINK_STATS - MSPFIRSTCOMMAND] = MSPLINKSTATSENTRY,
+#endif
+    [MSP_MULTIPLE - MSPFIRSTCOMMAND] = MSPMULTIPLEENTRY,
+};
+
+static const mspcommandstruct *getmspcommand(unsigned char command)
+{
+    if (command < MSPFIRSTCOMMAND)
+        return &mspcommands[MSPUNKNOWNENTRY];
+    return &mspcommands[mspcommandindex[command - MSPFIRSTCOMMAND]];
+}
+
+static int mspresponsespace(unsigned char command)
+{
+    const mspcommandstruct *entry = getmspcommand(command);
+    int space = (entry->handler ? entry->responsesize : 0) + MSPFRAMEOVERHEAD;
+    return space < MSPMAXRESPONSESPACE ? space : MSPMAXRESPONSESPACE;
+}
+
+static bool mspanswerswithoutrequest(unsigned char command)
+{
+    // whether the command can be pushed by MSP_SET_TELEMETRY or be part of an MSP_MULTIPLE: an out message we know
+    // that doesn't need a payload, with a response of a known size that fits in the send buffer in one piece so
+    // that sending it never waits for the UART
+    const mspcommandstruct *entry = getmspcommand(command);
+    return entry->handler && !entry->payloadsize && !entry->variablesize && command != MSP_MULTIPLE
+        && (command < MSP_SET_RAW_RC || command == MSP_DEBUG)
+        && entry->responsesize + MSPFRAMEOVERHEAD <= MSPMAXRESPONSESPACE;
+}
+
+static void mspmultiple(char portnumber, unsigned char *data)
+{
+    // answer each of the commands in the payload, in one frame with one checksum.  They are all answered in this
+    // pass through the main loop, so the values go together.  The commands have to pass mspanswerswithoutrequest(),
+    // and their responses have to fit in MSPMULTIPLEMAXSIZE with a size byte each.
+    unsigned char count = serialdatasize[portnumber];
+    int size = 0;
+    for (int x = 0; x < count; ++x) {
+        if (!mspanswerswithoutrequest(data[x])) {
+            senderrorheader(portnumber);
+            return;
         }
-    } else if (command == MSP_BOX) {    // send check box settings
-        sendgoodheader(portnumber, NUMCHECKBOXES * 2);
-        sendandchecksumdata(portnumber, (unsigned char *) usersettings.checkboxconfiguration, NUMCHECKBOXES * 2);
-    } else if (command == MSP_RESET_CONF) {     // reset user settings
-        sendgoodheader(portnumber, 0);
-        defaultusersettings();
-    } else if (command == MSP_EEPROM_WRITE) {   // reset user settings
-        sendgoodheader(portnumber, 0);
-        if (!global.armed)
-            writeusersettingstoeeprom();
-    } else if (command == MSP_RAW_GPS) {        // reset user settings
-        sendgoodheader(portnumber, 14);
-        sendandchecksumcharacter(portnumber, 0);        // gps fix
-        sendandchecksumcharacter(portnumber, global.gps_num_satelites);
-        sendandchecksumlong(portnumber, lib_fp_multiply(global.gps_current_latitude, 156250L)); //156250L is 10,000,000L>>LATLONGEXTRASHIFT); 
-        sendandchecksumlong(portnumber, lib_fp_multiply(global.gps_current_longitude, 156250L));
-        sendandchecksumint(portnumber, global.gps_current_altitude >> FIXEDPOINTSHIFT); // gps altitude
-        sendandchecksumint(portnumber, (global.gps_current_speed * 100) >>FIXEDPOINTSHIFT);     // gps speed
-    } else if (command == MSP_COMP_GPS) {       // reset user settings
-        sendgoodheader(portnumber, 5);
-        sendandchecksumint(portnumber, (global.navigation_distance) >>FIXEDPOINTSHIFT);
-        sendandchecksumint(portnumber, (global.navigation_bearing) >>FIXEDPOINTSHIFT);
-        sendandchecksumcharacter(portnumber, 0);        // gps update
-    } else if (command == MSP_RC_TUNING) {      // user settings
-        sendgoodheader(portnumber, 7);
-        sendandchecksumcharacter(portnumber, 0);        // rcRate
-        sendandchecksumcharacter(portnumber, 0);        // rcExpo
-        sendandchecksumcharacter(portnumber, usersettings.maxpitchandrollrate >> (FIXEDPOINTSHIFT + 3));        // rollPitchRate
-        sendandchecksumcharacter(portnumber, usersettings.maxyawrate >> (FIXEDPOINTSHIFT + 2)); // yawRate
-        sendandchecksumcharacter(portnumber, 0);        // dynThrPID
-        sendandchecksumcharacter(portnumber, 0);        // thrMid8
-        sendandchecksumcharacter(portnumber, 0);        // thrExpo8
-    } else if (command == MSP_SET_RC_TUNING) {  // user settings
-        data++;                 //rcRate
-        data++;                 //rcExpo
-        usersettings.maxpitchandrollrate = ((fixedpointnum) (*data++)) << (FIXEDPOINTSHIFT + 3);        // rollPitchRate
-        usersettings.maxyawrate = ((fixedpointnum) (*data++)) << (FIXEDPOINTSHIFT + 2); // yawRate
-        data++;                 // dynThrPID
-        data++;                 // thrMid8
-        data++;                 // thrExpo8
-        sendgoodheader(portnumber, 0);
+        size += 1 + getmspcommand(data[x])->responsesize;
     }
-
-    else                        // we don't know this command
-    {
+    if (size > MSPMULTIPLEMAXSIZE) {
         senderrorheader(portnumber);
+        return;
+    }
+
+    sendgoodheader(portnumber, size);
+    serialbatching = true;
+    for (int x = 0; x < count; ++x) {
+        serialcommand[portnumber] = data[x];
+        serialdatasize[portnumber] = 0;
+        getmspcommand(data[x])->handler(portnumber, data);
     }
-    lib_serial_sendchar(portnumber, serialchecksum[portnumber]);
+    serialbatching = false;
+    serialcommand[portnumber] = MSP_MULTIPLE;
+    serialdatasize[portnumber] = count;
+}
+
+void evaluatecommand(char portnumber, unsigned char *data)
+{
+    const mspcommandstruct *entry = getmspcommand(serialcommand[portnumber]);
+    if (entry->handler && serialdatasize[portnumber] >= entry->payloadsize)
+        entry->handler(portnumber, data);
+    else                        // we don't know this command, or the request is too short for it
+        senderrorheader(portnumber);
+    lib_serial_framechar(&serialframe, serialchecksum[portnumber]);
+    lib_serial_sendframe(&serialframe);
 }
 
 #define MAXPAYLOADSIZE 64
 
+#if (MSP_TELEMETRY==YES)
+void serialsendtelemetry(char portnumber)
+{
+    // send the responses that are due, after the requests have been answered and only while the budget lasts.
+    // A request may be half received, so what the receiver keeps about it is put back afterwards.
+    unsigned char command = serialcommand[portnumber];
+    unsigned char datasize = serialdatasize[portnumber];
+    unsigned char checksum = serialchecksum[portnumber];
+    unsigned char nodata[1] = { 0 };
+    int budget = MSP_TELEMETRY_BYTES_PER_LOOP;
+
+    for (int x = 0; x < MSPTELEMETRYSLOTS && budget > 0; ++x) {
+        unsigned char slotnumber = (msptelemetrynextslot + x) % MSPTELEMETRYSLOTS;
+        msptelemetrystruct *slot = &msptelemetry[slotnumber];
+        if (!slot->periodmicroseconds || slot->portnumber != portnumber
+            || lib_timers_gettimermicroseconds(slot->lastsent) < slot->periodmicroseconds)
+            continue;
+        if (lib_serial_availableoutputbuffersize(portnumber) < mspresponsespace(slot->command))
+            break;
+
+        // keep to the rate, but don't send a burst to catch up after falling behind
+        slot->lastsent += slot->periodmicroseconds;
+        if (lib_timers_gettimermicroseconds(slot->lastsent) >= slot->periodmicroseconds)
+            slot->lastsent = lib_timers_starttimer();
+
+        serialcommand[portnumber] = slot->command;
+        serialdatasize[portnumber] = 0;
+        evaluatecommand(portnumber, nodata);
+        budget -= serialresponsesize;
+        msptelemetrynextslot = (slotnumber + 1) % MSPTELEMETRYSLOTS;
+    }
+
+    serialcommand[portnumber] = command;
+    serialdatasize[portnumber] = datasize;
+    serialchecksum[portnumber] = checksum;
+}
+#endif
+
 void serialcheckportforaction(char portnumber)
 {
     int numcharsavailable;
@@ -313,11 +770,8 @@ void serialcheckportforaction(char portnumber)
         if (serialreceivestate[portnumber] == SERIALSTATEGOTCOMMAND) {
             // this is the only state where we have to read more than one byte, so do this first, even though it's not first in the sequence of events
             // we need to wait for data plus the checksum.  But don't process until we have enough space in the output buffer
-            int spaceneeded = 40;
-            if (serialcommand[portnumber] == MSP_BOXNAMES)
-                spaceneeded = strlen(checkboxnames) + 10;
-
-            if (numcharsavailable > serialdatasize[portnumber] && lib_serial_availableoutputbuffersize(portnumber) >= spaceneeded) {
+            // for the response.
+            if (numcharsavailable > serialdatasize[portnumber] && lib_serial_availableoutputbuffersize(portnumber) >= mspresponsespace(serialcommand[portnumber])) {
                 unsigned char data[MAXPAYLOADSIZE + 1];
                 lib_serial_getdata(portnumber, data, serialdatasize[portnumber] + 1);
                 for (int x = 0; x < serialdatasize[portnumber]; ++x)
@@ -327,7 +781,7 @@ void serialcheckportforaction(char portnumber)
                 }
                 serialreceivestate[portnumber] = SERIALSTATEIDLE;
             } else
-                return;
+                break;
         } else {
             unsigned char c = lib_serial_getchar(portnumber);
 
@@ -359,6 +813,9 @@ void serialcheckportforaction(char portnumber)
             }
         }
     }
+#if (MSP_TELEMETRY==YES)
+    serialsendtelemetry(portnumber);
+#endif
 }
 
 //#define SERIALTEXTDEBUG
@@ -420,6 +877,7 @@ void serialcheckportforactiontest(char portnumber)
                 serialprintfixedpoint(portnumber, global.acc_g_vector[x]);
             }
         } else if (c == 't') {  // atttude angle values
+            imuupdateeulerattitude();
             for (int x = 0; x < 3; ++x) {
                 serialprintfixedpoint(portnumber, global.currentestimatedeulerattitude[x]);
             }
@@ -43,6 +43,12 @@ void serialcheckforaction(void);
 #define MSP_PIDNAMES             117    //out message         the PID names
 #define MSP_WP                   118    //out message         get a WP, WP# is in the payload, returns (WP#, lat, lon, alt, flags) WP#0-home, WP#16-poshold
 
+#define MSP_LOOP_PROFILE         150    //out message         entry# is in the payload, returns (entry#, #entries, count, min, avg, max, 8 histogram buckets)
+#define MSP_LINK_STATS           151    //out message         seconds ago is in the payload, returns (seconds ago, #seconds, valid, bad checksum, wrong tx id, timeouts, rssi)
+#define MSP_STARTUP_TIMES        152    //out message         microseconds from power on to the end of calibration, to binding (0 if no binding) and to the main loop
+#define MSP_BLACKBOX_READ        153    //out message         offset is in the payload, returns (offset, blackbox size, up to 32 bytes of the log)
+#define MSP_MULTIPLE             154    //out message         out message numbers are in the payload, returns (size, data) of each of their responses in one frame
+
 #define MSP_SET_RAW_RC           200    //in message          8 rc chan
 #define MSP_SET_RAW_GPS          201    //in message          fix, numsat, lat, lon, alt, speed
 #define MSP_SET_PID              202    //in message          up to 16 P I D (8 are used)
@@ -54,6 +60,9 @@ void serialcheckforaction(void);
 #define MSP_RESET_CONF           208    //in message          no param
 #define MSP_WP_SET               209    //in message          sets a given WP (WP#,lat, lon, alt, flags)
 
+#define MSP_RESET_LOOP_PROFILE   230    //in message          no param
+#define MSP_SET_TELEMETRY        231    //in message          up to 4 (command, rate in Hz) pairs, those responses are then sent without requests.  No pairs stops them
+
 #define MSP_EEPROM_WRITE         250    //in message          no param
 
 #define MSP_DEBUG                254    //out message         debug1,debug2,debug3,debug4
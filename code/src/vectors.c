@@ -20,13 +20,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 extern globalstruct global;
 
-void vectorcrossproduct(fixedpointnum * v1, fixedpointnum * v2, fixedpointnum * v3)
-{
-    v3[XINDEX] = lib_fp_multiply(v1[YINDEX], v2[ZINDEX]) - lib_fp_multiply(v1[ZINDEX], v2[YINDEX]);
-    v3[YINDEX] = lib_fp_multiply(v1[ZINDEX], v2[XINDEX]) - lib_fp_multiply(v1[XINDEX], v2[ZINDEX]);
-    v3[ZINDEX] = lib_fp_multiply(v1[XINDEX], v2[YINDEX]) - lib_fp_multiply(v1[YINDEX], v2[XINDEX]);
-}
-
 fixedpointnum normalizevector(fixedpointnum * v)
 {
     fixedpointnum vectorlengthsquared = lib_fp_multiply(v[0], v[0])
@@ -47,11 +40,6 @@ fixedpointnum normalizevector(fixedpointnum * v)
     return (vectorlengthsquared);
 }
 
-fixedpointnum vectordotproduct(fixedpointnum * v1, fixedpointnum * v2)
-{
-    return (lib_fp_multiply(v1[0], v2[0]) + lib_fp_multiply(v1[1], v2[1]) + lib_fp_multiply(v1[2], v2[2]));
-}
-
 void rotatevectorwithsmallangles(fixedpointnum * v, fixedpointnum rolldeltaangle, fixedpointnum pitchdeltaangle, fixedpointnum yawdeltaangle)
 {
     // rotate theattitude by the delta angles.
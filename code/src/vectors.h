@@ -25,11 +25,22 @@ typedef struct {
     fixedpointnum downvector[3];
 } attitudestruct;
 
-void vectorcrossproduct(fixedpointnum * v1, fixedpointnum * v2, fixedpointnum * v3);
 fixedpointnum normalizevector(fixedpointnum * v);
-fixedpointnum vectordotproduct(fixedpointnum * v1, fixedpointnum * v2);
 void vectordifferencetoeulerangles(fixedpointnum * v1, fixedpointnum * v2, fixedpointnum * euler);
 void attitudetoeulerangles(attitudestruct * theattitude, fixedpointnum * eulerangles);
 void rotatevectorwithsmallangles(fixedpointnum * v, fixedpointnum rolldeltaangle, fixedpointnum pitchdeltaangle, fixedpointnum yawdeltaangle);
 void rotatevectorbyaxisangle(fixedpointnum * v1, fixedpointnum * axisvector, fixedpointnum angle, fixedpointnum * v2);
 void rotatevectorbyaxissmallangle(fixedpointnum * v1, fixedpointnum * axisvector, fixedpointnum angle);
+
+// the small vector operations are inline, like the lib_fp kernels they are built from.  Indexes are x, y, z.
+static inline void vectorcrossproduct(fixedpointnum * v1, fixedpointnum * v2, fixedpointnum * v3)
+{
+    v3[0] = lib_fp_multiply(v1[1], v2[2]) - lib_fp_multiply(v1[2], v2[1]);
+    v3[1] = lib_fp_multiply(v1[2], v2[0]) - lib_fp_multiply(v1[0], v2[2]);
+    v3[2] = lib_fp_multiply(v1[0], v2[1]) - lib_fp_multiply(v1[1], v2[0]);
+}
+
+static inline fixedpointnum vectordotproduct(fixedpointnum * v1, fixedpointnum * v2)
+{
+    return (lib_fp_multiply(v1[0], v2[0]) + lib_fp_multiply(v1[1], v2[1]) + lib_fp_multiply(v1[2], v2[2]));
+}